@@ -0,0 +1,49 @@
+/*
+ * Benchmarks for MidiConsoleApplication. They run the app's own modules,
+ * without its window, and print one table each.
+ *
+ * Usage: MidiBench <bench> [args]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+struct Bench {
+    const char* name;
+    const char* args;
+    const char* description;
+    int (*run)(int argc, char* argv[]);
+};
+
+static const Bench benches[] = {
+    { "backends", "[loopback port]", "delivery of notes due on a schedule, per output backend", bench_backends },
+    { "lanes", "[events/s per controller, 0 floods] [output port]", "throughput and latency of 1 to 16 controllers on device lanes", bench_lanes },
+    { "ump", "[packets]", "UMP encoder packing throughput", bench_ump },
+    { "axes", "[reports]", "axis filter batch throughput by the number of moving axes", bench_axes },
+    { "jack", "[messages]", "frames the JACK backend places notes and SysEx at, against a running server", bench_jack },
+    { "osc", "[frames]", "OSC messages and bundles from buttons and axes, decoded on a UDP port of the bench", bench_osc },
+    { "rtp", "[output port]", "RTP-MIDI commands and recovery journal as a loopback peer sees them", bench_rtp },
+};
+
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s <bench> [args]\n\n", program);
+    for (unsigned int i = 0; i < SDL_arraysize(benches); i++) {
+        fprintf(stderr, "  %s %s\n      %s\n", benches[i].name, benches[i].args, benches[i].description);
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        for (unsigned int i = 0; i < SDL_arraysize(benches); i++) {
+            if (strcmp(argv[1], benches[i].name) == 0) {
+                return benches[i].run(argc - 2, argv + 2);
+            }
+        }
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,27 @@
+#include <algorithm>
+#include <stdio.h>
+
+#include "bench.h"
+
+
+static double percentile_ms(const std::vector<Sint64>& sorted, double share) {
+    size_t i = (size_t)(share * (sorted.size() - 1));
+    return sorted[i] / 1e6;
+}
+
+
+void print_latency_header() {
+    printf("%-24s %8s %8s %8s %8s %8s %9s\n", "", "Count", "Lost", "p50 ms", "p99 ms", "Max ms", "Jitter ms");
+}
+
+
+void print_latencies(const char* label, std::vector<Sint64>& latencies, int lost) {
+    if (latencies.empty()) {
+        printf("%-24s %8d %8d\n", label, 0, lost);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-24s %8d %8d %8.3f %8.3f %8.3f %9.3f\n", label, (int)latencies.size(), lost,
+        percentile_ms(latencies, 0.5), percentile_ms(latencies, 0.99), latencies.back() / 1e6,
+        percentile_ms(latencies, 0.99) - percentile_ms(latencies, 0.01));
+}
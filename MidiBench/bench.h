@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+
+// Each bench runs the modules of MidiConsoleApplication it measures without
+// the window, args are what follows its name. Returns the exit code.
+int bench_backends(int argc, char* argv[]);
+int bench_lanes(int argc, char* argv[]);
+int bench_ump(int argc, char* argv[]);
+int bench_axes(int argc, char* argv[]);
+int bench_jack(int argc, char* argv[]);
+int bench_osc(int argc, char* argv[]);
+int bench_rtp(int argc, char* argv[]);
+
+// The first port of an RtMidiIn or RtMidiOut whose name contains name, -1
+// for none.
+template <typename Port>
+int find_port(Port& port, const char* name) {
+    for (unsigned int i = 0; i < port.getPortCount(); i++) {
+        if (port.getPortName(i).find(name) != std::string::npos) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void print_latency_header();
+// One row of latencies in ns: p50, p99, max and the spread of the middle
+// 98%. Sorts latencies.
+void print_latencies(const char* label, std::vector<Sint64>& latencies, int lost);
@@ -0,0 +1,53 @@
+/*
+ * Steps the axis filter bank the way stick reports do, with 1 to 16 axes
+ * moving in each report. Every event steps all FILTER_AXES as one batch, so
+ * the time per axis event should stay flat as more axes move and the axes
+ * handled per second grow with them. Build without AVX, or for 32-bit x86
+ * without SSE2, to compare with fewer lanes or the scalar fallback.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../MidiConsoleApplication/axis_filter.h"
+#include "../MidiConsoleApplication/simd.h"
+#include "../MidiConsoleApplication/xy_pad.h"
+#include "bench.h"
+
+#define AXES_REPORTS 200000
+
+
+static void run_axes(int moving, int reports) {
+    Uint64 start = SDL_GetTicksNS();
+    for (int r = 0; r < reports; r++) {
+        // Full sweeps back and forth, every event changes its axis.
+        Sint16 position = (Sint16)((r & 1) ? 16000 : -16000);
+        for (int a = 0; a < moving; a++) {
+            filter_axis(a, (Sint16)(position + a));
+        }
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    double events = (double)reports * moving;
+    printf("%8d %10d %12.1f %12.1f %14.0f\n", moving, reports, (double)elapsed / reports, elapsed / events,
+        events * 1e9 / elapsed);
+}
+
+
+int bench_axes(int argc, char* argv[]) {
+    int reports = argc > 0 ? atoi(argv[0]) : AXES_REPORTS;
+    if (reports <= 0) {
+        fprintf(stderr, "The count is stick reports per row\n");
+        return 1;
+    }
+    // Set up like the app does, with every axis feature off. The settle ticks
+    // don't run, the timing thread isn't started.
+    if (!xy_init() || !filter_init()) {
+        return 1;
+    }
+    printf("%d axes a batch, %d lanes wide\n\n", FILTER_AXES, SIMD_LANES);
+    printf("%8s %10s %12s %12s %14s\n", "Moving", "Reports", "ns/report", "ns/event", "axis events/s");
+    for (int moving = 1; moving <= FILTER_AXES; moving *= 2) {
+        run_axes(moving, reports);
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Plays notes paced like the timing thread, each stamped with the time it was
+ * due, through every output backend of this build, and takes the time each
+ * one arrives back on a loopback input. The latency histograms of the app
+ * only know when a native backend was asked to send a message, this measures
+ * when it was delivered.
+ *
+ * Without a loopback port the bench listens on a virtual port of its own
+ * (ALSA, CoreMIDI). On Windows pass a loopback driver port, like loopMIDI's.
+ */
+
+#include <atomic>
+#include <stdio.h>
+
+#include <RtMidi.h>
+
+#include "../MidiConsoleApplication/midi_output.h"
+#if defined(__LINUX_ALSA__)
+#include "../MidiConsoleApplication/alsa_seq.h"
+#endif
+#include "bench.h"
+
+#define BACKENDS_NOTES 2000
+#define BACKENDS_INTERVAL_NS SDL_MS_TO_NS(5)
+#define BACKENDS_FIXED_LATENCY_US 3000
+#define BACKENDS_SETTLE_MS 200
+#define LOOPBACK_NAME "MidiBench In"
+
+// When each note came back, 0 until it does. Written by RtMidi's input thread.
+static std::atomic<Uint64> arrivals[BACKENDS_NOTES];
+
+
+// Note k is note k % 128 with velocity 1 + k / 128, never a note-off.
+static int note_index(unsigned char note, unsigned char velocity) {
+    return note + 128 * (velocity - 1);
+}
+
+
+static void on_message(double, std::vector<unsigned char>* message, void*) {
+    Uint64 now = SDL_GetTicksNS();
+    if (message->size() != 3 || ((*message)[0] & 0xF0) != 0x90 || (*message)[2] == 0) {
+        return;
+    }
+    int index = note_index((*message)[1], (*message)[2]);
+    if (index < BACKENDS_NOTES) {
+        arrivals[index].store(now, std::memory_order_relaxed);
+    }
+}
+
+
+// The app's idea of the p99, from the histogram of what this run sent. Like
+// the bench it counts from the stamp of a message.
+static double reported_p99_ms(const MidiOutputCounters& before, const MidiOutputCounters& after) {
+    Uint32 total = after.sent - before.sent;
+    Uint32 seen = 0;
+    for (int b = 0; b < MIDI_LATENCY_BUCKETS; b++) {
+        seen += after.histogram[b] - before.histogram[b];
+        if (total > 0 && seen >= total * 0.99) {
+            return (b + 1) * MIDI_LATENCY_BUCKET_US / 1000.0;
+        }
+    }
+    return MIDI_LATENCY_BUCKETS * MIDI_LATENCY_BUCKET_US / 1000.0;
+}
+
+
+// Latency is from the stamp of a note to when it arrived, at best the fixed
+// latency.
+static void run_backend(const char* label, int backend) {
+    if (!midi_output_set_backend(0, backend)) {
+        printf("%-24s not available\n", label);
+        return;
+    }
+    for (int k = 0; k < BACKENDS_NOTES; k++) {
+        arrivals[k].store(0);
+    }
+    MidiOutputCounters before;
+    midi_output_counters(0, &before);
+
+    std::vector<Uint64> stamps(BACKENDS_NOTES);
+    Uint64 start = SDL_GetTicksNS() + BACKENDS_INTERVAL_NS;
+    for (int k = 0; k < BACKENDS_NOTES; k++) {
+        Uint64 target = start + k * BACKENDS_INTERVAL_NS;
+        Uint64 now = SDL_GetTicksNS();
+        if (target > now) {
+            SDL_DelayPrecise(target - now);
+        }
+        midi_output_stamp(target);
+        midi_output_send(0x90, (unsigned char)(k % 128), (unsigned char)(1 + k / 128));
+        stamps[k] = target;
+    }
+    midi_output_stamp(0);
+    SDL_Delay(BACKENDS_SETTLE_MS);
+
+    MidiOutputCounters after;
+    midi_output_counters(0, &after);
+    std::vector<Sint64> latencies;
+    int lost = 0;
+    for (int k = 0; k < BACKENDS_NOTES; k++) {
+        Uint64 arrival = arrivals[k].load();
+        if (arrival == 0) {
+            lost++;
+        }
+        else {
+            latencies.push_back((Sint64)(arrival - stamps[k]));
+        }
+    }
+    print_latencies(label, latencies, lost);
+    printf("%-24s %35.3f\n", "  app histogram", reported_p99_ms(before, after));
+}
+
+
+int bench_backends(int argc, char* argv[]) {
+    const char* loopback = argc > 0 ? argv[0] : LOOPBACK_NAME;
+    RtMidiIn in(RtMidi::UNSPECIFIED, "MidiBench");
+    RtMidiOut out;
+    try {
+        if (argc > 0) {
+            int port = find_port(in, loopback);
+            if (port < 0) {
+                fprintf(stderr, "No MIDI input named %s\n", loopback);
+                return 1;
+            }
+            in.openPort(port);
+        }
+        else {
+            in.openVirtualPort(LOOPBACK_NAME);
+        }
+        int port = find_port(out, loopback);
+        if (port < 0) {
+            fprintf(stderr, "No MIDI output named %s\n", loopback);
+            return 1;
+        }
+        out.openPort(port);
+    }
+    catch (RtMidiError& error) {
+        error.printMessage();
+        return 1;
+    }
+    in.setCallback(on_message);
+
+    if (!midi_output_start(&out)) {
+        return 1;
+    }
+    midi_output_set_fixed_latency(BACKENDS_FIXED_LATENCY_US);
+#if defined(__LINUX_ALSA__)
+    if (alsa_seq_open() && !alsa_seq_connect(0, loopback)) {
+        fprintf(stderr, "Couldn't connect the ALSA sequencer port to %s\n", loopback);
+    }
+#endif
+
+    printf("%d notes %d ms apart, fixed latency %.1f ms, latency from stamp to arrival\n\n", BACKENDS_NOTES,
+        (int)(BACKENDS_INTERVAL_NS / SDL_NS_PER_MS), BACKENDS_FIXED_LATENCY_US / 1000.0);
+    print_latency_header();
+    run_backend("RtMidi", BACKEND_RTMIDI);
+    run_backend("ALSA Seq", BACKEND_ALSA_SEQ);
+
+    midi_output_stop();
+#if defined(__LINUX_ALSA__)
+    alsa_seq_close();
+#endif
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Sends notes and SysEx through the JACK MIDI backend, each due on a
+ * schedule that doesn't line up with the periods, and reads them back on a
+ * JACK input port of the bench. Every message should land one period after
+ * its due time, at the frame that time falls on, and SysEx should arrive the
+ * way it was sent even though the bench reuses its buffer right away.
+ *
+ * Needs a running JACK server. The dummy backend keeps the periods steady
+ * without a sound card:
+ *
+ *     jackd -d dummy -r 48000 -p 256
+ */
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#if defined(__UNIX_JACK__)
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include "../MidiConsoleApplication/jack_midi.h"
+
+#define JACK_EVENTS 2000
+#define JACK_INTERVAL_NS 1370000 // a little over 1 ms, off the period grid
+#define JACK_LEAD_NS SDL_MS_TO_NS(20) // how long before it is due a message is sent
+#define JACK_START_NS SDL_MS_TO_NS(100)
+#define JACK_SETTLE_MS 200
+#define JACK_SYSEX_EVERY 10 // every tenth message is SysEx
+#define JACK_SYSEX_MAX 48
+#define JACK_TOLERANCE_FRAMES 2 // the clocks are compared a cycle apart
+
+// Written by the process callback of the bench client, read once it is done.
+static Uint64 dues[JACK_EVENTS];
+static Sint64 errors[JACK_EVENTS]; // frames after where it should have landed
+static std::atomic<bool> arrived[JACK_EVENTS];
+static std::atomic<Uint32> corrupt(0);
+static std::atomic<Uint32> strays(0);
+
+static jack_client_t* bench_client = NULL;
+static jack_port_t* in_port = NULL;
+
+
+static bool is_sysex(int k) {
+    return k % JACK_SYSEX_EVERY == JACK_SYSEX_EVERY - 1;
+}
+
+
+// F0 7D, the index in two bytes, then a payload that depends on it, then F7.
+static Uint32 fill_sysex(int k, unsigned char* data) {
+    Uint32 size = 5 + k % (JACK_SYSEX_MAX - 5);
+    data[0] = 0xF0;
+    data[1] = 0x7D;
+    data[2] = (unsigned char)(k >> 7);
+    data[3] = (unsigned char)(k & 0x7F);
+    for (Uint32 i = 4; i < size - 1; i++) {
+        data[i] = (unsigned char)((k + i) & 0x7F);
+    }
+    data[size - 1] = 0xF7;
+    return size;
+}
+
+
+// Which message this is, -1 if it isn't one of ours.
+static int event_index(const jack_midi_event_t& event) {
+    if (event.size >= 5 && event.buffer[0] == 0xF0 && event.buffer[1] == 0x7D) {
+        int k = event.buffer[2] << 7 | event.buffer[3];
+        if (k >= JACK_EVENTS || !is_sysex(k)) {
+            return -1;
+        }
+        unsigned char expected[JACK_SYSEX_MAX];
+        Uint32 size = fill_sysex(k, expected);
+        if (event.size != size || SDL_memcmp(event.buffer, expected, size) != 0) {
+            corrupt.fetch_add(1, std::memory_order_relaxed);
+        }
+        return k;
+    }
+    // Note k is note k % 128 with velocity 1 + k / 128, like the backends bench.
+    if (event.size == 3 && (event.buffer[0] & 0xF0) == 0x90 && event.buffer[2] > 0) {
+        int k = event.buffer[1] + 128 * (event.buffer[2] - 1);
+        return k < JACK_EVENTS && !is_sysex(k) ? k : -1;
+    }
+    return -1;
+}
+
+
+// Runs after the app's client in every cycle, the port is connected to it.
+static int on_process(jack_nframes_t nframes, void*) {
+    void* buffer = jack_port_get_buffer(in_port, nframes);
+    jack_nframes_t cycle = jack_last_frame_time(bench_client);
+    Sint64 offset_us = (Sint64)jack_get_time() - (Sint64)(SDL_GetTicksNS() / SDL_NS_PER_US);
+    Uint32 count = jack_midi_get_event_count(buffer);
+    for (Uint32 e = 0; e < count; e++) {
+        jack_midi_event_t event;
+        if (jack_midi_event_get(&event, buffer, e) != 0) {
+            continue;
+        }
+        int k = event_index(event);
+        if (k < 0 || arrived[k].load(std::memory_order_relaxed)) {
+            strays.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        // Written in the cycle after the one its due time falls in.
+        Sint64 due_us = (Sint64)(dues[k] / SDL_NS_PER_US) + offset_us;
+        jack_nframes_t expected = jack_time_to_frames(bench_client, (jack_time_t)due_us) + nframes;
+        errors[k] = (Sint64)(Sint32)(cycle + event.time - expected);
+        arrived[k].store(true, std::memory_order_release);
+    }
+    return 0;
+}
+
+
+static bool open_bench_client() {
+    jack_status_t status;
+    bench_client = jack_client_open("MidiBench", JackNoStartServer, &status);
+    if (bench_client == NULL) {
+        return false;
+    }
+    in_port = jack_port_register(bench_client, "in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+    if (in_port == NULL || jack_set_process_callback(bench_client, on_process, NULL) != 0 ||
+        jack_activate(bench_client) != 0) {
+        jack_client_close(bench_client);
+        bench_client = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+static void print_row(const char* label, bool sysex, int events) {
+    int count = 0;
+    int lost = 0;
+    int exact = 0;
+    Sint64 worst = 0;
+    for (int k = 0; k < events; k++) {
+        if (is_sysex(k) != sysex) {
+            continue;
+        }
+        if (!arrived[k].load(std::memory_order_acquire)) {
+            lost++;
+            continue;
+        }
+        count++;
+        Sint64 error = errors[k] < 0 ? -errors[k] : errors[k];
+        if (error == 0) {
+            exact++;
+        }
+        worst = SDL_max(worst, error);
+    }
+    printf("%-24s %8d %8d %8d %12lld\n", label, count, lost, exact, (long long)worst);
+}
+
+
+// Returns false if a message was lost, corrupted or landed off its frame.
+static bool check(int events) {
+    for (int k = 0; k < events; k++) {
+        if (!arrived[k].load(std::memory_order_acquire)) {
+            return false;
+        }
+        if (errors[k] < -JACK_TOLERANCE_FRAMES || errors[k] > JACK_TOLERANCE_FRAMES) {
+            return false;
+        }
+    }
+    return corrupt.load() == 0 && strays.load() == 0;
+}
+
+
+int bench_jack(int argc, char* argv[]) {
+    int events = argc > 0 ? atoi(argv[0]) : JACK_EVENTS;
+    if (events <= 0 || events > JACK_EVENTS) {
+        fprintf(stderr, "The count is messages, up to %d\n", JACK_EVENTS);
+        return 1;
+    }
+    if (!jack_midi_open() || !open_bench_client()) {
+        fprintf(stderr, "Couldn't connect to the JACK server, start one like jackd -d dummy -r 48000 -p 256\n");
+        jack_midi_close();
+        return 1;
+    }
+    if (!jack_midi_connect(0, jack_port_name(in_port))) {
+        jack_client_close(bench_client);
+        jack_midi_close();
+        return 1;
+    }
+    printf("%d messages %.2f ms apart, %u Hz, %u frames a period, frames off where they should land\n\n", events,
+        JACK_INTERVAL_NS / 1e6, (unsigned int)jack_get_sample_rate(bench_client),
+        (unsigned int)jack_get_buffer_size(bench_client));
+    printf("%-24s %8s %8s %8s %12s\n", "", "Count", "Lost", "Exact", "Max frames");
+
+    Uint64 start = SDL_GetTicksNS() + JACK_START_NS;
+    for (int k = 0; k < events; k++) {
+        dues[k] = start + k * JACK_INTERVAL_NS;
+    }
+    int refused = 0;
+    unsigned char sysex[JACK_SYSEX_MAX];
+    for (int k = 0; k < events; k++) {
+        Uint64 target = dues[k] - JACK_LEAD_NS;
+        Uint64 now = SDL_GetTicksNS();
+        if (target > now) {
+            SDL_DelayPrecise(target - now);
+        }
+        MidiMessage msg;
+        msg.timestamp = dues[k];
+        if (is_sysex(k)) {
+            msg.long_data = sysex;
+            msg.long_size = fill_sysex(k, sysex);
+        }
+        else {
+            msg.bytes[0] = 0x90;
+            msg.bytes[1] = (unsigned char)(k % 128);
+            msg.bytes[2] = (unsigned char)(1 + k / 128);
+            msg.size = 3;
+        }
+        if (!jack_midi_send(msg, dues[k])) {
+            refused++;
+        }
+        // The backend copied it, what was sent must not change with this.
+        SDL_memset(sysex, 0x55, sizeof(sysex));
+    }
+    SDL_Delay(JACK_SETTLE_MS);
+
+    jack_deactivate(bench_client);
+    print_row("notes", false, events);
+    print_row("SysEx", true, events);
+    bool passed = refused == 0 && check(events);
+    printf("\n%d refused, %u corrupted, %u strays: %s\n", refused, corrupt.load(), strays.load(),
+        passed ? "passed" : "FAILED");
+
+    jack_client_close(bench_client);
+    jack_midi_close();
+    return passed ? 0 : 1;
+}
+
+#else
+
+int bench_jack(int argc, char* argv[]) {
+    fprintf(stderr, "Built without JACK\n");
+    return 1;
+}
+
+#endif
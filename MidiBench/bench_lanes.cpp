@@ -0,0 +1,211 @@
+/*
+ * Plays 1 to 16 virtual joysticks at once, each on a device lane of its own,
+ * every one pressing and releasing buttons at the same rate. Throughput
+ * should grow with the lanes while the p99 latency, from event timestamp to
+ * send, stays flat.
+ *
+ * At rate 0 the controllers flood: events are posted as fast as the main
+ * thread can, to see where the lanes and the output start dropping and how
+ * deep the output queues get. The output's event lane has to hold what 16
+ * lanes produce while its worker catches up.
+ *
+ * Lanes send to a virtual output port of their own (ALSA, CoreMIDI). On
+ * Windows pass an output port, like loopMIDI's.
+ */
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <RtMidi.h>
+
+#include "../MidiConsoleApplication/device_lanes.h"
+#include "../MidiConsoleApplication/mapping.h"
+#include "../MidiConsoleApplication/midi_output.h"
+#include "bench.h"
+
+#define LANES_RATE 4000 // button events per second and controller
+#define LANES_SECONDS 2
+#define LANES_SETTLE_MS 200
+#define LANES_BUTTONS 8 // per controller, each one its own note
+#define LANES_FLOOD_BATCH 64 // events per controller between checks of the clock
+#define LANES_SAMPLES (DEVICE_LANES * 100000)
+#define OUTPUT_NAME "MidiBench Out"
+
+// Event timestamp to send of every message, written by the output workers.
+static Sint64 samples[LANES_SAMPLES];
+static std::atomic<Uint32> sample_count(0);
+
+
+static void on_sent(const MidiMessage& msg, Uint64 sent) {
+    Uint32 i = sample_count.fetch_add(1, std::memory_order_relaxed);
+    if (i < LANES_SAMPLES) {
+        samples[i] = (Sint64)(sent - msg.timestamp);
+    }
+}
+
+
+// Controller i plays notes of its own on channel i.
+static void map_buttons() {
+    JoystickStatus conf[MAPPING_MAX_BUTTONS];
+    for (int b = 0; b < DEVICE_LANES * LANES_BUTTONS; b++) {
+        conf[b].func = NOTE;
+        conf[b].channel = b / LANES_BUTTONS;
+        conf[b].value = 36 + b % LANES_BUTTONS;
+    }
+    mapping_swap(conf);
+}
+
+
+static Uint32 lane_drops() {
+    Uint32 dropped = 0;
+    for (int i = 0; i < DEVICE_LANES; i++) {
+        LaneCounters counters;
+        if (lanes_counters(i, &counters)) {
+            dropped += counters.dropped;
+        }
+    }
+    return dropped;
+}
+
+
+static Uint32 output_queued() {
+    MidiOutputCounters counters;
+    midi_output_counters(0, &counters);
+    Uint32 queued = 0;
+    for (int c = 0; c < MIDI_OUTPUT_LANES; c++) {
+        queued += counters.queued[c];
+    }
+    return queued;
+}
+
+
+// Posts events like SDL_AppEvent does, paced a millisecond at a time or as
+// fast as it can.
+static void run_lanes(int count, int rate) {
+    SDL_JoystickID ids[DEVICE_LANES];
+    for (int i = 0; i < count; i++) {
+        SDL_VirtualJoystickDesc desc;
+        SDL_INIT_INTERFACE(&desc);
+        desc.type = SDL_JOYSTICK_TYPE_GAMEPAD;
+        desc.nbuttons = LANES_BUTTONS;
+        desc.name = "MidiBench Joystick";
+        ids[i] = SDL_AttachVirtualJoystick(&desc);
+        if (ids[i] == 0 || !lanes_attach(ids[i])) {
+            fprintf(stderr, "Couldn't attach joystick %d: %s\n", i + 1, SDL_GetError());
+            for (int j = 0; j <= i; j++) {
+                lanes_detach(ids[j]);
+                SDL_DetachVirtualJoystick(ids[j]);
+            }
+            return;
+        }
+    }
+
+    MidiOutputCounters before;
+    midi_output_counters(0, &before);
+    Uint32 dropped_before = lane_drops();
+    sample_count.store(0);
+
+    Uint64 batch = rate > 0 ? (Uint64)count * rate / 1000 : (Uint64)count * LANES_FLOOD_BATCH;
+    Uint64 start = SDL_GetTicksNS();
+    Uint64 end = start + LANES_SECONDS * SDL_NS_PER_SECOND;
+    Uint32 presses[DEVICE_LANES] = {};
+    Uint32 posted = 0;
+    Uint32 peak = 0;
+    for (Uint64 t = 0;; t++) {
+        Uint64 target = start + t * SDL_NS_PER_MS;
+        Uint64 now = SDL_GetTicksNS();
+        if (now >= end) {
+            break;
+        }
+        if (rate > 0 && target > now) {
+            SDL_DelayPrecise(target - now);
+        }
+        peak = SDL_max(peak, output_queued());
+        for (Uint64 k = 0; k < batch; k++) {
+            int lane = (int)(posted % count);
+            Uint32 n = presses[lane]++;
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = n % 2 == 0 ? SDL_EVENT_JOYSTICK_BUTTON_DOWN : SDL_EVENT_JOYSTICK_BUTTON_UP;
+            event.jbutton.which = ids[lane];
+            event.jbutton.button = (Uint8)(lane * LANES_BUTTONS + (n / 2) % LANES_BUTTONS);
+            event.jbutton.down = n % 2 == 0;
+            event.common.timestamp = SDL_GetTicksNS();
+            lanes_post(&event);
+            posted++;
+        }
+    }
+    Uint64 elapsed = SDL_GetTicksNS() - start;
+    SDL_Delay(LANES_SETTLE_MS);
+
+    MidiOutputCounters after;
+    midi_output_counters(0, &after);
+    Uint32 lane_dropped = lane_drops() - dropped_before;
+    Uint32 sent = SDL_min(sample_count.load(), (Uint32)LANES_SAMPLES);
+    std::vector<Sint64> latencies(samples, samples + sent);
+    for (int i = 0; i < count; i++) {
+        lanes_detach(ids[i]);
+        SDL_DetachVirtualJoystick(ids[i]);
+    }
+    SDL_Delay(LANES_SETTLE_MS); // the notes released on detach aren't the next run's
+
+    char label[32];
+    SDL_snprintf(label, sizeof(label), "%2d lanes %8.0f ev/s", count, posted * 1e9 / elapsed);
+    print_latencies(label, latencies, (int)(posted - sent));
+    printf("%-24s %8.0f msg/s, dropped %u by the lanes, %u by the output, output queue peaked at %u\n", "",
+        sent * 1e9 / elapsed, lane_dropped, after.dropped - before.dropped, peak);
+}
+
+
+int bench_lanes(int argc, char* argv[]) {
+    int rate = argc > 0 ? atoi(argv[0]) : LANES_RATE;
+    if (rate < 0) {
+        fprintf(stderr, "The rate is button events per second and controller, 0 floods\n");
+        return 1;
+    }
+    if (!SDL_Init(SDL_INIT_JOYSTICK)) {
+        fprintf(stderr, "Couldn't initialize SDL: %s\n", SDL_GetError());
+        return 1;
+    }
+    RtMidiOut out;
+    try {
+        if (argc > 1) {
+            int port = find_port(out, argv[1]);
+            if (port < 0) {
+                fprintf(stderr, "No MIDI output named %s\n", argv[1]);
+                return 1;
+            }
+            out.openPort(port);
+        }
+        else {
+            out.openVirtualPort(OUTPUT_NAME);
+        }
+    }
+    catch (RtMidiError& error) {
+        error.printMessage();
+        return 1;
+    }
+    map_buttons();
+    midi_output_add_tap(on_sent);
+    if (!midi_output_start(&out)) {
+        return 1;
+    }
+
+    if (rate > 0) {
+        printf("%d button events per second and controller", rate);
+    }
+    else {
+        printf("Controllers flooding");
+    }
+    printf(" for %d s, latency from event to send\n\n", LANES_SECONDS);
+    print_latency_header();
+    for (int count = 1; count <= DEVICE_LANES; count *= 2) {
+        run_lanes(count, rate);
+    }
+
+    lanes_stop();
+    midi_output_stop();
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Sends OSC from buttons and axes to a UDP port the bench binds on the
+ * loopback and decodes what arrives. A message on its own should go out
+ * bare, the messages of one input frame as a #bundle with the "immediately"
+ * time tag, each element after its size. Then frames go out on a steady
+ * rate, to see how many reach the port and how long the socket thread takes
+ * to send them.
+ */
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "../MidiConsoleApplication/mapping.h"
+#include "../MidiConsoleApplication/net.h"
+#include "../MidiConsoleApplication/osc.h"
+#include "bench.h"
+
+#define OSC_FRAMES 2000
+#define OSC_MAX_FRAMES 32767 // the frame number rides in the axis value
+#define OSC_INTERVAL_NS 500000
+#define OSC_WAIT_MS 500
+#define OSC_MAX_PACKET 512
+#define OSC_BUTTON_ADDRESS "/bench/button"
+#define OSC_AXIS_ADDRESS "/bench/axis/0"
+#define OSC_OTHER_AXIS_ADDRESS "/bench/axis/1"
+
+struct OscExpected {
+    const char* address;
+    float value;
+};
+
+static const unsigned char bundle_header[16] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+
+static NetSocket receiver = NET_NO_SOCKET;
+
+// When each frame of the rate run was sent and arrived, 0 if it didn't.
+static Uint64 sent_at[OSC_MAX_FRAMES];
+static Uint64 arrived_at[OSC_MAX_FRAMES];
+static std::atomic<bool> receiving(false);
+static std::atomic<Uint32> malformed(0);
+
+
+// The size of the next packet, -1 if none came within OSC_WAIT_MS.
+static int receive(unsigned char* data) {
+    Uint64 deadline = SDL_GetTicks() + OSC_WAIT_MS;
+    while (SDL_GetTicks() < deadline) {
+        int size = (int)recvfrom(receiver, (char*)data, OSC_MAX_PACKET, 0, NULL, NULL);
+        if (size > 0) {
+            return size;
+        }
+        SDL_Delay(1);
+    }
+    return -1;
+}
+
+
+static Uint32 read_be32(const unsigned char* data) {
+    Uint32 value;
+    SDL_memcpy(&value, data, 4);
+    return SDL_Swap32BE(value);
+}
+
+
+static float read_float(const unsigned char* data) {
+    Uint32 bits = read_be32(data);
+    float value;
+    SDL_memcpy(&value, &bits, 4);
+    return value;
+}
+
+
+// The message at data: the padded address, ",f" and the float. Returns its
+// size, or -1 if it isn't the message expected.
+static int check_message(const unsigned char* data, int size, const OscExpected& expected) {
+    static const unsigned char tags[4] = { ',', 'f', 0, 0 };
+    int length = (int)SDL_strlen(expected.address);
+    int padded = (length + 4) & ~3;
+    if (size < padded + 8 || SDL_memcmp(data, expected.address, length) != 0) {
+        return -1;
+    }
+    for (int i = length; i < padded; i++) {
+        if (data[i] != 0) {
+            return -1;
+        }
+    }
+    if (SDL_memcmp(data + padded, tags, 4) != 0 || read_float(data + padded + 4) != expected.value) {
+        return -1;
+    }
+    return padded + 8;
+}
+
+
+static bool check_bare(const unsigned char* data, int size, const OscExpected& expected) {
+    return check_message(data, size, expected) == size;
+}
+
+
+static bool check_bundle(const unsigned char* data, int size, const OscExpected* expected, int count) {
+    if (size < (int)sizeof(bundle_header) || SDL_memcmp(data, bundle_header, sizeof(bundle_header)) != 0) {
+        return false;
+    }
+    int offset = sizeof(bundle_header);
+    for (int m = 0; m < count; m++) {
+        if (offset + 4 > size) {
+            return false;
+        }
+        int element_size = (int)read_be32(data + offset);
+        offset += 4;
+        if (offset + element_size > size || check_message(data + offset, element_size, expected[m]) != element_size) {
+            return false;
+        }
+        offset += element_size;
+    }
+    return offset == size;
+}
+
+
+static bool print_case(const char* label, bool passed) {
+    printf("%-40s %s\n", label, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+
+// What each input frame should turn into on the wire.
+static bool run_encodings() {
+    unsigned char data[OSC_MAX_PACKET];
+    bool passed = true;
+
+    osc_button(0, true);
+    int size = receive(data);
+    OscExpected down = { OSC_BUTTON_ADDRESS, 1.0f };
+    passed &= print_case("button outside a frame, bare", size > 0 && check_bare(data, size, down));
+
+    mapping_frame_begin();
+    osc_axis(0, -32768);
+    mapping_frame_end();
+    size = receive(data);
+    OscExpected low = { OSC_AXIS_ADDRESS, -1.0f };
+    passed &= print_case("one axis in a frame, bare", size > 0 && check_bare(data, size, low));
+
+    mapping_frame_begin();
+    osc_button(0, false);
+    osc_axis(0, 32767);
+    osc_axis(1, 0);
+    // No address, nothing in the bundle.
+    osc_button(1, true);
+    mapping_frame_end();
+    size = receive(data);
+    OscExpected frame[3] = { { OSC_BUTTON_ADDRESS, 0.0f }, { OSC_AXIS_ADDRESS, 1.0f }, { OSC_OTHER_AXIS_ADDRESS, 0.0f } };
+    passed &= print_case("button and two axes in a frame, #bundle", size > 0 && check_bundle(data, size, frame, 3));
+
+    passed &= print_case("nothing else", receive(data) < 0);
+    return passed;
+}
+
+
+// Frame k is a bundle of button 0 and axis 0 at k.
+static void receiver_thread() {
+    unsigned char data[OSC_MAX_PACKET];
+    while (receiving.load(std::memory_order_acquire)) {
+        int size = (int)recvfrom(receiver, (char*)data, OSC_MAX_PACKET, 0, NULL, NULL);
+        if (size <= 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        Uint64 now = SDL_GetTicksNS();
+        // The axis comes last, its float is the last 4 bytes.
+        int k = size > 4 ? (int)(read_float(data + size - 4) * 32767.0f + 0.5f) : -1;
+        OscExpected expected[2] = { { OSC_BUTTON_ADDRESS, (k & 1) ? 1.0f : 0.0f }, { OSC_AXIS_ADDRESS, k / 32767.0f } };
+        if (k < 0 || k >= OSC_MAX_FRAMES || arrived_at[k] != 0 || !check_bundle(data, size, expected, 2)) {
+            malformed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        arrived_at[k] = now;
+    }
+}
+
+
+static bool run_rate(int frames) {
+    receiving.store(true);
+    std::thread thread(receiver_thread);
+    Uint64 next = SDL_GetTicksNS();
+    for (int k = 0; k < frames; k++) {
+        Uint64 now = SDL_GetTicksNS();
+        if (next > now) {
+            SDL_DelayPrecise(next - now);
+        }
+        next += OSC_INTERVAL_NS;
+        sent_at[k] = SDL_GetTicksNS();
+        mapping_frame_begin();
+        osc_button(0, (k & 1) != 0);
+        osc_axis(0, (Sint16)k);
+        mapping_frame_end();
+    }
+    SDL_Delay(OSC_WAIT_MS);
+    receiving.store(false);
+    thread.join();
+
+    std::vector<Sint64> latencies;
+    int lost = 0;
+    for (int k = 0; k < frames; k++) {
+        if (arrived_at[k] == 0) {
+            lost++;
+        }
+        else {
+            latencies.push_back((Sint64)(arrived_at[k] - sent_at[k]));
+        }
+    }
+    printf("\n%d frames %.2f ms apart, from the frame to its arrival\n\n", frames, OSC_INTERVAL_NS / 1e6);
+    print_latency_header();
+    print_latencies("bundles", latencies, lost);
+    printf("\n%u malformed\n", malformed.load());
+    return lost == 0 && malformed.load() == 0;
+}
+
+
+int bench_osc(int argc, char* argv[]) {
+    int frames = argc > 0 ? atoi(argv[0]) : OSC_FRAMES;
+    if (frames <= 0 || frames > OSC_MAX_FRAMES) {
+        fprintf(stderr, "The count is frames, up to %d\n", OSC_MAX_FRAMES);
+        return 1;
+    }
+    if (!net_startup()) {
+        fprintf(stderr, "Couldn't start networking\n");
+        return 1;
+    }
+    receiver = net_udp_socket(0);
+    sockaddr_in local;
+    socklen_t local_size = sizeof(local);
+    if (receiver == NET_NO_SOCKET || getsockname(receiver, (sockaddr*)&local, &local_size) != 0) {
+        fprintf(stderr, "Couldn't bind a UDP port\n");
+        net_cleanup();
+        return 1;
+    }
+    if (!osc_start() || !osc_set_target("127.0.0.1", ntohs(local.sin_port))) {
+        fprintf(stderr, "Couldn't start OSC\n");
+        osc_stop();
+        net_close(receiver);
+        net_cleanup();
+        return 1;
+    }
+    osc_set_button_address(0, OSC_BUTTON_ADDRESS);
+    osc_set_axis_address(0, OSC_AXIS_ADDRESS);
+    osc_set_axis_address(1, OSC_OTHER_AXIS_ADDRESS);
+    printf("OSC to 127.0.0.1:%d\n\n", ntohs(local.sin_port));
+
+    bool passed = run_encodings();
+    passed &= run_rate(frames);
+    printf("%s\n", passed ? "passed" : "FAILED");
+
+    osc_stop();
+    net_close(receiver);
+    net_cleanup();
+    return passed ? 0 : 1;
+}
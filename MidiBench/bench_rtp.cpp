@@ -0,0 +1,386 @@
+/*
+ * Plays the RTP-MIDI peer on the loopback: invites the app's session on the
+ * control and the data port, syncs the clocks, then sends MIDI through
+ * output 0 one message at a time and decodes the RTP packet each one turns
+ * into. The command section should hold exactly what was sent, and the
+ * recovery journal the note (chapter N) and controller (chapter C) state of
+ * the packets since the checkpoint, nothing once the bench reported them
+ * received.
+ *
+ * Output 0 sends to a virtual output port of its own (ALSA, CoreMIDI). On
+ * Windows pass an output port, like loopMIDI's.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <RtMidi.h>
+
+#include "../MidiConsoleApplication/midi_output.h"
+#include "../MidiConsoleApplication/net.h"
+#include "../MidiConsoleApplication/rtp_midi.h"
+#include "bench.h"
+
+#define RTP_BENCH_PORT (RTP_DEFAULT_PORT + 10) // not to take the app's ports
+#define RTP_WAIT_MS 500
+#define RTP_SETTLE_MS 50 // for the session thread to see a receiver report
+#define RTP_MAX_PACKET 1500
+#define OUTPUT_NAME "MidiBench Out"
+
+// What one channel journal holds, of the chapters the session writes.
+struct ChannelJournal {
+    bool present = false;
+    Uint8 toc = 0;
+    int controllers = 0;
+    Uint8 controller[128][2] = {}; // number, value
+    int logs = 0;
+    Uint8 log[128][2] = {}; // note, velocity without the Y bit
+    bool off[128] = {};
+};
+
+struct Journal {
+    bool present = false;
+    Uint16 checkpoint = 0;
+    ChannelJournal channels[16];
+};
+
+struct RtpPacket {
+    Uint16 seq = 0;
+    unsigned char commands[RTP_MAX_PACKET];
+    int command_size = 0;
+    Journal journal;
+};
+
+static NetSocket control_sock = NET_NO_SOCKET;
+static NetSocket data_sock = NET_NO_SOCKET;
+static sockaddr_in app_control;
+static sockaddr_in app_data;
+static const Uint32 token = 0x4D424E43;
+static const Uint32 bench_ssrc = 0x4D424E53;
+
+
+static Uint32 get16(const unsigned char* p) {
+    return (p[0] << 8) | p[1];
+}
+
+
+static Uint32 get32(const unsigned char* p) {
+    return (get16(p) << 16) | get16(p + 2);
+}
+
+
+static void put32(unsigned char* p, Uint32 v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+
+// The size of the next datagram, -1 if none came within RTP_WAIT_MS.
+static int receive(NetSocket sock, unsigned char* data) {
+    Uint64 deadline = SDL_GetTicks() + RTP_WAIT_MS;
+    while (SDL_GetTicks() < deadline) {
+        int size = (int)recvfrom(sock, (char*)data, RTP_MAX_PACKET, 0, NULL, NULL);
+        if (size > 0) {
+            return size;
+        }
+        SDL_Delay(1);
+    }
+    return -1;
+}
+
+
+static void send_to(NetSocket sock, const sockaddr_in& to, const unsigned char* data, int size) {
+    sendto(sock, (const char*)data, size, 0, (const sockaddr*)&to, sizeof(to));
+}
+
+
+static bool print_case(const char* label, bool passed) {
+    printf("%-40s %s\n", label, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+
+// Sends IN and waits for the OK with our token.
+static bool invite(NetSocket sock, const sockaddr_in& to) {
+    unsigned char p[RTP_MAX_PACKET] = { 0xFF, 0xFF, 'I', 'N' };
+    put32(p + 4, 2);
+    put32(p + 8, token);
+    put32(p + 12, bench_ssrc);
+    SDL_memcpy(p + 16, "MidiBench", 10);
+    send_to(sock, to, p, 26);
+    int size = receive(sock, p);
+    return size >= 16 && p[0] == 0xFF && p[1] == 0xFF && p[2] == 'O' && p[3] == 'K' && get32(p + 8) == token;
+}
+
+
+// CK 0 out, CK 1 back with our time stamp, then CK 2 to finish the exchange.
+static bool sync_clocks() {
+    unsigned char p[RTP_MAX_PACKET] = { 0xFF, 0xFF, 'C', 'K' };
+    Uint64 ts1 = SDL_GetTicksNS() / 100000;
+    put32(p + 4, bench_ssrc);
+    put32(p + 12, (Uint32)(ts1 >> 32));
+    put32(p + 16, (Uint32)ts1);
+    send_to(data_sock, app_data, p, 36);
+    int size = receive(data_sock, p);
+    if (size < 36 || p[2] != 'C' || p[3] != 'K' || p[8] != 1 || get32(p + 12) != (Uint32)(ts1 >> 32) || get32(p + 16) != (Uint32)ts1) {
+        return false;
+    }
+    p[8] = 2;
+    put32(p + 4, bench_ssrc);
+    Uint64 ts3 = SDL_GetTicksNS() / 100000;
+    put32(p + 28, (Uint32)(ts3 >> 32));
+    put32(p + 32, (Uint32)ts3);
+    send_to(data_sock, app_data, p, 36);
+    return true;
+}
+
+
+// Tells the session we have every packet up to seq.
+static void report_received(Uint16 seq) {
+    unsigned char p[12] = { 0xFF, 0xFF, 'R', 'S' };
+    put32(p + 4, bench_ssrc);
+    put32(p + 8, (Uint32)seq << 16);
+    send_to(control_sock, app_control, p, sizeof(p));
+    SDL_Delay(RTP_SETTLE_MS);
+}
+
+
+static bool parse_channel_journal(const unsigned char* p, int size, ChannelJournal& c) {
+    int pos = 3;
+    c.present = true;
+    c.toc = p[2];
+    if (c.toc & 0x80) { // P
+        pos += 3;
+    }
+    if (c.toc & 0x40) { // C
+        if (pos >= size) {
+            return false;
+        }
+        c.controllers = p[pos] + 1;
+        if (pos + 1 + c.controllers * 2 > size) {
+            return false;
+        }
+        for (int i = 0; i < c.controllers; i++) {
+            c.controller[i][0] = p[pos + 1 + i * 2] & 0x7F;
+            c.controller[i][1] = p[pos + 2 + i * 2] & 0x7F;
+        }
+        pos += 1 + c.controllers * 2;
+    }
+    if (c.toc & 0x10) { // W
+        pos += 2;
+    }
+    if (c.toc & 0x08) { // N
+        if (pos + 2 > size) {
+            return false;
+        }
+        c.logs = p[pos] & 0x7F;
+        int low = p[pos + 1] >> 4;
+        int high = p[pos + 1] & 0x0F;
+        pos += 2;
+        if (pos + c.logs * 2 > size) {
+            return false;
+        }
+        for (int i = 0; i < c.logs; i++) {
+            c.log[i][0] = p[pos + i * 2] & 0x7F;
+            c.log[i][1] = p[pos + 1 + i * 2] & 0x7F;
+        }
+        pos += c.logs * 2;
+        for (int octet = low; octet <= high; octet++) {
+            if (pos >= size) {
+                return false;
+            }
+            for (int bit = 0; bit < 8; bit++) {
+                c.off[octet * 8 + bit] = (p[pos] & (0x80 >> bit)) != 0;
+            }
+            pos++;
+        }
+    }
+    if (c.toc & 0x02) { // T
+        pos++;
+    }
+    return pos == size;
+}
+
+
+static bool parse_journal(const unsigned char* p, int size, Journal& j) {
+    if (size < 3 || (p[0] & 0xF0) != 0x20) {
+        return false; // channel journals only, no system journal
+    }
+    j.present = true;
+    j.checkpoint = (Uint16)get16(p + 1);
+    int count = (p[0] & 0x0F) + 1;
+    int pos = 3;
+    for (int i = 0; i < count; i++) {
+        if (pos + 3 > size) {
+            return false;
+        }
+        int channel = (p[pos] >> 3) & 0x0F;
+        int length = ((p[pos] & 0x03) << 8) | p[pos + 1];
+        if (length < 3 || pos + length > size || !parse_channel_journal(p + pos, length, j.channels[channel])) {
+            return false;
+        }
+        pos += length;
+    }
+    return pos == size;
+}
+
+
+// The next RTP packet on the data port, skipping session commands.
+static bool receive_packet(RtpPacket& packet) {
+    unsigned char p[RTP_MAX_PACKET];
+    int size;
+    do {
+        size = receive(data_sock, p);
+    } while (size >= 2 && p[0] == 0xFF && p[1] == 0xFF);
+    if (size < 13 || p[0] != 0x80 || (p[1] & 0x7F) != 0x61) {
+        return false;
+    }
+    packet = RtpPacket();
+    packet.seq = (Uint16)get16(p + 2);
+    int header = p[12] & 0x80 ? 2 : 1;
+    int length = header == 2 ? ((p[12] & 0x0F) << 8) | p[13] : p[12] & 0x0F;
+    if (12 + header + length > size) {
+        return false;
+    }
+    SDL_memcpy(packet.commands, p + 12 + header, length);
+    packet.command_size = length;
+    int rest = size - 12 - header - length;
+    if (p[12] & 0x40) {
+        return parse_journal(p + 12 + header + length, rest, packet.journal);
+    }
+    return rest == 0;
+}
+
+
+// Sends one message through output 0 and checks the command section of the
+// packet it turns into.
+static bool send_and_receive(unsigned char status, unsigned char data1, unsigned char data2, RtpPacket& packet) {
+    midi_output_send(status, data1, data2);
+    const unsigned char sent[3] = { status, data1, data2 };
+    return receive_packet(packet) && packet.command_size == 3 && SDL_memcmp(packet.commands, sent, 3) == 0;
+}
+
+
+static int journal_channels(const Journal& j) {
+    int count = 0;
+    for (int c = 0; c < 16; c++) {
+        count += j.channels[c].present ? 1 : 0;
+    }
+    return count;
+}
+
+
+static int off_count(const ChannelJournal& c) {
+    int count = 0;
+    for (int n = 0; n < 128; n++) {
+        count += c.off[n] ? 1 : 0;
+    }
+    return count;
+}
+
+
+static bool run_session() {
+    bool passed = true;
+    RtpPacket packet;
+
+    passed &= print_case("invitation on the control port", invite(control_sock, app_control));
+    passed &= print_case("invitation on the data port", invite(data_sock, app_data));
+    passed &= print_case("clock sync", sync_clocks());
+    if (!passed) {
+        return false;
+    }
+
+    bool ok = send_and_receive(0x90, 60, 100, packet);
+    passed &= print_case("note-on, no journal", ok && !packet.journal.present);
+    Uint16 first = packet.seq;
+
+    // The journal now covers the note-on.
+    ok = send_and_receive(0xB1, 7, 90, packet);
+    const Journal& j = packet.journal;
+    const ChannelJournal& notes = j.channels[0];
+    ok = ok && j.present && j.checkpoint == (Uint16)(first - 1) && journal_channels(j) == 1 && notes.toc == 0x08;
+    ok = ok && notes.logs == 1 && notes.log[0][0] == 60 && notes.log[0][1] == 100 && off_count(notes) == 0;
+    passed &= print_case("controller, chapter N of the note-on", ok);
+
+    // The note-on and the controller, not yet the note-off itself.
+    ok = send_and_receive(0x80, 60, 0, packet);
+    const ChannelJournal& controllers = j.channels[1];
+    ok = ok && j.present && j.checkpoint == (Uint16)(first - 1) && journal_channels(j) == 2;
+    ok = ok && notes.toc == 0x08 && notes.logs == 1 && notes.log[0][0] == 60 && off_count(notes) == 0;
+    ok = ok && controllers.toc == 0x40 && controllers.controllers == 1 && controllers.controller[0][0] == 7 && controllers.controller[0][1] == 90;
+    passed &= print_case("note-off, chapters N and C", ok);
+
+    ok = send_and_receive(0xE0, 0, 64, packet);
+    ok = ok && j.present && j.checkpoint == (Uint16)(first - 1) && journal_channels(j) == 2;
+    ok = ok && notes.toc == 0x08 && notes.logs == 0 && notes.off[60] && off_count(notes) == 1;
+    ok = ok && controllers.toc == 0x40 && controllers.controllers == 1;
+    passed &= print_case("pitch bend, the note-off in chapter N", ok);
+
+    // Everything reported received, nothing left to recover.
+    report_received(packet.seq);
+    ok = send_and_receive(0x92, 62, 80, packet);
+    passed &= print_case("note-on after a report, no journal", ok && !packet.journal.present);
+    midi_output_send(0x82, 62, 0);
+
+    unsigned char bye[16] = { 0xFF, 0xFF, 'B', 'Y' };
+    put32(bye + 4, 2);
+    put32(bye + 8, token);
+    put32(bye + 12, bench_ssrc);
+    send_to(control_sock, app_control, bye, sizeof(bye));
+    return passed;
+}
+
+
+int bench_rtp(int argc, char* argv[]) {
+    RtMidiOut out;
+    try {
+        if (argc > 0) {
+            int port = find_port(out, argv[0]);
+            if (port < 0) {
+                fprintf(stderr, "No MIDI output named %s\n", argv[0]);
+                return 1;
+            }
+            out.openPort(port);
+        }
+        else {
+            out.openVirtualPort(OUTPUT_NAME);
+        }
+    }
+    catch (RtMidiError& error) {
+        error.printMessage();
+        return 1;
+    }
+    if (!net_startup()) {
+        fprintf(stderr, "Couldn't start networking\n");
+        return 1;
+    }
+    control_sock = net_udp_socket(0);
+    data_sock = net_udp_socket(0);
+    net_address("127.0.0.1", RTP_BENCH_PORT, &app_control);
+    net_address("127.0.0.1", RTP_BENCH_PORT + 1, &app_data);
+    bool passed = false;
+    if (control_sock == NET_NO_SOCKET || data_sock == NET_NO_SOCKET) {
+        fprintf(stderr, "Couldn't bind the UDP ports of the peer\n");
+    }
+    else if (!rtp_midi_init() || !midi_output_start(&out) || !rtp_midi_start(RTP_BENCH_PORT)) {
+        fprintf(stderr, "Couldn't start the RTP-MIDI session on port %d\n", RTP_BENCH_PORT);
+    }
+    else {
+        printf("RTP-MIDI session on 127.0.0.1:%d\n\n", RTP_BENCH_PORT);
+        passed = run_session();
+        printf("\n%s\n", passed ? "passed" : "FAILED");
+    }
+
+    rtp_midi_stop();
+    midi_output_stop();
+    if (control_sock != NET_NO_SOCKET) {
+        net_close(control_sock);
+    }
+    if (data_sock != NET_NO_SOCKET) {
+        net_close(data_sock);
+    }
+    net_cleanup();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * How fast the UMP encoder packs: axis positions into 32-bit controllers,
+ * MIDI 1.0 messages translated to MIDI 2.0, and MIDI 1.0 in 32-bit packets.
+ * Every packet is stamped with the time, as the app sends them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../MidiConsoleApplication/ump.h"
+#include "bench.h"
+
+#define UMP_PACKETS 10000000
+
+// Note-on, note-off, controller and pitch bend, what the mappings send most.
+static const unsigned char midi1_messages[4][3] = {
+    { 0x90, 60, 100 },
+    { 0x80, 60, 0 },
+    { 0xB0, 1, 64 },
+    { 0xE0, 0, 64 }
+};
+
+// Folded into the result so the compiler can't drop the packing.
+static Uint32 checksum = 0;
+
+
+static void print_rate(const char* label, int packets, Uint64 elapsed) {
+    printf("%-24s %10d %10.1f %12.2f\n", label, packets, (double)elapsed / packets, packets * 1e3 / elapsed);
+}
+
+
+static void run_axis(int packets) {
+    Uint64 start = SDL_GetTicksNS();
+    for (int i = 0; i < packets; i++) {
+        Sint16 value = (Sint16)(i * 7919);
+        Uint32 position = (Uint32)(value + 32768);
+        UmpPacket p = ump_control_change(0, (Uint8)(i & 15), (Uint8)(i & 127), ump_scale_up(position, 16, 32));
+        checksum += p.words[0] ^ p.words[1];
+    }
+    print_rate("axis to 32-bit CC", packets, SDL_GetTicksNS() - start);
+}
+
+
+static void run_midi2(int packets) {
+    Uint64 start = SDL_GetTicksNS();
+    for (int i = 0; i < packets; i++) {
+        UmpPacket p = ump_from_midi1(0, midi1_messages[i & 3], 3);
+        checksum += p.words[0] ^ p.words[1];
+    }
+    print_rate("MIDI 1.0 to 2.0", packets, SDL_GetTicksNS() - start);
+}
+
+
+static void run_midi1(int packets) {
+    Uint64 start = SDL_GetTicksNS();
+    for (int i = 0; i < packets; i++) {
+        UmpPacket p = ump_midi1(0, midi1_messages[i & 3], 3);
+        checksum += p.words[0];
+    }
+    print_rate("MIDI 1.0 in 32 bits", packets, SDL_GetTicksNS() - start);
+}
+
+
+int bench_ump(int argc, char* argv[]) {
+    int packets = argc > 0 ? atoi(argv[0]) : UMP_PACKETS;
+    if (packets <= 0) {
+        fprintf(stderr, "The count is packets per row\n");
+        return 1;
+    }
+    printf("%-24s %10s %10s %12s\n", "", "Packets", "ns/packet", "Mpackets/s");
+    run_axis(packets);
+    run_midi2(packets);
+    run_midi1(packets);
+    printf("\nchecksum %08X\n", checksum);
+    return 0;
+}
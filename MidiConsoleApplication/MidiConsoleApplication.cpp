@@ -35,66 +35,188 @@
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_sdlrenderer3.h"
 
-enum ButtonFunction {
-    NOTE,
-    CC
-};
-
-struct JoystickStatus {
-    ButtonFunction func = NOTE;
-    int channel = 0; // 0 to 15
-    int value = 0;   // 0 to 127
-};
+#if defined(__LINUX_ALSA__)
+#include "alsa_seq.h"
+#endif
+#if defined(__UNIX_JACK__)
+#include "jack_midi.h"
+#endif
+#include "axis_filter.h"
+#include "axis_zones.h"
+#include "combo.h"
+#include "control.h"
+#include "device_lanes.h"
+#include "gamepad.h"
+#include "mapping.h"
+#include "looper.h"
+#include "midi_output.h"
+#include "mpe.h"
+#include "osc.h"
+#include "profiles.h"
+#include "rtp_midi.h"
+#include "sequencer.h"
+#include "smf_player.h"
+#include "smf_writer.h"
+#include "stats.h"
+#include "sysex.h"
+#include "timing.h"
+#include "ump.h"
+#include "xy_pad.h"
 
 /* We will use this renderer to draw into this window every frame. */
 static SDL_Window* window = NULL;
 static SDL_Renderer* renderer = NULL;
 static SDL_Joystick* joystick = NULL;
+static SDL_Gamepad* gamepad = NULL; // set in gamepad mode, joystick is its joystick
 
 static RtMidiOut* midi_out = NULL;
+// The axes of a report being mapped as one input frame.
+static bool input_frame_open = false;
+
+#define PROFILES_PATH "profiles.txt"
+#define CONTROL_PATH "midiconsole.sock"
 
-static std::vector<JoystickStatus> joystick_conf;
-
-const char* button_function_str(ButtonFunction bf) {
-    const char* res;
-    
-    switch (bf) {
-    case ButtonFunction::NOTE:
-        res = "NOTE";
-        break;
-    case ButtonFunction::CC:
-        res = "CC";
-        break;
-    default:
-        res = NULL;
-    }
-    return res;
+void open_controller(SDL_JoystickID id) {
+    if (gamepad_mode() && SDL_IsGamepad(id)) {
+        gamepad = SDL_OpenGamepad(id);
+        joystick = gamepad ? SDL_GetGamepadJoystick(gamepad) : NULL;
+    }
+    else {
+        joystick = SDL_OpenJoystick(id);
+    }
+    if (!joystick) {
+        SDL_Log("Failed to open joystick ID %u: %s", (unsigned int)id, SDL_GetError());
+    }
 }
 
 
-const unsigned char button_function_val(ButtonFunction bf, bool release = false) {
-    unsigned char res;
+void close_controller() {
+    if (gamepad) {
+        SDL_CloseGamepad(gamepad);
+    }
+    else if (joystick) {
+        SDL_CloseJoystick(joystick);
+    }
+    gamepad = NULL;
+    joystick = NULL;
+}
+
 
-    switch (bf) {
-    case ButtonFunction::NOTE:
-        if (release) {
-            res = 0x80;
+// Load a profile, reopening the controller if it was made in the other mode.
+void use_profile(SDL_JoystickID id, int profile) {
+    if (profile_gamepad(profile) != gamepad_mode()) {
+        gamepad_set_mode(profile_gamepad(profile));
+        close_controller();
+        open_controller(id);
+    }
+    profile_apply(profile);
+}
+
+
+// Commands from the control socket, applied between frames like UI edits.
+void apply_control_commands() {
+    ControlCommand command;
+    while (control_pop(&command)) {
+        if (command.type == CONTROL_PANIC) {
+            midi_output_panic();
         }
-        else {
-            res = 0x90;
+        else if (command.type == CONTROL_BANK) {
+            midi_output_send(0xB0 + command.channel, 0, command.bank >> 7);
+            midi_output_send(0xB0 + command.channel, 32, command.bank & 0x7F);
+            midi_output_send(0xC0 + command.channel, command.program);
+        }
+        else if (command.type == CONTROL_PROFILE) {
+            if (joystick && command.profile < profile_count()) {
+                use_profile(SDL_GetJoystickID(joystick), command.profile);
+            }
+            else {
+                SDL_Log("No controller or no profile %d to load", command.profile);
+            }
+        }
+    }
+}
+
+
+// SDL sends the axes of one report as events with the same timestamp, the
+// frame stays open while the next queued event is one more of them.
+static bool report_continues(const SDL_Event* event) {
+    SDL_Event next;
+    if (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_EVENT_FIRST, SDL_EVENT_LAST) != 1) {
+        return false;
+    }
+    return (next.type == SDL_EVENT_JOYSTICK_AXIS_MOTION || next.type == SDL_EVENT_GAMEPAD_AXIS_MOTION) &&
+        next.common.timestamp == event->common.timestamp && next.jaxis.which == event->jaxis.which;
+}
+
+
+static void end_input_frame() {
+    if (input_frame_open) {
+        input_frame_open = false;
+        mapping_frame_end();
+    }
+}
+
+
+// Joystick events, or gamepad events turned into joystick events.
+void process_input(const SDL_Event* event) {
+    looper_record(event);
+    midi_output_stamp(event->common.timestamp);
+    if (!input_frame_open) {
+        input_frame_open = true;
+        mapping_frame_begin();
+    }
+    if (event->type == SDL_EVENT_JOYSTICK_AXIS_MOTION || !combo_process(event)) {
+        mapping_process(event);
+    }
+    if (!report_continues(event)) {
+        end_input_frame();
+    }
+    midi_output_stamp(0);
+}
+
+
+void button_config_row(int btn, const char* label, JoystickStatus* joy_conf) {
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::Text(label);
+    ImGui::TableNextColumn();
+    ImGui::PushID(btn);
+    // Edited on a copy, the lanes and the looper read the mapping meanwhile.
+    JoystickStatus conf = joy_conf[btn];
+    bool changed = false;
+    if (ImGui::BeginCombo("##Func", button_function_str(conf.func), ImGuiComboFlags_None)) {
+        for (unsigned int i = 0; i < ButtonFunction::BUTTON_FUNCTION_COUNT; i++) {
+            const bool is_selected = (conf.func == i);
+            if (ImGui::Selectable(button_function_str((ButtonFunction)i), is_selected)) {
+                conf.func = (ButtonFunction)i;
+                changed = true;
+            }
+            if (is_selected)
+                ImGui::SetItemDefaultFocus();
         }
-        break;
-    case ButtonFunction::CC:
-        res = 0xB0;
-        break;
-    default:
-        res = 0;
-    }
-    return res;
+        ImGui::EndCombo();
+    }
+    ImGui::TableNextColumn();
+    int channel = conf.channel + 1;
+    if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
+        conf.channel = channel - 1;
+        changed = true;
+    }
+    ImGui::TableNextColumn();
+    if (ImGui::SliderInt("##Val", &conf.value, 0, 127)) {
+        changed = true;
+    }
+    if (changed) {
+        mapping_set(btn, conf);
+        profile_mark_dirty();
+    }
+    ImGui::TableNextColumn();
+    osc_address_ui(btn);
+    ImGui::PopID();
 }
 
 
-void joystick_config_ui(SDL_Joystick* joys, std::vector<JoystickStatus>& joy_conf) {
+void joystick_config_ui(SDL_Joystick* joys, SDL_Gamepad* pad, JoystickStatus* joy_conf) {
     // TODO: Create a line for each button.
     // button_id; message type [note | cc]; [note | code]
     // Put everything in a table and remove the labels.
@@ -102,38 +224,37 @@ void joystick_config_ui(SDL_Joystick* joys, std::vector<JoystickStatus>& joy_con
     if (joys != NULL) {
         ImGui::SeparatorText("Controller");
         ImGui::Text(SDL_GetJoystickName(joys));
-        int button_count = SDL_GetNumJoystickButtons(joys);
-        if (ImGui::BeginTable(SDL_GetJoystickName(joys), 4)) {
+        bool pad_mode = gamepad_mode();
+        if (ImGui::Checkbox("Gamepad Mode", &pad_mode)) {
+            SDL_JoystickID id = SDL_GetJoystickID(joys);
+            gamepad_set_mode(pad_mode);
+            profile_mark_dirty(); // the profile remembers the mode
+            close_controller();
+            open_controller(id);
+            return; // joys and pad are gone
+        }
+        profile_ui(joys);
+        int button_count = SDL_min(SDL_GetNumJoystickButtons(joys), MAPPING_MAX_BUTTONS);
+        if (ImGui::BeginTable(SDL_GetJoystickName(joys), 5)) {
             ImGui::TableSetupColumn("Bttn");
             ImGui::TableSetupColumn("Func");
             ImGui::TableSetupColumn("Chnl");
             ImGui::TableSetupColumn("Val");
+            ImGui::TableSetupColumn("OSC");
             ImGui::TableHeadersRow();
-            for (unsigned int btn = 0; btn < button_count; btn++) {
-                ImGui::TableNextRow();
-                ImGui::TableNextColumn();
-                ImGui::Text("%d", btn);
-                ImGui::TableNextColumn();
-                ImGui::PushID(btn);
-                if (ImGui::BeginCombo("##Func", button_function_str(joy_conf[btn].func), ImGuiComboFlags_None)) {
-                    for (unsigned int i = 0; i < 2; i++) {
-                        const bool is_selected = (joy_conf[btn].func == i);
-                        if (ImGui::Selectable(button_function_str((ButtonFunction)i), is_selected)) {
-                            joy_conf[btn].func = (ButtonFunction)i;
-                        }
-                        if (is_selected)
-                            ImGui::SetItemDefaultFocus();
+            if (pad != NULL) {
+                for (int btn = 0; btn < SDL_GAMEPAD_BUTTON_COUNT; btn++) {
+                    if (SDL_GamepadHasButton(pad, (SDL_GamepadButton)btn)) {
+                        button_config_row(btn, gamepad_button_name(btn), joy_conf);
                     }
-                    ImGui::EndCombo();
                 }
-                ImGui::TableNextColumn();
-                int channel = joy_conf[btn].channel + 1;
-                if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
-                    joy_conf[btn].channel = channel - 1;
+            }
+            else {
+                for (int btn = 0; btn < button_count; btn++) {
+                    char label[8];
+                    SDL_snprintf(label, sizeof(label), "%d", btn);
+                    button_config_row(btn, label, joy_conf);
                 }
-                ImGui::TableNextColumn();
-                ImGui::SliderInt("##Val", &joy_conf[btn].value, 0, 127);
-                ImGui::PopID();
             }
             ImGui::EndTable();
         }
@@ -142,34 +263,36 @@ void joystick_config_ui(SDL_Joystick* joys, std::vector<JoystickStatus>& joy_con
 
 
 void midi_config_ui(RtMidiOut* mout) {
-    static unsigned int selected_port_id = 0;
-    std::string selected_port = mout->getPortName(selected_port_id);
+    // -1 for an output that isn't open, output 0 always is.
+    static int selected_port_ids[MIDI_OUTPUTS] = { 0, -1, -1, -1 };
 
     ImGui::SeparatorText("Midi Config");
-    // Port DropDown
-    if (ImGui::BeginCombo("Port", selected_port.c_str(), ImGuiComboFlags_None)) {
-        for (unsigned int i = 0; i < mout->getPortCount(); i++) {
-            const bool is_selected = (selected_port_id == i);
-            const std::string item = mout->getPortName(i);
-            if (ImGui::Selectable(item.c_str(), is_selected)) {
-                if (i != selected_port_id) {
-                    selected_port_id = i;
-                    // TODO: Maybe trigger a SDL_Event and do the port change somewhere else
-                    mout->closePort();
-                    try {
-                        SDL_Log("RtMidi open port %s", mout->getPortName(selected_port_id).c_str());
-                        mout->openPort(selected_port_id);
-                    }
-                    catch (RtMidiError& error) {
-                        error.printMessage();
-                        // TODO: show the error to user or crash the app.
+    for (int output = 0; output < MIDI_OUTPUTS; output++) {
+        int& selected_port_id = selected_port_ids[output];
+        std::string selected_port = selected_port_id >= 0 ? mout->getPortName(selected_port_id) : "None";
+        char label[16];
+        if (output == 0) {
+            SDL_strlcpy(label, "Port", sizeof(label));
+        }
+        else {
+            SDL_snprintf(label, sizeof(label), "Port %d", output + 1);
+        }
+        // Port DropDown
+        if (ImGui::BeginCombo(label, selected_port.c_str(), ImGuiComboFlags_None)) {
+            for (int i = output == 0 ? 0 : -1; i < (int)mout->getPortCount(); i++) {
+                const bool is_selected = (selected_port_id == i);
+                const std::string item = i >= 0 ? mout->getPortName(i) : "None";
+                if (ImGui::Selectable(item.c_str(), is_selected)) {
+                    if (i != selected_port_id) {
+                        selected_port_id = i;
+                        midi_output_open_port(output, selected_port_id);
                     }
                 }
+                if (is_selected)
+                    ImGui::SetItemDefaultFocus();
             }
-            if (is_selected)
-                ImGui::SetItemDefaultFocus();
+            ImGui::EndCombo();
         }
-        ImGui::EndCombo();
     }
 }
 
@@ -182,7 +305,9 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
     SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
     SDL_SetAppMetadata("Example Input Joystick Polling", "1.0", "com.example.input-joystick-polling");
  
-    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK)) {
+    profiles_load(PROFILES_PATH);
+
+    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK | SDL_INIT_GAMEPAD)) {
         SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
         return SDL_APP_FAILURE;
     }
@@ -236,6 +361,26 @@ SDL_AppResult SDL_AppInit(void** appstate, int argc, char* argv[])
         return SDL_APP_FAILURE;
     }
 
+    // The native backends are optional, outputs stay on RtMidi without them.
+#if defined(__LINUX_ALSA__)
+    alsa_seq_open();
+#endif
+#if defined(__UNIX_JACK__)
+    jack_midi_open();
+#endif
+    // Optional as well, MIDI doesn't need them.
+    osc_start();
+    rtp_midi_start();
+    control_start(CONTROL_PATH);
+    stats_open();
+    if (!smf_writer_init() || !ump_output_init() || !rtp_midi_init() || !midi_output_start(midi_out)) {
+        return SDL_APP_FAILURE;
+    }
+
+    if (!sequencer_init() || !looper_init() || !combo_init() || !filter_init() || !xy_init() || !smf_player_init() || !timing_start()) {
+        return SDL_APP_FAILURE;
+    }
+
     return SDL_APP_CONTINUE;  /* carry on with the program! */
 }
 
@@ -247,46 +392,53 @@ SDL_AppResult SDL_AppEvent(void* appstate, SDL_Event* event)
     }
     else if (event->type == SDL_EVENT_JOYSTICK_ADDED) {
         /* this event is sent for each hotplugged stick, but also each already-connected joystick during SDL_Init(). */
-        if (joystick == NULL) {  /* we don't have a stick yet and one was added, open it! */
-            joystick = SDL_OpenJoystick(event->jdevice.which);
-            if (!joystick) {
-                SDL_Log("Failed to open joystick ID %u: %s", (unsigned int)event->jdevice.which, SDL_GetError());
+        if (joystick != NULL) {  /* the others play along on lanes of their own. */
+            lanes_attach(event->jdevice.which);
+        }
+        else {  /* we don't have a stick yet and one was added, open it! */
+            open_controller(event->jdevice.which);
+            int profile = joystick ? profile_find(joystick) : -1;
+            if (profile >= 0) {
+                use_profile(event->jdevice.which, profile);
             }
-            int button_count = SDL_GetNumJoystickButtons(joystick);
-            for (int i = 0; i < button_count; i++) {
-                JoystickStatus js;
-                joystick_conf.push_back(js);
+            else {
+                profile_clear();
             }
         }
     }
     else if (event->type == SDL_EVENT_JOYSTICK_REMOVED) {
         if (joystick && (SDL_GetJoystickID(joystick) == event->jdevice.which)) {
-            SDL_CloseJoystick(joystick);  /* our joystick was unplugged. */
-            joystick = NULL;
-            joystick_conf.clear();
+            profile_store_dirty(joystick);
+            close_controller();  /* our joystick was unplugged. */
+        }
+        else {
+            lanes_detach(event->jdevice.which);
         }
     }
-    else if (event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN) {
-        // Get which button was pressed
-        int button_id = event->jbutton.button;
-
-        std::vector<unsigned char> message;
-
-        int type_chn = button_function_val(joystick_conf[button_id].func, false) + joystick_conf[button_id].channel;
-        message.push_back(type_chn);
-        message.push_back(joystick_conf[button_id].value);
-        message.push_back(90);
-        SDL_Log("Sending message %x %d %d", type_chn, joystick_conf[button_id].value, 90);
-        midi_out->sendMessage(&message);
+    else if (event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN ||
+             event->type == SDL_EVENT_JOYSTICK_BUTTON_UP ||
+             event->type == SDL_EVENT_JOYSTICK_AXIS_MOTION) {
+        // A gamepad sends these too, its gamepad events are the ones mapped.
+        if (joystick && SDL_GetJoystickID(joystick) == event->jdevice.which) {
+            if (gamepad == NULL) {
+                process_input(event);
+            }
+        }
+        else {
+            lanes_post(event);
+        }
     }
-    else if (event->type == SDL_EVENT_JOYSTICK_BUTTON_UP) {
-        int button_id = event->jbutton.button;
-        int type_chn = button_function_val(joystick_conf[button_id].func, true) + joystick_conf[button_id].channel;
-        std::vector<unsigned char> message;
-        message.push_back(type_chn);
-        message.push_back(joystick_conf[button_id].value);
-        //message.push_back(90);
-        midi_out->sendMessage(&message);
+    else if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN ||
+             event->type == SDL_EVENT_GAMEPAD_BUTTON_UP ||
+             event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+        if (gamepad && SDL_GetGamepadID(gamepad) == event->gdevice.which) {
+            SDL_Event translated;
+            gamepad_translate(event, &translated);
+            process_input(&translated);
+        }
+        else {
+            lanes_post(event);
+        }
     }
 
     ImGui_ImplSDL3_ProcessEvent(event);
@@ -299,6 +451,10 @@ SDL_AppResult SDL_AppIterate(void* appstate)
 {
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    end_input_frame(); // the rest of the report wasn't ours to map
+    apply_control_commands();
+    stats_publish(joystick);
+
     ImGui_ImplSDLRenderer3_NewFrame();
     ImGui_ImplSDL3_NewFrame();
     ImGui::NewFrame();
@@ -307,7 +463,29 @@ SDL_AppResult SDL_AppIterate(void* appstate)
     ImGui::SetNextWindowPos(ImVec2(0, 0));
     if (ImGui::Begin("UI", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove)) {
         midi_config_ui(midi_out);
-        joystick_config_ui(joystick, joystick_conf);
+        midi_output_ui();
+#if defined(__LINUX_ALSA__)
+        alsa_seq_ui();
+#endif
+#if defined(__UNIX_JACK__)
+        jack_midi_ui();
+#endif
+        joystick_config_ui(joystick, gamepad, joystick_conf);
+        lanes_ui();
+        osc_ui(joystick);
+        rtp_midi_ui();
+        control_ui();
+        combo_ui();
+        mpe_ui();
+        filter_ui();
+        zones_ui();
+        xy_ui();
+        sysex_ui();
+        sequencer_ui();
+        looper_ui();
+        smf_writer_ui();
+        smf_player_ui();
+        ump_ui();
     }
     ImGui::End();
 
@@ -326,14 +504,33 @@ SDL_AppResult SDL_AppIterate(void* appstate)
 void SDL_AppQuit(void* appstate, SDL_AppResult result)
 {
     if (joystick) {
-        SDL_CloseJoystick(joystick);
+        profile_store_dirty(joystick);
     }
+    profiles_save(PROFILES_PATH);
+    close_controller();
+    lanes_stop();
 
     // Cleanup ImGui stuff
     ImGui_ImplSDLRenderer3_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     ImGui::DestroyContext();
 
+    // Stop the threads before the port goes away
+    timing_stop();
+    smf_player_quit();
+    midi_output_stop();
+#if defined(__LINUX_ALSA__)
+    alsa_seq_close();
+#endif
+#if defined(__UNIX_JACK__)
+    jack_midi_close();
+#endif
+    smf_capture_stop();
+    osc_stop();
+    rtp_midi_stop();
+    control_stop();
+    stats_close();
+
     // Cleanup RtMidi stuff
     delete midi_out;
 
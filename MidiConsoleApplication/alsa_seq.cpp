@@ -0,0 +1,260 @@
+#if defined(__LINUX_ALSA__)
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <alsa/asoundlib.h>
+
+#include "imgui.h"
+
+#include "alsa_seq.h"
+
+#define ALSA_SEQ_NAME "MidiConsoleApplication"
+#define ALSA_SEQ_ENCODE_SIZE 16 // a channel message, SysEx doesn't go through the encoder
+// The queue runs on its own timer, line it up with SDL_GetTicksNS() this often.
+#define ALSA_SEQ_SYNC_NS SDL_NS_PER_SECOND
+
+struct Destination {
+    int client;
+    int port;
+    std::string name;
+};
+
+static snd_seq_t* seq = NULL;
+static int queue = -1;
+static int ports[MIDI_OUTPUTS];
+static snd_midi_event_t* encoders[MIDI_OUTPUTS];
+// The sequencer handle isn't thread safe, the output workers and the UI share it.
+static std::mutex seq_mutex;
+static Uint64 origin = 0;    // SDL_GetTicksNS() time of queue time 0
+static Uint64 last_sync = 0;
+static std::vector<Destination> destinations;
+static Destination connected[MIDI_OUTPUTS]; // client -1 for none
+
+
+static void sync_queue_time(Uint64 now) {
+    snd_seq_queue_status_t* status;
+    snd_seq_queue_status_alloca(&status);
+    if (snd_seq_get_queue_status(seq, queue, status) < 0) {
+        return;
+    }
+    const snd_seq_real_time_t* time = snd_seq_queue_status_get_real_time(status);
+    origin = now - ((Uint64)time->tv_sec * SDL_NS_PER_SECOND + time->tv_nsec);
+    last_sync = now;
+}
+
+
+bool alsa_seq_open() {
+    int err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_OUTPUT, 0);
+    if (err < 0) {
+        SDL_Log("Couldn't open the ALSA sequencer: %s", snd_strerror(err));
+        seq = NULL;
+        return false;
+    }
+    snd_seq_set_client_name(seq, ALSA_SEQ_NAME);
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        char name[32];
+        SDL_snprintf(name, sizeof(name), "Output %d", i + 1);
+        ports[i] = snd_seq_create_simple_port(seq, name, SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                              SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        encoders[i] = NULL;
+        connected[i].client = -1;
+        if (ports[i] < 0 || snd_midi_event_new(ALSA_SEQ_ENCODE_SIZE, &encoders[i]) < 0) {
+            SDL_Log("Couldn't create ALSA sequencer port %d", i + 1);
+            alsa_seq_close();
+            return false;
+        }
+    }
+
+    queue = snd_seq_alloc_named_queue(seq, ALSA_SEQ_NAME);
+    if (queue < 0) {
+        SDL_Log("Couldn't allocate an ALSA sequencer queue: %s", snd_strerror(queue));
+        alsa_seq_close();
+        return false;
+    }
+    snd_seq_start_queue(seq, queue, NULL);
+    snd_seq_drain_output(seq);
+    sync_queue_time(SDL_GetTicksNS());
+    return true;
+}
+
+
+void alsa_seq_close() {
+    std::lock_guard<std::mutex> lock(seq_mutex);
+    if (seq == NULL) {
+        return;
+    }
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        if (encoders[i]) {
+            snd_midi_event_free(encoders[i]);
+            encoders[i] = NULL;
+        }
+    }
+    if (queue >= 0) {
+        // Pending events are dropped with the queue, like a closed RtMidi port.
+        snd_seq_stop_queue(seq, queue, NULL);
+        snd_seq_drain_output(seq);
+        snd_seq_free_queue(seq, queue);
+        queue = -1;
+    }
+    snd_seq_close(seq);
+    seq = NULL;
+}
+
+
+bool alsa_seq_is_open() {
+    return seq != NULL;
+}
+
+
+bool alsa_seq_send(const MidiMessage& msg, Uint64 due) {
+    std::lock_guard<std::mutex> lock(seq_mutex);
+    if (seq == NULL || msg.output >= MIDI_OUTPUTS) {
+        return false;
+    }
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    if (msg.long_data) {
+        snd_seq_ev_set_sysex(&ev, msg.long_size, (void*)msg.long_data);
+    }
+    else {
+        snd_midi_event_reset_encode(encoders[msg.output]);
+        if (snd_midi_event_encode(encoders[msg.output], msg.bytes, msg.size, &ev) <= 0 || ev.type == SND_SEQ_EVENT_NONE) {
+            return false;
+        }
+    }
+    snd_seq_ev_set_source(&ev, ports[msg.output]);
+    snd_seq_ev_set_subs(&ev);
+
+    Uint64 now = SDL_GetTicksNS();
+    if (now - last_sync >= ALSA_SEQ_SYNC_NS) {
+        sync_queue_time(now);
+    }
+    snd_seq_real_time_t time = { 0, 0 };
+    if (due > now && due > origin) {
+        Uint64 queue_time = due - origin;
+        time.tv_sec = (unsigned int)(queue_time / SDL_NS_PER_SECOND);
+        time.tv_nsec = (unsigned int)(queue_time % SDL_NS_PER_SECOND);
+        snd_seq_ev_schedule_real(&ev, queue, 0, &time);
+    }
+    else {
+        // Still through the queue, a direct event could overtake a scheduled one.
+        snd_seq_ev_schedule_real(&ev, queue, 1, &time);
+    }
+
+    int err = snd_seq_event_output_direct(seq, &ev);
+    if (err < 0) {
+        SDL_Log("ALSA sequencer output failed: %s", snd_strerror(err));
+        return false;
+    }
+    return true;
+}
+
+
+// Every port other clients can write to, except our own.
+static void find_destinations() {
+    std::lock_guard<std::mutex> lock(seq_mutex);
+    snd_seq_client_info_t* client_info;
+    snd_seq_port_info_t* port_info;
+    snd_seq_client_info_alloca(&client_info);
+    snd_seq_port_info_alloca(&port_info);
+    const unsigned int writable = SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE;
+    int self = snd_seq_client_id(seq);
+
+    destinations.clear();
+    snd_seq_client_info_set_client(client_info, -1);
+    while (snd_seq_query_next_client(seq, client_info) >= 0) {
+        int client = snd_seq_client_info_get_client(client_info);
+        if (client == self) {
+            continue;
+        }
+        snd_seq_port_info_set_client(port_info, client);
+        snd_seq_port_info_set_port(port_info, -1);
+        while (snd_seq_query_next_port(seq, port_info) >= 0) {
+            if ((snd_seq_port_info_get_capability(port_info) & writable) != writable) {
+                continue;
+            }
+            Destination d;
+            d.client = client;
+            d.port = snd_seq_port_info_get_port(port_info);
+            d.name = std::string(snd_seq_port_info_get_name(port_info)) + " " + std::to_string(client) + ":" + std::to_string(d.port);
+            destinations.push_back(d);
+        }
+    }
+}
+
+
+static bool is_connected(int output, const Destination& d) {
+    return connected[output].client == d.client && connected[output].port == d.port;
+}
+
+
+// destination NULL only disconnects.
+static void connect(int output, const Destination* destination) {
+    std::lock_guard<std::mutex> lock(seq_mutex);
+    Destination& c = connected[output];
+    if (c.client >= 0) {
+        snd_seq_disconnect_to(seq, ports[output], c.client, c.port);
+        c.client = -1;
+    }
+    if (destination == NULL) {
+        return;
+    }
+    int err = snd_seq_connect_to(seq, ports[output], destination->client, destination->port);
+    if (err < 0) {
+        SDL_Log("Couldn't connect to %s: %s", destination->name.c_str(), snd_strerror(err));
+        return;
+    }
+    c = *destination;
+}
+
+
+bool alsa_seq_connect(int output, const char* name) {
+    if (seq == NULL || output < 0 || output >= MIDI_OUTPUTS) {
+        return false;
+    }
+    find_destinations();
+    for (int d = 0; d < (int)destinations.size(); d++) {
+        if (destinations[d].name.compare(0, SDL_strlen(name), name) == 0) {
+            connect(output, &destinations[d]);
+            return is_connected(output, destinations[d]);
+        }
+    }
+    return false;
+}
+
+
+void alsa_seq_ui() {
+    if (seq == NULL) {
+        return;
+    }
+    ImGui::SeparatorText("ALSA Sequencer");
+    ImGui::PushID("ALSA");
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        char label[16];
+        SDL_snprintf(label, sizeof(label), "Output %d", i + 1);
+        const char* preview = connected[i].client >= 0 ? connected[i].name.c_str() : "None";
+        if (ImGui::BeginCombo(label, preview)) {
+            // Clients come and go, look again every time the list opens.
+            if (ImGui::IsWindowAppearing()) {
+                find_destinations();
+            }
+            if (ImGui::Selectable("None", connected[i].client < 0)) {
+                connect(i, NULL);
+            }
+            for (int d = 0; d < (int)destinations.size(); d++) {
+                ImGui::PushID(d);
+                if (ImGui::Selectable(destinations[d].name.c_str(), is_connected(i, destinations[d]))) {
+                    connect(i, &destinations[d]);
+                }
+                ImGui::PopID();
+            }
+            ImGui::EndCombo();
+        }
+    }
+    ImGui::PopID();
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "midi_output.h"
+
+// Native ALSA sequencer backend, built on Linux along with RtMidi's ALSA API.
+// Each output gets a port of our own sequencer client. Messages sent through
+// it go on a sequencer queue with their due time, so the kernel times their
+// delivery instead of the output worker.
+#if defined(__LINUX_ALSA__)
+
+bool alsa_seq_open();
+void alsa_seq_close();
+bool alsa_seq_is_open();
+
+// Schedule a message from the port of msg.output for due, an SDL_GetTicksNS()
+// time, or right away if that has passed. Messages due at the same time are
+// delivered in the order they were sent. Safe from every output worker.
+bool alsa_seq_send(const MidiMessage& msg, Uint64 due);
+
+// Connect the port of an output to the first destination whose name starts
+// with name. Returns false if there is none.
+bool alsa_seq_connect(int output, const char* name);
+
+// Connect the port of each output to a destination.
+void alsa_seq_ui();
+
+#endif
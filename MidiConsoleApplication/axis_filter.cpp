@@ -0,0 +1,262 @@
+#include <atomic>
+#include <mutex>
+
+#include "imgui.h"
+
+#include "axis_filter.h"
+#include "mapping.h"
+#include "simd.h"
+#include "timing.h"
+
+#define FILTER_SETTLE_NS (4 * SDL_NS_PER_MS)
+#define FILTER_MAX_DT 0.004f        // s, a gap since the last step counts as one settle tick
+#define FILTER_DERIVATIVE_CUTOFF 1  // Hz, smooths the one-euro speed
+#define FILTER_NO_CUTOFF 1e6f       // Hz, passes everything in one step
+#define FILTER_NO_LIMIT 1e9f        // full scales per s
+#define FILTER_SNAP 0.5f / 32768    // half an axis unit
+
+static_assert(FILTER_AXES % SIMD_LANES == 0, "FILTER_AXES must be a multiple of SIMD_LANES");
+
+enum FilterKind {
+    FILTER_OFF,
+    FILTER_EMA,     // exponential moving average with a time constant
+    FILTER_SLEW,    // limits how fast the position may move
+    FILTER_ONE_EURO // EMA whose cutoff rises with the speed of the stick
+};
+
+static const int resolution_steps[] = { 1, 4, 512 }; // 16, 14 and 7 bit
+
+// Edited by the UI, applied by configure().
+struct FilterConfig {
+    int kind = FILTER_OFF;
+    int deadzone = 0;        // axis units
+    int curve = 0;           // % of cubic response
+    int resolution = 0;      // index into resolution_steps
+    int tau_ms = 20;
+    int slew_rate = 200;     // axis units per ms
+    float min_cutoff = 1.0f; // Hz
+    int beta = 50;           // mHz more per 1000 units/s
+};
+
+// Struct of arrays in lane order, the pipeline runs SIMD_LANES axes at a
+// time. Positions are normalized to -1..1. Every filter is a one-euro filter
+// with a slew limit: EMA has no beta, slew and off have no cutoff, and
+// off snaps right away.
+struct FilterBank {
+    alignas(32) float target[FILTER_AXES];
+    alignas(32) float deadzone[FILTER_AXES];
+    alignas(32) float deadzone_scale[FILTER_AXES]; // stretches what's left to full scale
+    alignas(32) float curve[FILTER_AXES];
+    alignas(32) float min_cutoff[FILTER_AXES];     // Hz
+    alignas(32) float beta[FILTER_AXES];           // Hz per full scale/s
+    alignas(32) float slew[FILTER_AXES];           // full scales/s
+    alignas(32) float snap[FILTER_AXES];
+    alignas(32) float levels[FILTER_AXES];         // quantization steps per half scale
+    alignas(32) float value[FILTER_AXES];
+    alignas(32) float speed[FILTER_AXES];          // full scales/s
+    alignas(32) float sent[FILTER_AXES];           // quantized, last passed on
+    Uint64 time = 0;                               // of the last step
+};
+
+static FilterConfig configs[FILTER_AXES];
+static FilterBank bank;
+// The bank steps from SDL_AppEvent, the looper and the settle ticks on the
+// timing thread. The lock is held for one batch and for passing on what it
+// changed, so the axis consumers see one thread at a time and every axis in
+// the order it moved.
+static std::mutex bank_mutex;
+static std::atomic<bool> settling(false);
+
+
+// Deadzone, curve, smoothing, quantization and change detection for every
+// axis. Returns one bit per axis whose quantized position changed, sets
+// *moving to the axes that haven't reached their target yet.
+static Uint32 filter_batch(Uint64 now, Uint32* moving) {
+    float dt = bank.time == 0 ? 0.0f : SDL_min((now - bank.time) / (float)SDL_NS_PER_SECOND, FILTER_MAX_DT);
+    bank.time = now;
+
+    const VecF zero = vec_set(0.0f);
+    const VecF one = vec_set(1.0f);
+    const VecF two_pi_dt = vec_set(2 * SDL_PI_F * dt);
+    const VecF vdt = vec_set(dt);
+    const VecF inv_dt = vec_set(dt > 0 ? 1 / dt : 0.0f);
+    const float k_d = 2 * SDL_PI_F * FILTER_DERIVATIVE_CUTOFF * dt;
+    const VecF alpha_d = vec_set(k_d / (k_d + 1));
+    Uint32 changed = 0;
+    Uint32 unsettled = 0;
+
+    for (int i = 0; i < FILTER_AXES; i += SIMD_LANES) {
+        VecF x = vec_load(bank.target + i);
+
+        // Deadzone, then stretch the rest so the edge is still full scale.
+        VecF shaped = vec_mul(vec_max(vec_sub(vec_abs(x), vec_load(bank.deadzone + i)), zero), vec_load(bank.deadzone_scale + i));
+        // Blend of linear and cubic response.
+        VecF cubic = vec_mul(vec_mul(shaped, shaped), shaped);
+        shaped = vec_add(shaped, vec_mul(vec_load(bank.curve + i), vec_sub(cubic, shaped)));
+        shaped = vec_select(vec_lt(x, zero), vec_sub(zero, shaped), shaped);
+
+        // One-euro: the cutoff follows the smoothed speed, alpha = k / (k + 1).
+        VecF value = vec_load(bank.value + i);
+        VecF diff = vec_sub(shaped, value);
+        VecF speed = vec_load(bank.speed + i);
+        speed = vec_add(speed, vec_mul(vec_sub(vec_mul(vec_abs(diff), inv_dt), speed), alpha_d));
+        VecF cutoff = vec_add(vec_load(bank.min_cutoff + i), vec_mul(vec_load(bank.beta + i), speed));
+        VecF k = vec_mul(cutoff, two_pi_dt);
+        VecF step = vec_mul(diff, vec_div(k, vec_add(k, one)));
+        VecF limit = vec_mul(vec_load(bank.slew + i), vdt);
+        value = vec_add(value, vec_max(vec_min(step, limit), vec_sub(zero, limit)));
+        VecMask near = vec_lt(vec_abs(vec_sub(shaped, value)), vec_load(bank.snap + i));
+        value = vec_select(near, shaped, value);
+        vec_store(bank.value + i, value);
+        vec_store(bank.speed + i, speed);
+
+        // Quantize, then only what changed at that resolution goes on.
+        VecF quantized = vec_round(vec_mul(value, vec_load(bank.levels + i)));
+        VecMask different = vec_neq(quantized, vec_load(bank.sent + i));
+        vec_store(bank.sent + i, quantized);
+        changed |= vec_bits(different) << i;
+        unsettled |= (vec_bits(near) ^ ((1u << SIMD_LANES) - 1)) << i;
+    }
+    *moving = unsettled;
+    return changed;
+}
+
+
+// Step the bank and pass on the axes that changed. Returns true if an axis
+// started moving, the settle ticks have to be woken up.
+static bool update(int axis, Sint16 value, Uint64 now) {
+    Sint16 positions[FILTER_AXES];
+    Uint32 moving;
+
+    std::lock_guard<std::mutex> lock(bank_mutex);
+    if (axis >= 0) {
+        bank.target[axis] = value / 32768.0f;
+    }
+    Uint32 changed = filter_batch(now, &moving);
+    // Written under the lock so a tick that finds the bank settled can't
+    // clear it after an event started an axis moving again.
+    bool was_settling = settling.exchange(moving != 0, std::memory_order_relaxed);
+    bool woke = moving != 0 && !was_settling;
+    for (int a = 0; a < FILTER_AXES; a++) {
+        if (changed & (1u << a)) {
+            int step = (int)(32768 / bank.levels[a]);
+            positions[a] = (Sint16)SDL_clamp((int)bank.sent[a] * step, -32768, 32767);
+        }
+    }
+    for (int a = 0; a < FILTER_AXES; a++) {
+        if (changed & (1u << a)) {
+            mapping_axis(a, positions[a]);
+        }
+    }
+    return woke;
+}
+
+
+static Uint64 filter_tick(Uint64 now, void* userdata) {
+    if (!settling.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    // One frame, like an input event.
+    mapping_frame_begin();
+    update(-1, 0, now);
+    mapping_frame_end();
+    return settling.load(std::memory_order_relaxed) ? now + FILTER_SETTLE_NS : 0;
+}
+
+
+static void configure(int axis) {
+    const FilterConfig& cfg = configs[axis];
+
+    std::lock_guard<std::mutex> lock(bank_mutex);
+    bank.deadzone[axis] = cfg.deadzone / 32768.0f;
+    bank.deadzone_scale[axis] = 32768.0f / (32768 - cfg.deadzone);
+    bank.curve[axis] = cfg.curve / 100.0f;
+    bank.levels[axis] = 32768.0f / resolution_steps[cfg.resolution];
+    bank.min_cutoff[axis] = FILTER_NO_CUTOFF;
+    bank.beta[axis] = 0;
+    bank.slew[axis] = FILTER_NO_LIMIT;
+    bank.snap[axis] = cfg.kind == FILTER_OFF ? 2.0f : FILTER_SNAP;
+    if (cfg.kind == FILTER_EMA) {
+        bank.min_cutoff[axis] = 1000 / (2 * SDL_PI_F * cfg.tau_ms);
+    }
+    else if (cfg.kind == FILTER_SLEW) {
+        bank.slew[axis] = cfg.slew_rate * 1000 / 32768.0f;
+    }
+    else if (cfg.kind == FILTER_ONE_EURO) {
+        bank.min_cutoff[axis] = cfg.min_cutoff;
+        bank.beta[axis] = cfg.beta * 32768 / 1e6f;
+    }
+}
+
+
+bool filter_init() {
+    for (int axis = 0; axis < FILTER_AXES; axis++) {
+        configure(axis);
+    }
+    return timing_add(filter_tick, NULL);
+}
+
+
+void filter_axis(int axis, Sint16 value) {
+    if (axis < 0 || axis >= FILTER_AXES) {
+        std::lock_guard<std::mutex> lock(bank_mutex);
+        mapping_axis(axis, value);
+        return;
+    }
+    if (update(axis, value, SDL_GetTicksNS())) {
+        timing_wake();
+    }
+}
+
+
+void filter_ui() {
+    static const char* kind_names[] = { "Off", "EMA", "Slew", "One Euro" };
+    static const char* resolution_names[] = { "16 bit", "14 bit", "7 bit" };
+
+    ImGui::SeparatorText("Axis Filters");
+    ImGui::PushID("Filters");
+    if (ImGui::BeginTable("Filters", 7)) {
+        ImGui::TableSetupColumn("Axis");
+        ImGui::TableSetupColumn("Dead");
+        ImGui::TableSetupColumn("Curve");
+        ImGui::TableSetupColumn("Res");
+        ImGui::TableSetupColumn("Filter");
+        ImGui::TableSetupColumn("");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        for (int axis = 0; axis < FILTER_AXES; axis++) {
+            FilterConfig& cfg = configs[axis];
+            bool changed = false;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", axis);
+            ImGui::TableNextColumn();
+            ImGui::PushID(axis);
+            changed |= ImGui::SliderInt("##Dead", &cfg.deadzone, 0, 16384);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Curve", &cfg.curve, 0, 100, "%d%%");
+            ImGui::TableNextColumn();
+            changed |= ImGui::Combo("##Res", &cfg.resolution, resolution_names, 3);
+            ImGui::TableNextColumn();
+            changed |= ImGui::Combo("##Filter", &cfg.kind, kind_names, 4);
+            ImGui::TableNextColumn();
+            if (cfg.kind == FILTER_EMA) {
+                changed |= ImGui::SliderInt("##Tau", &cfg.tau_ms, 1, 500, "%d ms");
+            }
+            else if (cfg.kind == FILTER_SLEW) {
+                changed |= ImGui::SliderInt("##Rate", &cfg.slew_rate, 1, 2000, "%d /ms");
+            }
+            else if (cfg.kind == FILTER_ONE_EURO) {
+                changed |= ImGui::SliderFloat("##Cutoff", &cfg.min_cutoff, 0.1f, 10.0f, "%.1f Hz");
+                ImGui::TableNextColumn();
+                changed |= ImGui::SliderInt("##Beta", &cfg.beta, 0, 1000, "beta %d");
+            }
+            ImGui::PopID();
+            if (changed) {
+                configure(axis);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define FILTER_AXES 16
+
+// Registers the filters on the timing thread, which keeps moving a filtered
+// axis to its final position after the stick stops sending events. Must be
+// called before timing_start().
+bool filter_init();
+
+// Deadzone, curve, smooth and quantize an axis, then pass it on to
+// mapping_axis() if the result changed. All axes are stepped together as
+// one SIMD batch.
+void filter_axis(int axis, Sint16 value);
+
+void filter_ui();
@@ -0,0 +1,196 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "axis_zones.h"
+#include "midi_output.h"
+
+// Edited by the UI, applied by configure().
+struct ZoneConfig {
+    int count = 0;           // 0 when the axis has no zones
+    int channel = 0;
+    int base = 48;           // note of zone 0
+    int step = 1;            // semitones between zones
+    int hysteresis = 1024;   // how far past its edge the axis must go to leave a zone
+    bool silent_center = false;
+};
+
+// One configuration of an axis. The UI builds the spare table of the axis
+// and swaps it in, so an event never sees a half built table.
+struct ZoneTable {
+    Uint8 table[65536];            // zone of every axis position
+    Uint32 start[ZONES_MAX + 1];   // first position of each zone
+    int count = 0;
+    int channel = 0;
+    int base = 0;
+    int step = 0;
+    int hysteresis = 0;
+    int silent = -1;               // zone that plays nothing, -1 for none
+    std::atomic<int> zone{ -1 };   // zone the axis is in, -1 before the first event
+    std::atomic<int> readers{ 0 }; // events using the table right now
+};
+
+struct ZoneAxis {
+    ZoneTable tables[2];
+    std::atomic<ZoneTable*> active{ NULL }; // NULL when the axis has no zones
+};
+
+static ZoneConfig configs[ZONE_AXES];
+static ZoneAxis axes[ZONE_AXES];
+
+
+static void send_zone(const ZoneTable& t, int zone, bool on) {
+    if (zone < 0 || zone == t.silent) {
+        return;
+    }
+    unsigned char channel = (unsigned char)t.channel;
+    int note = SDL_clamp(t.base + zone * t.step, 0, 127);
+    if (on) {
+        midi_output_send(0x90 + channel, note, 90);
+    }
+    else {
+        midi_output_send(0x80 + channel, note, 0);
+    }
+}
+
+
+// Build the spare table with the new config and swap it in. Once no event
+// uses the old table any more its note is released, and it becomes the spare.
+static void configure(int axis) {
+    const ZoneConfig& cfg = configs[axis];
+    ZoneAxis& z = axes[axis];
+    ZoneTable* old = z.active.load();
+    ZoneTable& t = old == &z.tables[0] ? z.tables[1] : z.tables[0];
+
+    t.count = cfg.count;
+    t.channel = cfg.channel;
+    t.base = cfg.base;
+    t.step = cfg.step;
+    t.hysteresis = cfg.hysteresis;
+    t.silent = -1;
+    t.zone.store(-1);
+    if (cfg.count >= 2) {
+        for (int zone = 0; zone <= cfg.count; zone++) {
+            t.start[zone] = (Uint32)((zone * 65536 + cfg.count - 1) / cfg.count);
+        }
+        for (int position = 0; position < 65536; position++) {
+            t.table[position] = (Uint8)((position * cfg.count) >> 16);
+        }
+        if (cfg.silent_center) {
+            t.silent = t.table[32768];
+        }
+    }
+    z.active.store(cfg.count >= 2 ? &t : NULL);
+
+    if (old) {
+        // An event holds the table for a few sends at most.
+        while (old->readers.load() > 0) {
+        }
+        send_zone(*old, old->zone.exchange(-1), false);
+    }
+}
+
+
+// The active table of an axis, held until release_table(). NULL if it has none.
+static ZoneTable* acquire_table(ZoneAxis& z) {
+    for (;;) {
+        ZoneTable* t = z.active.load();
+        if (t == NULL) {
+            return NULL;
+        }
+        t->readers.fetch_add(1);
+        if (z.active.load() == t) {
+            return t;
+        }
+        t->readers.fetch_sub(1); // swapped out meanwhile, take the new one
+    }
+}
+
+
+static void release_table(ZoneTable* t) {
+    t->readers.fetch_sub(1);
+}
+
+
+static void play_zone(ZoneTable& t, Sint16 value) {
+    int position = value + 32768; // 0 to 65535
+    int next = t.table[position];
+    int current = t.zone.load(std::memory_order_relaxed);
+    if (next == current) {
+        return;
+    }
+    if (current >= 0) {
+        // Stay in the zone until the axis is past its edge by the hysteresis.
+        if (next > current && position < (int)t.start[current + 1] + t.hysteresis) {
+            return;
+        }
+        if (next < current && position >= (int)t.start[current] - t.hysteresis) {
+            return;
+        }
+    }
+    // The looper may feed the same axis from the timing thread, only one of
+    // them gets to play the change.
+    if (!t.zone.compare_exchange_strong(current, next, std::memory_order_relaxed)) {
+        return;
+    }
+    send_zone(t, current, false);
+    send_zone(t, next, true);
+}
+
+
+void zones_axis(int axis, Sint16 value) {
+    if (axis < 0 || axis >= ZONE_AXES) {
+        return;
+    }
+    ZoneTable* t = acquire_table(axes[axis]);
+    if (t) {
+        play_zone(*t, value);
+        release_table(t);
+    }
+}
+
+
+void zones_ui() {
+    ImGui::SeparatorText("Axis Zones");
+    ImGui::PushID("Zones");
+    if (ImGui::BeginTable("Zones", 7)) {
+        ImGui::TableSetupColumn("Axis");
+        ImGui::TableSetupColumn("Zones");
+        ImGui::TableSetupColumn("Chnl");
+        ImGui::TableSetupColumn("Note");
+        ImGui::TableSetupColumn("Step");
+        ImGui::TableSetupColumn("Hyst");
+        ImGui::TableSetupColumn("Rest");
+        ImGui::TableHeadersRow();
+        for (int axis = 0; axis < ZONE_AXES; axis++) {
+            ZoneConfig& cfg = configs[axis];
+            bool changed = false;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", axis);
+            ImGui::TableNextColumn();
+            ImGui::PushID(axis);
+            changed |= ImGui::SliderInt("##Zones", &cfg.count, 0, ZONES_MAX);
+            ImGui::TableNextColumn();
+            int channel = cfg.channel + 1;
+            if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
+                cfg.channel = channel - 1;
+                changed = true;
+            }
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Note", &cfg.base, 0, 127);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Step", &cfg.step, -12, 12);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Hyst", &cfg.hysteresis, 0, 8192);
+            ImGui::TableNextColumn();
+            changed |= ImGui::Checkbox("##Rest", &cfg.silent_center);
+            ImGui::PopID();
+            if (changed) {
+                configure(axis);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define ZONE_AXES 8
+#define ZONES_MAX 32
+
+// Split an axis into zones that each play a note, like a ribbon. Moving into
+// another zone releases the note of the old one first.
+void zones_axis(int axis, Sint16 value);
+
+void zones_ui();
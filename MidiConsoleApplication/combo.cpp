@@ -0,0 +1,458 @@
+#include <algorithm>
+#include <mutex>
+
+#include "imgui.h"
+
+#include "combo.h"
+#include "mapping.h"
+#include "timing.h"
+
+#define COMBO_MAX_BUTTONS 4
+#define COMBO_MAX_SYMBOLS 32
+#define COMBO_MAX_STATES 256
+#define COMBO_MAX_PENDING 64
+
+enum ComboType {
+    COMBO_SEQUENCE, // pressed in order, e.g. up, up, A
+    COMBO_CHORD     // pressed together in any order, e.g. A+B
+};
+
+// Edited by the UI, compiled into the automaton by combo_build().
+struct ComboConfig {
+    int type = COMBO_SEQUENCE;
+    char buttons[32] = "";
+    int window_ms = 300;
+    JoystickStatus action;
+};
+
+struct ComboPattern {
+    int type = COMBO_SEQUENCE;
+    int length = 0;
+    Uint8 buttons[COMBO_MAX_BUTTONS];
+    Uint64 window = 0; // ns from the first press to the last
+    JoystickStatus action;
+};
+
+// Aho-Corasick automaton over the presses of the combo buttons, completed into
+// a DFA so each press is a single table lookup. State 0 is "no prefix", a state
+// of depth d holds back the last d presses.
+struct ComboAutomaton {
+    Uint8 symbol[MAPPING_MAX_BUTTONS]; // symbol + 1 of each button, 0 if it isn't in a combo
+    Uint8 next[COMBO_MAX_STATES][COMBO_MAX_SYMBOLS];
+    Uint8 depth[COMBO_MAX_STATES];
+    Sint8 accept[COMBO_MAX_STATES];    // combo matched on reaching the state, -1 for none
+    Uint64 window[COMBO_MAX_STATES];   // longest window of the combos it is a prefix of
+    ComboPattern patterns[MAPPING_MAX_COMBOS];
+};
+
+struct PendingPress {
+    Uint64 time;
+    Uint8 button;
+    bool down;
+};
+
+static ComboConfig configs[MAPPING_MAX_COMBOS];
+static char build_status[64] = "No combos";
+
+// Rebuilt on the main thread only, which is also the only one reading it.
+static ComboAutomaton automaton;
+
+// Shared by SDL_AppEvent and the timing thread. Only combo buttons take the lock.
+static std::mutex combo_mutex;
+static int state = 0;
+static PendingPress pending[COMBO_MAX_PENDING];
+static int pending_count = 0;
+static int pending_downs = 0;
+static Uint64 deadline = 0;
+static Uint64 held[MAPPING_MAX_BUTTONS / 64];
+static Uint64 swallowed[MAPPING_MAX_BUTTONS / 64]; // the release belongs to a combo
+static Uint8 release_combo[MAPPING_MAX_BUTTONS];   // combo + 1 released with the button, 0 for none
+
+
+static bool is_held(const Uint64* bits, int button) {
+    return (bits[button / 64] & (1ull << (button % 64))) != 0;
+}
+
+
+static void set_held(Uint64* bits, int button, bool down) {
+    if (down) {
+        bits[button / 64] |= 1ull << (button % 64);
+    }
+    else {
+        bits[button / 64] &= ~(1ull << (button % 64));
+    }
+}
+
+
+static void replay(const PendingPress& press) {
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = press.down ? SDL_EVENT_JOYSTICK_BUTTON_DOWN : SDL_EVENT_JOYSTICK_BUTTON_UP;
+    event.common.timestamp = press.time;
+    event.jbutton.button = press.button;
+    event.jbutton.down = press.down;
+    mapping_process(&event);
+}
+
+
+// Send the first count held back presses on, in order.
+static void flush(int count) {
+    for (int i = 0; i < count; i++) {
+        replay(pending[i]);
+        if (pending[i].down) {
+            pending_downs--;
+        }
+    }
+    pending_count -= count;
+    SDL_memmove(pending, pending + count, pending_count * sizeof(PendingPress));
+}
+
+
+static void flush_all() {
+    flush(pending_count);
+    state = 0;
+    deadline = 0;
+}
+
+
+// Flush the presses that fell out of the current prefix, keeping the last keep
+// presses and the releases after them.
+static void trim(int keep) {
+    int count = 0;
+    int downs = pending_downs;
+    while (count < pending_count && (downs > keep || !pending[count].down)) {
+        if (pending[count].down) {
+            downs--;
+        }
+        count++;
+    }
+    flush(count);
+}
+
+
+static void append(Uint64 time, Uint8 button, bool down) {
+    pending[pending_count].time = time;
+    pending[pending_count].button = button;
+    pending[pending_count].down = down;
+    pending_count++;
+    if (down) {
+        pending_downs++;
+    }
+}
+
+
+// Index of the n-th press from the end of pending.
+static int last_down(int n) {
+    int i = pending_count;
+    while (n > 0) {
+        i--;
+        if (pending[i].down) {
+            n--;
+        }
+    }
+    return i;
+}
+
+
+static bool matches(const ComboPattern& p) {
+    Uint64 first = pending[last_down(p.length)].time;
+    if (pending[pending_count - 1].time - first > p.window) {
+        return false;
+    }
+    if (p.type == COMBO_CHORD) {
+        for (int i = 0; i < p.length; i++) {
+            if (!is_held(held, p.buttons[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Drop the presses of the combo, play its action instead. The action is
+// released with the last button of the combo, the other releases are dropped.
+static void fire(int combo) {
+    const ComboPattern& p = automaton.patterns[combo];
+    Uint64 matched[MAPPING_MAX_BUTTONS / 64] = {};
+
+    flush(last_down(p.length));
+    for (int i = 0; i < pending_count; i++) {
+        if (pending[i].down) {
+            set_held(matched, pending[i].button, true);
+        }
+        else if (!is_held(matched, pending[i].button)) {
+            replay(pending[i]); // its press went out before the combo started
+        }
+    }
+    for (int i = 0; i < MAPPING_MAX_BUTTONS / 64; i++) {
+        swallowed[i] |= matched[i] & held[i];
+    }
+    release_combo[pending[pending_count - 1].button] = (Uint8)(combo + 1);
+    pending_count = 0;
+    pending_downs = 0;
+    state = 0;
+    deadline = 0;
+
+    mapping_button(p.action, MAPPING_MAX_BUTTONS + combo, true);
+}
+
+
+static Uint64 combo_tick(Uint64 now, void* userdata) {
+    std::lock_guard<std::mutex> lock(combo_mutex);
+    if (pending_count > 0 && now >= deadline) {
+        flush_all();
+    }
+    return pending_count > 0 ? deadline : 0;
+}
+
+
+bool combo_init() {
+    return timing_add(combo_tick, NULL);
+}
+
+
+bool combo_process(const SDL_Event* event) {
+    int button = event->jbutton.button;
+    if (button >= MAPPING_MAX_BUTTONS || automaton.symbol[button] == 0) {
+        return false;
+    }
+    bool down = event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN;
+    Uint64 time = event->common.timestamp;
+
+    std::lock_guard<std::mutex> lock(combo_mutex);
+    set_held(held, button, down);
+    if (pending_count > 0 && time > deadline) {
+        flush_all(); // the timing thread hasn't got to it yet
+    }
+
+    if (!down) {
+        if (is_held(swallowed, button)) {
+            set_held(swallowed, button, false);
+            int combo = release_combo[button] - 1;
+            if (combo >= 0) {
+                release_combo[button] = 0;
+                mapping_button(automaton.patterns[combo].action, MAPPING_MAX_BUTTONS + combo, false);
+            }
+            return true;
+        }
+        if (pending_count == 0) {
+            return false;
+        }
+        if (pending_count == COMBO_MAX_PENDING) {
+            flush_all();
+            return false;
+        }
+        append(time, (Uint8)button, false); // stays behind its press
+        return true;
+    }
+
+    int next = automaton.next[state][automaton.symbol[button] - 1];
+    if (next == 0 || pending_count == COMBO_MAX_PENDING) {
+        flush_all();
+        return false;
+    }
+    trim(automaton.depth[next] - 1);
+    append(time, (Uint8)button, true);
+    state = next;
+
+    // A combo fires as soon as it is complete, even if it is the prefix of a longer one.
+    int combo = automaton.accept[next];
+    if (combo >= 0) {
+        if (matches(automaton.patterns[combo])) {
+            fire(combo);
+        }
+        else {
+            flush_all();
+        }
+        return true;
+    }
+
+    deadline = pending[0].time + automaton.window[next];
+    timing_wake();
+    return true;
+}
+
+
+// Space or comma separated button ids. Returns the count, or -1 if invalid.
+static int parse_buttons(const char* text, Uint8* out) {
+    int count = 0;
+    const char* c = text;
+
+    for (;;) {
+        while (*c == ' ' || *c == ',' || *c == '+') {
+            c++;
+        }
+        if (*c == '\0') {
+            return count;
+        }
+        char* end;
+        long button = SDL_strtol(c, &end, 10);
+        if (end == c || button < 0 || button >= MAPPING_MAX_BUTTONS || count == COMBO_MAX_BUTTONS) {
+            return -1;
+        }
+        out[count++] = (Uint8)button;
+        c = end;
+    }
+}
+
+
+// Compile the configs into a new automaton. Keeps the old one if they don't fit.
+static bool combo_build() {
+    static ComboAutomaton a; // too big for the stack
+    Uint8 fail[COMBO_MAX_STATES] = {};
+    Uint8 queue[COMBO_MAX_STATES];
+    int symbols = 0;
+    int states = 1;
+    int combos = 0;
+
+    SDL_zero(a);
+    SDL_memset(a.accept, -1, sizeof(a.accept));
+    for (int c = 0; c < MAPPING_MAX_COMBOS; c++) {
+        ComboPattern& p = a.patterns[c];
+        p.length = parse_buttons(configs[c].buttons, p.buttons);
+        if (p.length < 0) {
+            SDL_snprintf(build_status, sizeof(build_status), "Combo %d: up to %d button ids", c, COMBO_MAX_BUTTONS);
+            return false;
+        }
+        if (p.length == 0) {
+            continue;
+        }
+        p.type = configs[c].type;
+        p.window = configs[c].window_ms * SDL_NS_PER_MS;
+        p.action = configs[c].action;
+
+        for (int i = 0; i < p.length; i++) {
+            if (a.symbol[p.buttons[i]] == 0) {
+                if (symbols == COMBO_MAX_SYMBOLS) {
+                    SDL_snprintf(build_status, sizeof(build_status), "More than %d combo buttons", COMBO_MAX_SYMBOLS);
+                    return false;
+                }
+                a.symbol[p.buttons[i]] = (Uint8)++symbols;
+            }
+        }
+
+        // A chord can be pressed in any order, each order goes in as a sequence.
+        Uint8 order[COMBO_MAX_BUTTONS];
+        SDL_memcpy(order, p.buttons, p.length);
+        if (p.type == COMBO_CHORD) {
+            std::sort(order, order + p.length);
+        }
+        do {
+            int s = 0;
+            for (int i = 0; i < p.length; i++) {
+                int sym = a.symbol[order[i]] - 1;
+                if (a.next[s][sym] == 0) {
+                    if (states == COMBO_MAX_STATES) {
+                        SDL_snprintf(build_status, sizeof(build_status), "Combos too long");
+                        return false;
+                    }
+                    a.depth[states] = (Uint8)(i + 1);
+                    a.next[s][sym] = (Uint8)states++;
+                }
+                s = a.next[s][sym];
+                a.window[s] = SDL_max(a.window[s], p.window);
+            }
+            if (a.accept[s] < 0) {
+                a.accept[s] = (Sint8)c;
+            }
+        } while (p.type == COMBO_CHORD && std::next_permutation(order, order + p.length));
+        combos++;
+    }
+
+    // Breadth first, so the failure state of a state is complete before it is
+    // used. Missing transitions go where the failure state would go, then a
+    // press that breaks a prefix lands on the longest prefix it still ends.
+    int head = 0;
+    int tail = 0;
+    for (int sym = 0; sym < symbols; sym++) {
+        if (a.next[0][sym] != 0) {
+            queue[tail++] = a.next[0][sym];
+        }
+    }
+    while (head < tail) {
+        int s = queue[head++];
+        if (a.accept[s] < 0) {
+            a.accept[s] = a.accept[fail[s]];
+        }
+        for (int sym = 0; sym < symbols; sym++) {
+            int u = a.next[s][sym];
+            if (u != 0) {
+                fail[u] = a.next[fail[s]][sym];
+                queue[tail++] = (Uint8)u;
+            }
+            else {
+                a.next[s][sym] = a.next[fail[s]][sym];
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(combo_mutex);
+    flush_all();
+    // Release the actions still held, their buttons' releases are still dropped.
+    for (int btn = 0; btn < MAPPING_MAX_BUTTONS; btn++) {
+        int combo = release_combo[btn] - 1;
+        if (combo >= 0) {
+            mapping_button(automaton.patterns[combo].action, MAPPING_MAX_BUTTONS + combo, false);
+            release_combo[btn] = 0;
+        }
+    }
+    SDL_memcpy(&automaton, &a, sizeof(a));
+    SDL_snprintf(build_status, sizeof(build_status), "%d combos, %d states", combos, states);
+    return true;
+}
+
+
+void combo_ui() {
+    static const char* type_names[] = { "Sequence", "Chord" };
+
+    ImGui::SeparatorText("Combos");
+    ImGui::PushID("Combos");
+    if (ImGui::BeginTable("Combos", 6)) {
+        ImGui::TableSetupColumn("Type");
+        ImGui::TableSetupColumn("Bttns");
+        ImGui::TableSetupColumn("Window ms");
+        ImGui::TableSetupColumn("Func");
+        ImGui::TableSetupColumn("Chnl");
+        ImGui::TableSetupColumn("Val");
+        ImGui::TableHeadersRow();
+        for (int c = 0; c < MAPPING_MAX_COMBOS; c++) {
+            ComboConfig& cfg = configs[c];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::PushID(c);
+            ImGui::Combo("##Type", &cfg.type, type_names, 2);
+            ImGui::TableNextColumn();
+            ImGui::InputText("##Bttns", cfg.buttons, sizeof(cfg.buttons));
+            ImGui::TableNextColumn();
+            ImGui::SliderInt("##Window", &cfg.window_ms, 10, 1000);
+            ImGui::TableNextColumn();
+            if (ImGui::BeginCombo("##Func", button_function_str(cfg.action.func), ImGuiComboFlags_None)) {
+                for (unsigned int i = 0; i < ButtonFunction::BUTTON_FUNCTION_COUNT; i++) {
+                    const bool is_selected = (cfg.action.func == i);
+                    if (ImGui::Selectable(button_function_str((ButtonFunction)i), is_selected)) {
+                        cfg.action.func = (ButtonFunction)i;
+                    }
+                    if (is_selected)
+                        ImGui::SetItemDefaultFocus();
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::TableNextColumn();
+            int channel = cfg.action.channel + 1;
+            if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
+                cfg.action.channel = channel - 1;
+            }
+            ImGui::TableNextColumn();
+            ImGui::SliderInt("##Val", &cfg.action.value, 0, 127);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    if (ImGui::Button("Apply")) {
+        combo_build();
+    }
+    ImGui::SameLine();
+    ImGui::TextUnformatted(build_status);
+    ImGui::PopID();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Register with the timing thread, it flushes held back presses when a combo
+// window runs out. Must be called before timing_start().
+bool combo_init();
+
+// Feed a joystick button event. Returns true if the combo recognizer took it,
+// then it must not go to mapping_process(): it is either part of a combo or
+// held back until it is known not to be. Buttons that don't start any combo
+// are never held back.
+bool combo_process(const SDL_Event* event);
+
+void combo_ui();
@@ -0,0 +1,275 @@
+#include <atomic>
+#include <thread>
+
+#include "imgui.h"
+
+#include "control.h"
+#include "lockfree_queue.h"
+#include "midi_output.h"
+#include "net.h"
+#ifdef _WIN32
+#include <afunix.h>
+#else
+#include <sys/select.h>
+#include <sys/un.h>
+#endif
+
+#define CONTROL_QUEUE_SIZE 64
+#define CONTROL_MAX_CLIENTS 4
+#define CONTROL_MAX_LINE 128
+#define CONTROL_POLL_MS 100
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Winsock doesn't raise SIGPIPE anyway
+#endif
+
+struct ControlClient {
+    NetSocket sock = NET_NO_SOCKET;
+    char line[CONTROL_MAX_LINE];
+    int length = 0;
+};
+
+static LockFreeQueue<ControlCommand, CONTROL_QUEUE_SIZE> queue;
+static std::thread worker;
+static std::atomic<bool> running(false);
+static std::atomic<int> client_count(0);
+static std::atomic<Uint32> commands(0); // taken by the main thread
+static bool networking = false;
+static NetSocket listen_sock = NET_NO_SOCKET;
+static char socket_path[108] = ""; // the size of sun_path
+// Only the socket thread touches these.
+static ControlClient clients[CONTROL_MAX_CLIENTS];
+
+
+static void close_client(ControlClient& c) {
+    net_close(c.sock);
+    c.sock = NET_NO_SOCKET;
+    c.length = 0;
+    client_count.fetch_sub(1);
+}
+
+
+// A client that doesn't read its answers is dropped rather than waited for.
+// Returns false if it was.
+static bool reply(ControlClient& c, const char* text) {
+    int length = (int)SDL_strlen(text);
+    if ((int)send(c.sock, text, length, MSG_NOSIGNAL) != length) {
+        close_client(c);
+        return false;
+    }
+    return true;
+}
+
+
+static bool push(ControlClient& c, const ControlCommand& command) {
+    return reply(c, queue.push(command) ? "ok\n" : "error busy\n");
+}
+
+
+// The counters are atomics, read here without going through the main thread.
+static bool send_counters(ControlClient& c) {
+    char text[MIDI_OUTPUTS * 96 + 8];
+    int length = 0;
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        MidiOutputCounters counters;
+        midi_output_counters(i, &counters);
+        if (counters.open) {
+            length += SDL_snprintf(text + length, sizeof(text) - length, "output %d sent %u coalesced %u dropped %u latency_us %u\n",
+                i + 1, counters.sent, counters.coalesced, counters.dropped, counters.latency_us);
+        }
+    }
+    SDL_strlcpy(text + length, "end\n", sizeof(text) - length);
+    return reply(c, text);
+}
+
+
+static bool handle_line(ControlClient& c, const char* line) {
+    ControlCommand command;
+    int channel, bank, program, profile;
+    if (SDL_strcmp(line, "panic") == 0) {
+        command.type = CONTROL_PANIC;
+        return push(c, command);
+    }
+    if (SDL_sscanf(line, "bank %d %d %d", &channel, &bank, &program) == 3) {
+        if (channel < 1 || channel > 16 || bank < 0 || bank > 16383 || program < 0 || program > 127) {
+            return reply(c, "error out of range\n");
+        }
+        command.type = CONTROL_BANK;
+        command.channel = channel - 1;
+        command.bank = bank;
+        command.program = program;
+        return push(c, command);
+    }
+    if (SDL_sscanf(line, "profile %d", &profile) == 1) {
+        if (profile < 0) {
+            return reply(c, "error out of range\n");
+        }
+        command.type = CONTROL_PROFILE;
+        command.profile = profile;
+        return push(c, command);
+    }
+    if (SDL_strcmp(line, "counters") == 0) {
+        return send_counters(c);
+    }
+    return reply(c, "error unknown command\n");
+}
+
+
+static void receive(ControlClient& c) {
+    char buffer[256];
+    int size = (int)recv(c.sock, buffer, sizeof(buffer), 0);
+    if (size <= 0) {
+        close_client(c); // gone, select() said there was something to read
+        return;
+    }
+    for (int i = 0; i < size; i++) {
+        if (buffer[i] == '\n') {
+            c.line[c.length] = 0;
+            c.length = 0;
+            if (!handle_line(c, c.line)) {
+                return;
+            }
+        }
+        else if (buffer[i] != '\r' && c.length < CONTROL_MAX_LINE - 1) {
+            c.line[c.length++] = buffer[i];
+        }
+    }
+}
+
+
+static void accept_client() {
+    NetSocket sock = accept(listen_sock, NULL, NULL);
+    if (sock == NET_NO_SOCKET) {
+        return;
+    }
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].sock == NET_NO_SOCKET) {
+            if (!net_set_nonblocking(sock)) {
+                break;
+            }
+            clients[i].sock = sock;
+            clients[i].length = 0;
+            client_count.fetch_add(1);
+            return;
+        }
+    }
+    send(sock, "error too many clients\n", 23, MSG_NOSIGNAL);
+    net_close(sock);
+}
+
+
+static void control_worker() {
+    while (running.load(std::memory_order_acquire)) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_sock, &readable);
+        NetSocket highest = listen_sock;
+        for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (clients[i].sock != NET_NO_SOCKET) {
+                FD_SET(clients[i].sock, &readable);
+                highest = SDL_max(highest, clients[i].sock);
+            }
+        }
+        timeval timeout = { 0, CONTROL_POLL_MS * 1000 };
+        if (select((int)highest + 1, &readable, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        if (FD_ISSET(listen_sock, &readable)) {
+            accept_client();
+        }
+        for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (clients[i].sock != NET_NO_SOCKET && FD_ISSET(clients[i].sock, &readable)) {
+                receive(clients[i]);
+            }
+        }
+    }
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].sock != NET_NO_SOCKET) {
+            close_client(clients[i]);
+        }
+    }
+}
+
+
+// Whether something still accepts connections on the socket at address.
+static bool socket_answers(const sockaddr_un& address) {
+    NetSocket sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == NET_NO_SOCKET) {
+        return false;
+    }
+    bool answers = connect(sock, (const sockaddr*)&address, sizeof(address)) == 0;
+    net_close(sock);
+    return answers;
+}
+
+
+bool control_start(const char* path) {
+    sockaddr_un address;
+    SDL_zero(address);
+    address.sun_family = AF_UNIX;
+    if (SDL_strlcpy(address.sun_path, path, sizeof(address.sun_path)) >= sizeof(address.sun_path)) {
+        SDL_Log("Control socket path too long: %s", path);
+        return false;
+    }
+    networking = net_startup();
+    if (!networking) {
+        SDL_Log("Couldn't start networking");
+        return false;
+    }
+    // A run that didn't quit cleanly leaves its socket behind, which would
+    // fail the bind. Only remove it if nothing answers on it any more, not
+    // the socket of another instance that is still running.
+    if (socket_answers(address)) {
+        SDL_Log("Control socket %s is in use by another instance", path);
+        control_stop();
+        return false;
+    }
+    SDL_RemovePath(path);
+    listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_sock == NET_NO_SOCKET || bind(listen_sock, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listen_sock, CONTROL_MAX_CLIENTS) != 0) {
+        SDL_Log("Couldn't listen on the control socket %s", path);
+        control_stop();
+        return false;
+    }
+    SDL_strlcpy(socket_path, path, sizeof(socket_path));
+    running.store(true);
+    worker = std::thread(control_worker);
+    return true;
+}
+
+
+void control_stop() {
+    if (running.exchange(false)) {
+        worker.join();
+    }
+    if (listen_sock != NET_NO_SOCKET) {
+        net_close(listen_sock);
+        listen_sock = NET_NO_SOCKET;
+    }
+    if (socket_path[0]) {
+        SDL_RemovePath(socket_path);
+        socket_path[0] = 0;
+    }
+    if (networking) {
+        net_cleanup();
+        networking = false;
+    }
+}
+
+
+bool control_pop(ControlCommand* command) {
+    if (!queue.pop(*command)) {
+        return false;
+    }
+    commands.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+
+void control_ui() {
+    if (!running.load()) {
+        return;
+    }
+    ImGui::SeparatorText("Control Socket");
+    ImGui::Text("%s: %d clients, %u commands", socket_path, client_count.load(), commands.load());
+}
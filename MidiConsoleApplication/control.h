@@ -0,0 +1,36 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Control of the running app from scripts over a Unix domain socket, one
+// command per line:
+//   panic                          all notes off on every output
+//   bank <channel> <bank> <program> bank select and program change, channel 1-16
+//   profile <index>                load a stored profile into the mapping
+//   counters                       one line per open output, then "end"
+// The rest are answered with one line, "ok" once queued or "error <reason>".
+// The socket thread only reads counters itself, the rest goes through a queue
+// the main thread drains, so a slow client never holds up the app.
+
+enum ControlCommandType {
+    CONTROL_PANIC,
+    CONTROL_BANK,
+    CONTROL_PROFILE
+};
+
+struct ControlCommand {
+    ControlCommandType type = CONTROL_PANIC;
+    int channel = 0; // 0 to 15
+    int bank = 0;    // 0 to 16383
+    int program = 0;
+    int profile = 0;
+};
+
+// Listen on path, replacing a socket left behind by an earlier run.
+bool control_start(const char* path);
+void control_stop();
+
+// The next command a client sent, never blocks. Main thread only.
+bool control_pop(ControlCommand* command);
+
+void control_ui();
@@ -0,0 +1,334 @@
+#include <atomic>
+#include <thread>
+
+#include "imgui.h"
+
+#include "device_lanes.h"
+#include "gamepad.h"
+#include "lockfree_queue.h"
+#include "mapping.h"
+#include "midi_output.h"
+#include "profiles.h"
+
+#define LANE_QUEUE_SIZE 256
+#define LANE_IDLE_MS 100
+#define LANE_AXES 16
+
+struct Lane {
+    // Only touched by SDL_AppEvent and the UI, both on the main thread.
+    SDL_JoystickID id = 0; // 0 when the lane is free
+    SDL_Joystick* joystick = NULL;
+    SDL_Gamepad* gamepad = NULL;
+    std::thread worker;
+
+    LockFreeQueue<SDL_Event, LANE_QUEUE_SIZE> queue;
+    SDL_Semaphore* wakeup = NULL;
+    std::atomic<bool> running{ false };
+    std::atomic<int> output{ 0 };
+    std::atomic<int> channel{ -1 };  // -1 plays the channels of joystick_conf
+    std::atomic<int> axis_cc{ -1 };  // CC of axis 0, -1 to ignore the axes
+    std::atomic<Uint32> dropped{ 0 };
+    // Button-ups the queue had no room for, released by the worker once it
+    // has played what was queued before them.
+    std::atomic<Uint32> parked_ups[MAPPING_MAX_BUTTONS / 32];
+    // The controller's own profile, set before the worker starts. Without one
+    // the lane plays joystick_conf.
+    JoystickStatus conf[MAPPING_MAX_BUTTONS];
+    bool own_conf = false;
+};
+
+static Lane lanes[DEVICE_LANES];
+
+
+static Lane* find_lane(SDL_JoystickID id) {
+    for (int i = 0; i < DEVICE_LANES; i++) {
+        if (lanes[i].id == id) {
+            return &lanes[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void lane_button(Lane* lane, int button, bool down) {
+    JoystickStatus conf = lane->own_conf ? lane->conf[button] : mapping_conf(button);
+    int channel = lane->channel.load(std::memory_order_relaxed);
+    if (channel >= 0) {
+        conf.channel = channel;
+    }
+    // MPE member channels are held by button id, the first controller's.
+    mapping_button(conf, -1, down);
+}
+
+
+static void lane_worker(Lane* lane) {
+    Uint32 held[MAPPING_MAX_BUTTONS / 32] = {};
+    int sent[LANE_AXES];
+    SDL_Event event;
+
+    for (int a = 0; a < LANE_AXES; a++) {
+        sent[a] = -1;
+    }
+    while (lane->running.load(std::memory_order_acquire)) {
+        SDL_WaitSemaphoreTimeout(lane->wakeup, LANE_IDLE_MS);
+        while (lane->queue.pop(event)) {
+            midi_output_route(lane->output.load(std::memory_order_relaxed));
+            midi_output_stamp(event.common.timestamp);
+            if (event.type == SDL_EVENT_JOYSTICK_BUTTON_DOWN || event.type == SDL_EVENT_JOYSTICK_BUTTON_UP) {
+                int button = event.jbutton.button;
+                bool down = event.type == SDL_EVENT_JOYSTICK_BUTTON_DOWN;
+                if (button >= MAPPING_MAX_BUTTONS) {
+                    continue;
+                }
+                if (down) {
+                    held[button / 32] |= 1u << (button % 32);
+                }
+                else {
+                    held[button / 32] &= ~(1u << (button % 32));
+                }
+                lane_button(lane, button, down);
+            }
+            else if (event.type == SDL_EVENT_JOYSTICK_AXIS_MOTION) {
+                int axis = event.jaxis.axis;
+                int cc = lane->axis_cc.load(std::memory_order_relaxed);
+                int value = (event.jaxis.value + 32768) >> 9;
+                if (cc < 0 || axis >= LANE_AXES || cc + axis > 127 || value == sent[axis]) {
+                    continue;
+                }
+                sent[axis] = value;
+                int channel = SDL_max(lane->channel.load(std::memory_order_relaxed), 0);
+                midi_output_send(0xB0 + channel, cc + axis, value);
+            }
+        }
+        // Parked ups go once the queue is empty after they were parked, the
+        // downs queued before them have been played by then.
+        Uint32 parked[MAPPING_MAX_BUTTONS / 32];
+        for (int i = 0; i < MAPPING_MAX_BUTTONS / 32; i++) {
+            parked[i] = lane->parked_ups[i].load(std::memory_order_acquire);
+        }
+        if (lane->queue.size() != 0) {
+            continue;
+        }
+        midi_output_route(lane->output.load(std::memory_order_relaxed));
+        midi_output_stamp(0);
+        for (int i = 0; i < MAPPING_MAX_BUTTONS / 32; i++) {
+            if (parked[i] == 0) {
+                continue;
+            }
+            for (int bit = 0; bit < 32; bit++) {
+                Uint32 mask = 1u << bit;
+                if ((parked[i] & mask) && (held[i] & mask)) {
+                    held[i] &= ~mask;
+                    lane_button(lane, i * 32 + bit, false);
+                }
+            }
+            lane->parked_ups[i].fetch_and(~parked[i], std::memory_order_release);
+        }
+    }
+
+    // Unplugged with buttons down, don't leave their notes hanging.
+    midi_output_route(lane->output.load(std::memory_order_relaxed));
+    for (int button = 0; button < MAPPING_MAX_BUTTONS; button++) {
+        if (held[button / 32] & (1u << (button % 32))) {
+            lane_button(lane, button, false);
+        }
+    }
+}
+
+
+bool lanes_attach(SDL_JoystickID id) {
+    Lane* lane = find_lane(0);
+    if (lane == NULL) {
+        SDL_Log("No lane left for joystick ID %u", (unsigned int)id);
+        return false;
+    }
+    lane->joystick = SDL_OpenJoystick(id);
+    if (lane->joystick == NULL) {
+        SDL_Log("Failed to open joystick ID %u: %s", (unsigned int)id, SDL_GetError());
+        return false;
+    }
+    // A known controller plays its own profile, in the mode it was made in.
+    int profile = profile_find(lane->joystick);
+    lane->own_conf = profile >= 0;
+    if (lane->own_conf) {
+        profile_buttons(profile, lane->conf);
+    }
+    bool pad_mode = lane->own_conf ? profile_gamepad(profile) : gamepad_mode();
+    if (pad_mode && SDL_IsGamepad(id)) {
+        lane->gamepad = SDL_OpenGamepad(id);
+        if (lane->gamepad == NULL) {
+            SDL_Log("Failed to open gamepad ID %u: %s", (unsigned int)id, SDL_GetError());
+            SDL_CloseJoystick(lane->joystick);
+            lane->joystick = NULL;
+            return false;
+        }
+        SDL_CloseJoystick(lane->joystick); // the gamepad holds it open
+        lane->joystick = SDL_GetGamepadJoystick(lane->gamepad);
+    }
+    else if (pad_mode && lane->own_conf) {
+        lane->own_conf = false; // its buttons are semantic ids, play joystick_conf
+    }
+    if (lane->wakeup == NULL) {
+        lane->wakeup = SDL_CreateSemaphore(0);
+        if (lane->wakeup == NULL) {
+            SDL_Log("Couldn't create lane semaphore: %s", SDL_GetError());
+            return false;
+        }
+    }
+
+    SDL_Event event;
+    while (lane->queue.pop(event)) {
+    }
+    for (int i = 0; i < MAPPING_MAX_BUTTONS / 32; i++) {
+        lane->parked_ups[i].store(0);
+    }
+    lane->id = id;
+    lane->running.store(true);
+    lane->worker = std::thread(lane_worker, lane);
+    return true;
+}
+
+
+void lanes_detach(SDL_JoystickID id) {
+    Lane* lane = id != 0 ? find_lane(id) : NULL;
+    if (lane == NULL) {
+        return;
+    }
+    lane->running.store(false);
+    SDL_SignalSemaphore(lane->wakeup);
+    lane->worker.join();
+    if (lane->gamepad) {
+        SDL_CloseGamepad(lane->gamepad);
+    }
+    else {
+        SDL_CloseJoystick(lane->joystick);
+    }
+    lane->gamepad = NULL;
+    lane->joystick = NULL;
+    lane->id = 0;
+}
+
+
+bool lanes_post(const SDL_Event* event) {
+    Lane* lane;
+    SDL_Event translated;
+
+    if (event->type == SDL_EVENT_GAMEPAD_BUTTON_DOWN || event->type == SDL_EVENT_GAMEPAD_BUTTON_UP ||
+        event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+        lane = event->gdevice.which != 0 ? find_lane(event->gdevice.which) : NULL;
+        if (lane == NULL || lane->gamepad == NULL) {
+            return lane != NULL;
+        }
+        gamepad_translate(event, &translated);
+        event = &translated;
+    }
+    else {
+        // A gamepad sends joystick events too, its gamepad events are the ones played.
+        lane = event->jdevice.which != 0 ? find_lane(event->jdevice.which) : NULL;
+        if (lane == NULL || lane->gamepad != NULL) {
+            return lane != NULL;
+        }
+    }
+
+    bool is_button = event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN || event->type == SDL_EVENT_JOYSTICK_BUTTON_UP;
+    int button = is_button ? event->jbutton.button : 0;
+    std::atomic<Uint32>* parked = is_button && button < MAPPING_MAX_BUTTONS ? &lane->parked_ups[button / 32] : NULL;
+    Uint32 mask = 1u << (button % 32);
+    // Until the worker released a parked up, its button takes nothing after
+    // it: a down would be released with it, another up has nothing to release.
+    if (parked && (parked->load(std::memory_order_acquire) & mask)) {
+        if (event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN) {
+            lane->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    if (!lane->queue.push(*event)) {
+        // A dropped up would leave its note on until the controller is unplugged.
+        if (parked && event->type == SDL_EVENT_JOYSTICK_BUTTON_UP) {
+            parked->fetch_or(mask, std::memory_order_release);
+        }
+        else {
+            lane->dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    SDL_SignalSemaphore(lane->wakeup);
+    return true;
+}
+
+
+void lanes_stop() {
+    for (int i = 0; i < DEVICE_LANES; i++) {
+        lanes_detach(lanes[i].id);
+        if (lanes[i].wakeup) {
+            SDL_DestroySemaphore(lanes[i].wakeup);
+            lanes[i].wakeup = NULL;
+        }
+    }
+}
+
+
+bool lanes_counters(int lane, LaneCounters* counters) {
+    const Lane& l = lanes[lane];
+    if (l.id == 0) {
+        return false;
+    }
+    counters->id = l.id;
+    counters->name = SDL_GetJoystickName(l.joystick);
+    counters->output = l.output.load();
+    counters->channel = l.channel.load();
+    counters->queued = (Uint32)l.queue.size();
+    counters->dropped = l.dropped.load();
+    return true;
+}
+
+
+void lanes_ui() {
+    int used = 0;
+    for (int i = 0; i < DEVICE_LANES; i++) {
+        used += lanes[i].id != 0;
+    }
+    if (used == 0) {
+        return;
+    }
+
+    ImGui::SeparatorText("Other Controllers");
+    if (ImGui::BeginTable("Lanes", 5)) {
+        ImGui::TableSetupColumn("Controller");
+        ImGui::TableSetupColumn("Output");
+        ImGui::TableSetupColumn("Chnl");
+        ImGui::TableSetupColumn("Axis CC");
+        ImGui::TableSetupColumn("Dropped");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < DEVICE_LANES; i++) {
+            Lane& lane = lanes[i];
+            if (lane.id == 0) {
+                continue;
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(SDL_GetJoystickName(lane.joystick));
+            ImGui::PushID(i);
+            ImGui::TableNextColumn();
+            int output = lane.output.load() + 1;
+            if (ImGui::SliderInt("##Output", &output, 1, MIDI_OUTPUTS)) {
+                lane.output.store(output - 1);
+            }
+            // 0 keeps the channels of the mapping.
+            ImGui::TableNextColumn();
+            int channel = lane.channel.load() + 1;
+            if (ImGui::SliderInt("##Chnl", &channel, 0, 16)) {
+                lane.channel.store(channel - 1);
+            }
+            ImGui::TableNextColumn();
+            int cc = lane.axis_cc.load();
+            if (ImGui::SliderInt("##AxisCC", &cc, -1, 127)) {
+                lane.axis_cc.store(cc);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", lane.dropped.load());
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Every controller after the first one gets a lane: a worker thread fed by a
+// lock-free queue, so each device keeps its event order while devices run on
+// separate cores. Lanes play the buttons through the controller's own
+// profile, or joystick_conf if it has none, on their own channel and output;
+// the axis features, looper and combos stay with the first controller.
+#define DEVICE_LANES 16
+
+// Open a controller and start its lane. Returns false if all lanes are taken.
+bool lanes_attach(SDL_JoystickID id);
+// Stop the lane of an unplugged controller, its held notes are released.
+void lanes_detach(SDL_JoystickID id);
+// Queue a joystick or gamepad event for its device's lane. Returns false if
+// the device has no lane. Called from SDL_AppEvent, never blocks.
+bool lanes_post(const SDL_Event* event);
+void lanes_stop();
+
+struct LaneCounters {
+    SDL_JoystickID id = 0;
+    const char* name = NULL;
+    int output = 0;
+    int channel = -1; // -1 plays the channels of the mapping
+    Uint32 queued = 0;
+    Uint32 dropped = 0;
+};
+
+// Main thread only. Returns false for a free lane.
+bool lanes_counters(int lane, LaneCounters* counters);
+
+void lanes_ui();
@@ -0,0 +1,63 @@
+#include <atomic>
+
+#include "gamepad.h"
+#include "mapping.h"
+#include "osc.h"
+
+static std::atomic<bool> enabled(false);
+// The mapping of the mode that isn't active.
+static JoystickStatus other_conf[MAPPING_MAX_BUTTONS];
+
+static const char* button_names[SDL_GAMEPAD_BUTTON_COUNT] = {
+    "South", "East", "West", "North", "Back", "Guide", "Start",
+    "Left Stick", "Right Stick", "Left Shoulder", "Right Shoulder",
+    "DPad Up", "DPad Down", "DPad Left", "DPad Right", "Misc 1",
+    "Right Paddle 1", "Left Paddle 1", "Right Paddle 2", "Left Paddle 2",
+    "Touchpad", "Misc 2", "Misc 3", "Misc 4", "Misc 5", "Misc 6"
+};
+
+
+bool gamepad_mode() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+
+void gamepad_set_mode(bool on) {
+    if (enabled.load() == on) {
+        return;
+    }
+    mapping_swap(other_conf);
+    osc_swap_buttons();
+    enabled.store(on);
+}
+
+
+void gamepad_translate(const SDL_Event* event, SDL_Event* out) {
+    SDL_zerop(out);
+    out->common.timestamp = event->common.timestamp;
+    if (event->type == SDL_EVENT_GAMEPAD_AXIS_MOTION) {
+        out->type = SDL_EVENT_JOYSTICK_AXIS_MOTION;
+        out->jaxis.which = event->gaxis.which;
+        out->jaxis.axis = event->gaxis.axis;
+        out->jaxis.value = event->gaxis.value;
+        // Triggers go from 0 to 32767, the pipeline expects a released
+        // trigger at the bottom of the axis range rather than at its centre.
+        if (event->gaxis.axis == SDL_GAMEPAD_AXIS_LEFT_TRIGGER || event->gaxis.axis == SDL_GAMEPAD_AXIS_RIGHT_TRIGGER) {
+            out->jaxis.value = (Sint16)(event->gaxis.value * 2 - 32767);
+        }
+    }
+    else {
+        out->type = event->gbutton.down ? SDL_EVENT_JOYSTICK_BUTTON_DOWN : SDL_EVENT_JOYSTICK_BUTTON_UP;
+        out->jbutton.which = event->gbutton.which;
+        out->jbutton.button = event->gbutton.button;
+        out->jbutton.down = event->gbutton.down;
+    }
+}
+
+
+const char* gamepad_button_name(int button) {
+    if (button < 0 || button >= SDL_GAMEPAD_BUTTON_COUNT) {
+        return "";
+    }
+    return button_names[button];
+}
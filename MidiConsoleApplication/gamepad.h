@@ -0,0 +1,20 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// In gamepad mode controllers are opened with SDL_OpenGamepad and mapped by
+// semantic button (South, Left Shoulder...) and axis (Left X, Left Trigger...)
+// so a mapping works on every controller SDL knows. The semantic ids index
+// joystick_conf and the axis pipeline like raw button and axis numbers do.
+bool gamepad_mode();
+
+// Raw and gamepad mappings are kept apart, switching loads the one of the new
+// mode into joystick_conf. The controller has to be reopened afterwards.
+void gamepad_set_mode(bool on);
+
+// Turn a gamepad button or axis event into the joystick event the raw path
+// gets, with the semantic id as button or axis. Triggers are scaled to the
+// full axis range, released at -32767.
+void gamepad_translate(const SDL_Event* event, SDL_Event* out);
+
+const char* gamepad_button_name(int button);
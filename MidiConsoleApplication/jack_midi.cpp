@@ -0,0 +1,247 @@
+#if defined(__UNIX_JACK__)
+
+#include <atomic>
+#include <string>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include "imgui.h"
+
+#include "jack_midi.h"
+#include "lockfree_queue.h"
+
+#define JACK_CLIENT_NAME "MidiConsoleApplication"
+#define JACK_QUEUE_SIZE 1024
+#define JACK_SYSEX_RING 65536 // bytes of SysEx per port, a power of two
+
+struct JackEvent {
+    MidiMessage msg; // long_data not used, SysEx is in the ring of the port
+    Uint64 due = 0;
+    Uint32 sysex_start = 0; // ring position of its SysEx
+    Uint32 sysex_size = 0;
+};
+
+struct JackPort {
+    jack_port_t* port = NULL;
+    LockFreeQueue<JackEvent, JACK_QUEUE_SIZE> queue;
+    // Taken off the queue but due in a later cycle, only the process callback touches it.
+    JackEvent pending;
+    bool has_pending = false;
+    // SysEx is copied in by jack_midi_send, from the worker of the output,
+    // and read out by the process callback in the same order the events are
+    // queued. Positions count up and wrap, a payload never wraps around the
+    // end of the ring.
+    unsigned char sysex[JACK_SYSEX_RING];
+    Uint32 sysex_head = 0;              // only the output worker touches it
+    std::atomic<Uint32> sysex_tail{ 0 }; // moved on by the process callback
+    std::atomic<Uint32> late{ 0 };    // placed at frame 0, due before the cycle
+    std::atomic<Uint32> dropped{ 0 }; // didn't fit in the port buffer
+    std::string connected;            // only the UI touches it
+};
+
+static jack_client_t* client = NULL;
+static JackPort ports[MIDI_OUTPUTS];
+
+
+// Writes what fell due during the last cycle into this one, at the frame
+// its due time fell on, so every message is one period late and none of them
+// jitter. Runs on the JACK realtime thread: no locks, no allocation.
+static int process(jack_nframes_t nframes, void* arg) {
+    jack_nframes_t frames;
+    jack_time_t cycle_start;
+    jack_time_t next_start;
+    float period_us;
+    if (jack_get_cycle_times(client, &frames, &cycle_start, &next_start, &period_us) != 0 || next_start <= cycle_start) {
+        return 0;
+    }
+    jack_time_t period = next_start - cycle_start;
+    // JACK and SDL both count the monotonic clock, from different origins.
+    Sint64 offset_us = (Sint64)jack_get_time() - (Sint64)(SDL_GetTicksNS() / SDL_NS_PER_US);
+    Sint64 window_start = (Sint64)cycle_start - (Sint64)period;
+
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        JackPort& p = ports[i];
+        void* buffer = jack_port_get_buffer(p.port, nframes);
+        jack_midi_clear_buffer(buffer);
+        jack_nframes_t last = 0;
+
+        for (;;) {
+            if (!p.has_pending) {
+                if (!p.queue.pop(p.pending)) {
+                    break;
+                }
+                p.has_pending = true;
+            }
+            Sint64 due_us = (Sint64)(p.pending.due / SDL_NS_PER_US) + offset_us;
+            if (due_us >= (Sint64)cycle_start) {
+                break; // goes out in the next cycle
+            }
+            jack_nframes_t frame = 0;
+            if (due_us >= window_start) {
+                frame = (jack_nframes_t)((Uint64)(due_us - window_start) * nframes / period);
+            }
+            else {
+                p.late.fetch_add(1, std::memory_order_relaxed);
+            }
+            // Events must be written in frame order.
+            frame = SDL_clamp(frame, last, nframes - 1);
+
+            const JackEvent& e = p.pending;
+            int err;
+            if (e.sysex_size > 0) {
+                err = jack_midi_event_write(buffer, frame, p.sysex + e.sysex_start % JACK_SYSEX_RING, e.sysex_size);
+                p.sysex_tail.store(e.sysex_start + e.sysex_size, std::memory_order_release);
+            }
+            else {
+                err = jack_midi_event_write(buffer, frame, e.msg.bytes, e.msg.size);
+            }
+            if (err != 0) {
+                p.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            last = frame;
+            p.has_pending = false;
+        }
+    }
+    return 0;
+}
+
+
+bool jack_midi_open() {
+    jack_status_t status;
+    client = jack_client_open(JACK_CLIENT_NAME, JackNoStartServer, &status);
+    if (client == NULL) {
+        SDL_Log("Couldn't connect to the JACK server, status 0x%x", (unsigned int)status);
+        return false;
+    }
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        char name[32];
+        SDL_snprintf(name, sizeof(name), "output_%d", i + 1);
+        ports[i].port = jack_port_register(client, name, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+        if (ports[i].port == NULL) {
+            SDL_Log("Couldn't register JACK port %s", name);
+            jack_midi_close();
+            return false;
+        }
+    }
+    if (jack_set_process_callback(client, process, NULL) != 0 || jack_activate(client) != 0) {
+        SDL_Log("Couldn't activate the JACK client");
+        jack_midi_close();
+        return false;
+    }
+    SDL_Log("JACK client %s at %u Hz", jack_get_client_name(client), (unsigned int)jack_get_sample_rate(client));
+    return true;
+}
+
+
+void jack_midi_close() {
+    if (client == NULL) {
+        return;
+    }
+    jack_deactivate(client);
+    jack_client_close(client); // unregisters the ports
+    client = NULL;
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        ports[i].port = NULL;
+        ports[i].connected.clear();
+    }
+}
+
+
+bool jack_midi_is_open() {
+    return client != NULL;
+}
+
+
+bool jack_midi_send(const MidiMessage& msg, Uint64 due) {
+    if (client == NULL || msg.output >= MIDI_OUTPUTS) {
+        return false;
+    }
+    JackPort& p = ports[msg.output];
+    JackEvent event;
+    event.msg = msg;
+    event.msg.long_data = NULL;
+    event.msg.long_refs = NULL;
+    event.due = due;
+    if (msg.long_data) {
+        // Written in a later cycle, the payload is copied so the process
+        // callback never touches the message's buffer or its refs.
+        Uint32 head = p.sysex_head;
+        Uint32 start = head;
+        if (head % JACK_SYSEX_RING + msg.long_size > JACK_SYSEX_RING) {
+            start += JACK_SYSEX_RING - head % JACK_SYSEX_RING; // skip the end of the ring
+        }
+        Uint32 tail = p.sysex_tail.load(std::memory_order_acquire);
+        if (msg.long_size > JACK_SYSEX_RING || start + msg.long_size - tail > JACK_SYSEX_RING) {
+            return false;
+        }
+        SDL_memcpy(p.sysex + start % JACK_SYSEX_RING, msg.long_data, msg.long_size);
+        event.sysex_start = start;
+        event.sysex_size = msg.long_size;
+        if (!p.queue.push(event)) {
+            return false;
+        }
+        p.sysex_head = start + msg.long_size;
+        return true;
+    }
+    return p.queue.push(event);
+}
+
+
+static bool connect(int output, const char* destination) {
+    JackPort& p = ports[output];
+    const char* source = jack_port_name(p.port);
+    if (!p.connected.empty()) {
+        jack_disconnect(client, source, p.connected.c_str());
+        p.connected.clear();
+    }
+    if (destination == NULL) {
+        return true;
+    }
+    if (jack_connect(client, source, destination) != 0) {
+        SDL_Log("Couldn't connect %s to %s", source, destination);
+        return false;
+    }
+    p.connected = destination;
+    return true;
+}
+
+
+bool jack_midi_connect(int output, const char* port) {
+    if (client == NULL || output < 0 || output >= MIDI_OUTPUTS) {
+        return false;
+    }
+    return connect(output, port);
+}
+
+
+void jack_midi_ui() {
+    if (client == NULL) {
+        return;
+    }
+    ImGui::SeparatorText("JACK MIDI");
+    ImGui::PushID("JACK");
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        JackPort& p = ports[i];
+        char label[16];
+        SDL_snprintf(label, sizeof(label), "Output %d", i + 1);
+        if (ImGui::BeginCombo(label, p.connected.empty() ? "None" : p.connected.c_str())) {
+            if (ImGui::Selectable("None", p.connected.empty())) {
+                connect(i, NULL);
+            }
+            const char** inputs = jack_get_ports(client, NULL, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
+            for (int d = 0; inputs && inputs[d]; d++) {
+                if (ImGui::Selectable(inputs[d], p.connected == inputs[d])) {
+                    connect(i, inputs[d]);
+                }
+            }
+            jack_free(inputs);
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        ImGui::Text("late %u dropped %u", p.late.load(), p.dropped.load());
+    }
+    ImGui::PopID();
+}
+
+#endif
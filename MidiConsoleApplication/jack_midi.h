@@ -0,0 +1,30 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#include "midi_output.h"
+
+// JACK MIDI backend, built along with RtMidi's JACK API. Each output gets a
+// MIDI port of our own JACK client. Messages reach the process callback
+// through a lock-free queue and are written at the frame their due time falls
+// on, so they are placed sample-accurately in the audio graph.
+#if defined(__UNIX_JACK__)
+
+bool jack_midi_open();
+void jack_midi_close();
+bool jack_midi_is_open();
+
+// Queue a message for the port of msg.output, to be played at due, an
+// SDL_GetTicksNS() time, or in the next cycle if that has passed. SysEx is
+// copied, the message can be released once this returns. Never blocks.
+// Returns false if the queue or the SysEx ring of the port is full.
+bool jack_midi_send(const MidiMessage& msg, Uint64 due);
+
+// Connect the port of an output to the JACK MIDI input port, by its full
+// name. Returns false if that failed.
+bool jack_midi_connect(int output, const char* port);
+
+// Connect the port of each output to a JACK MIDI input.
+void jack_midi_ui();
+
+#endif
@@ -0,0 +1,308 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "looper.h"
+#include "mapping.h"
+#include "midi_output.h"
+#include "timing.h"
+
+#define LOOPER_MAX_EVENTS 65536
+#define LOOPER_MAX_LAYERS 64
+
+enum LooperState {
+    LOOPER_IDLE,
+    LOOPER_RECORDING,
+    LOOPER_PLAYING,
+    LOOPER_OVERDUB
+};
+
+// Raw joystick input, not MIDI, so changing joystick_conf changes the loop.
+struct LoopEvent {
+    Uint64 offset = 0; // ns from the start of the loop
+    Uint32 type = 0;   // SDL event type
+    Uint8 index = 0;   // button or axis
+    Sint16 value = 0;  // axis value
+};
+
+// Events recorded during one pass over the loop. They are appended in time
+// order, so each layer is sorted without ever sorting the buffer.
+struct LoopLayer {
+    Uint32 first;
+    std::atomic<Uint32> end;
+    Uint64 recorded_in; // start time of the pass it was recorded in, not replayed during it
+};
+
+// Preallocated, append-only. Written by the main thread only.
+static LoopEvent events[LOOPER_MAX_EVENTS];
+static std::atomic<Uint32> event_count(0);
+static LoopLayer layers[LOOPER_MAX_LAYERS];
+static std::atomic<int> layer_count(0);
+static Uint64 recording_held[MAPPING_MAX_BUTTONS / 64];
+
+static std::atomic<int> state(LOOPER_IDLE);
+static std::atomic<Uint64> loop_start(0);
+static std::atomic<Uint64> loop_length(0);
+
+// Only touched by the timing thread.
+static Uint64 cycle_start = 0;
+static Uint32 cursors[LOOPER_MAX_LAYERS];
+static Uint64 cursor_cycle[LOOPER_MAX_LAYERS]; // pass the cursor belongs to
+static Uint64 playing_held[MAPPING_MAX_BUTTONS / 64];
+
+
+static bool is_held(const Uint64* held, int button) {
+    return (held[button / 64] & (1ull << (button % 64))) != 0;
+}
+
+
+static void set_held(Uint64* held, int button, bool down) {
+    if (down) {
+        held[button / 64] |= 1ull << (button % 64);
+    }
+    else {
+        held[button / 64] &= ~(1ull << (button % 64));
+    }
+}
+
+
+static void append_event(Uint64 time, Uint32 type, Uint8 index, Sint16 value) {
+    Uint64 start = loop_start.load(std::memory_order_relaxed);
+    if (time < start) {
+        return; // queued before recording started
+    }
+    Uint64 offset = time - start;
+    Uint64 pass = start;
+    if (state.load(std::memory_order_relaxed) == LOOPER_OVERDUB) {
+        Uint64 length = loop_length.load(std::memory_order_relaxed);
+        pass = start + (offset / length) * length;
+        offset %= length;
+    }
+
+    Uint32 n = event_count.load(std::memory_order_relaxed);
+    if (n == LOOPER_MAX_EVENTS) {
+        return;
+    }
+
+    // Each pass over the loop gets its own layer to keep the layers sorted.
+    int layer = layer_count.load(std::memory_order_relaxed) - 1;
+    if (layer < 0 || layers[layer].recorded_in != pass) {
+        if (layer + 1 == LOOPER_MAX_LAYERS) {
+            return;
+        }
+        layer++;
+        layers[layer].first = n;
+        layers[layer].end.store(n, std::memory_order_relaxed);
+        layers[layer].recorded_in = pass;
+        layer_count.store(layer + 1, std::memory_order_release);
+    }
+
+    events[n].offset = offset;
+    events[n].type = type;
+    events[n].index = index;
+    events[n].value = value;
+    event_count.store(n + 1, std::memory_order_relaxed);
+    layers[layer].end.store(n + 1, std::memory_order_release);
+
+    if (type == SDL_EVENT_JOYSTICK_BUTTON_DOWN || type == SDL_EVENT_JOYSTICK_BUTTON_UP) {
+        set_held(recording_held, index, type == SDL_EVENT_JOYSTICK_BUTTON_DOWN);
+    }
+}
+
+
+// Release the buttons still held when recording stops, or they would hang on every pass.
+static void release_recording(Uint64 time) {
+    for (int btn = 0; btn < MAPPING_MAX_BUTTONS; btn++) {
+        if (is_held(recording_held, btn)) {
+            append_event(time, SDL_EVENT_JOYSTICK_BUTTON_UP, (Uint8)btn, 0);
+        }
+    }
+}
+
+
+static void replay(const LoopEvent& e, Uint64 time) {
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = e.type;
+    event.common.timestamp = time;
+    if (e.type == SDL_EVENT_JOYSTICK_AXIS_MOTION) {
+        event.jaxis.axis = e.index;
+        event.jaxis.value = e.value;
+    }
+    else {
+        event.jbutton.button = e.index;
+        event.jbutton.down = (e.type == SDL_EVENT_JOYSTICK_BUTTON_DOWN);
+        set_held(playing_held, e.index, event.jbutton.down);
+    }
+    // The time it was due, not when the timing thread got to it.
+    midi_output_stamp(time);
+    mapping_frame_begin();
+    mapping_process(&event);
+    mapping_frame_end();
+    midi_output_stamp(0);
+}
+
+
+// Replay everything due up to limit in the pass starting at cycle.
+// Returns the time of the next event in that pass, or 0 if there is none.
+static Uint64 play_until(Uint64 cycle, Uint64 limit) {
+    Uint64 next = 0;
+    int count = layer_count.load(std::memory_order_acquire);
+
+    for (int l = 0; l < count; l++) {
+        if (layers[l].recorded_in == cycle) {
+            continue; // it was played live during this pass
+        }
+        if (cursor_cycle[l] != cycle) {
+            cursors[l] = layers[l].first;
+            cursor_cycle[l] = cycle;
+        }
+        Uint32 end = layers[l].end.load(std::memory_order_acquire);
+        while (cursors[l] < end && cycle + events[cursors[l]].offset <= limit) {
+            replay(events[cursors[l]], cycle + events[cursors[l]].offset);
+            cursors[l]++;
+        }
+        if (cursors[l] < end) {
+            Uint64 due = cycle + events[cursors[l]].offset;
+            if (next == 0 || due < next) {
+                next = due;
+            }
+        }
+    }
+    return next;
+}
+
+
+static void release_playing(Uint64 now) {
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = SDL_EVENT_JOYSTICK_BUTTON_UP;
+    event.common.timestamp = now;
+    mapping_frame_begin();
+    for (int btn = 0; btn < MAPPING_MAX_BUTTONS; btn++) {
+        if (is_held(playing_held, btn)) {
+            event.jbutton.button = (Uint8)btn;
+            mapping_process(&event);
+            set_held(playing_held, btn, false);
+        }
+    }
+    mapping_frame_end();
+}
+
+
+static Uint64 looper_tick(Uint64 now, void* userdata) {
+    int s = state.load(std::memory_order_acquire);
+    if (s != LOOPER_PLAYING && s != LOOPER_OVERDUB) {
+        if (cycle_start != 0) {
+            release_playing(now);
+            cycle_start = 0;
+        }
+        return 0;
+    }
+
+    Uint64 start = loop_start.load(std::memory_order_acquire);
+    Uint64 length = loop_length.load(std::memory_order_acquire);
+    if (now < start || length == 0) {
+        return start;
+    }
+
+    Uint64 current = start + ((now - start) / length) * length;
+    if (current != cycle_start) {
+        if (cycle_start >= start) {
+            play_until(cycle_start, cycle_start + length); // finish the previous pass
+        }
+        cycle_start = current;
+    }
+
+    Uint64 next = play_until(cycle_start, now);
+    if (next == 0) {
+        next = cycle_start + length;
+    }
+    return next;
+}
+
+
+static void looper_clear() {
+    event_count.store(0);
+    layer_count.store(0);
+    loop_length.store(0);
+    SDL_zeroa(recording_held);
+}
+
+
+bool looper_init() {
+    return timing_add(looper_tick, NULL);
+}
+
+
+void looper_record(const SDL_Event* event) {
+    int s = state.load(std::memory_order_relaxed);
+    if (s != LOOPER_RECORDING && s != LOOPER_OVERDUB) {
+        return;
+    }
+
+    if (event->type == SDL_EVENT_JOYSTICK_AXIS_MOTION) {
+        append_event(event->common.timestamp, event->type, event->jaxis.axis, event->jaxis.value);
+    }
+    else if (event->jbutton.button < MAPPING_MAX_BUTTONS) {
+        append_event(event->common.timestamp, event->type, event->jbutton.button, 0);
+    }
+}
+
+
+void looper_ui() {
+    int s = state.load();
+    Uint64 now = SDL_GetTicksNS();
+
+    ImGui::SeparatorText("Looper");
+    ImGui::PushID("Looper");
+    if (s == LOOPER_IDLE) {
+        if (ImGui::Button("Record")) {
+            looper_clear();
+            loop_start.store(now);
+            state.store(LOOPER_RECORDING);
+        }
+        if (loop_length.load() != 0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Play")) {
+                loop_start.store(now);
+                state.store(LOOPER_PLAYING);
+                timing_wake();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear")) {
+                looper_clear();
+            }
+        }
+    }
+    else if (s == LOOPER_RECORDING) {
+        if (ImGui::Button("Stop Recording")) {
+            loop_length.store(now - loop_start.load());
+            release_recording(now - 1);
+            // Playback starts right away, loop_start is the start of pass 0.
+            state.store(LOOPER_PLAYING);
+            timing_wake();
+        }
+    }
+    else {
+        if (s == LOOPER_PLAYING && ImGui::Button("Overdub")) {
+            SDL_zeroa(recording_held);
+            state.store(LOOPER_OVERDUB);
+        }
+        else if (s == LOOPER_OVERDUB && ImGui::Button("End Overdub")) {
+            release_recording(now);
+            state.store(LOOPER_PLAYING);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Stop")) {
+            if (s == LOOPER_OVERDUB) {
+                release_recording(now);
+            }
+            state.store(LOOPER_IDLE);
+            timing_wake();
+        }
+    }
+    ImGui::Text("%u/%u events, %d layers, %.2f s", event_count.load(), LOOPER_MAX_EVENTS, layer_count.load(),
+        loop_length.load() / (double)SDL_NS_PER_SECOND);
+    ImGui::PopID();
+}
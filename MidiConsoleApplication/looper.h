@@ -0,0 +1,11 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Registers the looper on the timing thread. Call before timing_start().
+bool looper_init();
+
+// Called from SDL_AppEvent with every joystick button/axis event. Never allocates.
+void looper_record(const SDL_Event* event);
+
+void looper_ui();
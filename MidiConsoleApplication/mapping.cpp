@@ -0,0 +1,154 @@
+#include <mutex>
+#include <stddef.h>
+
+#include "axis_filter.h"
+#include "axis_zones.h"
+#include "mapping.h"
+#include "midi_output.h"
+#include "mpe.h"
+#include "osc.h"
+#include "sequencer.h"
+#include "sysex.h"
+#include "ump.h"
+#include "xy_pad.h"
+
+JoystickStatus joystick_conf[MAPPING_MAX_BUTTONS];
+// Held for a copy, a set or a swap, SDL_AppEvent, the looper and the lanes
+// read joystick_conf while the UI may edit it or switch it to the other mode.
+static std::mutex conf_mutex;
+
+
+const char* button_function_str(ButtonFunction bf) {
+    const char* res;
+
+    switch (bf) {
+    case ButtonFunction::NOTE:
+        res = "NOTE";
+        break;
+    case ButtonFunction::CC:
+        res = "CC";
+        break;
+    case ButtonFunction::STEP:
+        res = "STEP";
+        break;
+    case ButtonFunction::SYSEX:
+        res = "SYSEX";
+        break;
+    default:
+        res = NULL;
+    }
+    return res;
+}
+
+
+const unsigned char button_function_val(ButtonFunction bf, bool release) {
+    unsigned char res;
+
+    switch (bf) {
+    case ButtonFunction::NOTE:
+        if (release) {
+            res = 0x80;
+        }
+        else {
+            res = 0x90;
+        }
+        break;
+    case ButtonFunction::CC:
+        res = 0xB0;
+        break;
+    default:
+        res = 0;
+    }
+    return res;
+}
+
+
+JoystickStatus mapping_conf(int button) {
+    std::lock_guard<std::mutex> lock(conf_mutex);
+    return joystick_conf[button];
+}
+
+
+void mapping_set(int button, const JoystickStatus& conf) {
+    std::lock_guard<std::mutex> lock(conf_mutex);
+    joystick_conf[button] = conf;
+}
+
+
+void mapping_swap(JoystickStatus* other) {
+    std::lock_guard<std::mutex> lock(conf_mutex);
+    for (int i = 0; i < MAPPING_MAX_BUTTONS; i++) {
+        JoystickStatus conf = joystick_conf[i];
+        joystick_conf[i] = other[i];
+        other[i] = conf;
+    }
+}
+
+
+void mapping_button(const JoystickStatus& conf, int id, bool down) {
+    osc_button(id, down);
+    if (down) {
+        if (conf.func == ButtonFunction::STEP) {
+            sequencer_toggle_step(conf.value);
+        }
+        else if (conf.func == ButtonFunction::SYSEX) {
+            sysex_send(conf.value);
+        }
+        else {
+            // A full MPE zone falls back to the plain channel note, which
+            // the up below then ends like any other.
+            bool mpe = conf.func == ButtonFunction::NOTE && id >= 0 && mpe_enabled() && mpe_note_on(id, conf.value, 90);
+            if (!mpe) {
+                int type_chn = button_function_val(conf.func, false) + conf.channel;
+                SDL_Log("Sending message %x %d %d", type_chn, conf.value, 90);
+                midi_output_send(type_chn, conf.value, 90);
+            }
+        }
+    }
+    else {
+        if (id >= 0 && mpe_note_off(id)) {
+            return;
+        }
+        if (conf.func == ButtonFunction::NOTE || conf.func == ButtonFunction::CC) {
+            int type_chn = button_function_val(conf.func, true) + conf.channel;
+            midi_output_send(type_chn, conf.value);
+        }
+    }
+}
+
+
+void mapping_axis(int axis, Sint16 value) {
+    sequencer_axis(axis, value);
+    mpe_axis(axis, value);
+    ump_axis(axis, value);
+    zones_axis(axis, value);
+    xy_axis(axis, value);
+    osc_axis(axis, value);
+}
+
+
+void mapping_frame_begin() {
+    osc_frame_begin();
+    xy_frame_begin();
+}
+
+
+void mapping_frame_end() {
+    xy_frame_end();
+    osc_frame_end();
+}
+
+
+void mapping_process(const SDL_Event* event) {
+    if (event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN || event->type == SDL_EVENT_JOYSTICK_BUTTON_UP) {
+        // Get which button was pressed
+        int button_id = event->jbutton.button;
+        if (button_id >= MAPPING_MAX_BUTTONS) {
+            return;
+        }
+        mapping_button(mapping_conf(button_id), button_id, event->type == SDL_EVENT_JOYSTICK_BUTTON_DOWN);
+    }
+    else if (event->type == SDL_EVENT_JOYSTICK_AXIS_MOTION) {
+        filter_axis(event->jaxis.axis, event->jaxis.value);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define MAPPING_MAX_BUTTONS 128
+// Combos act like extra buttons with ids after the real ones.
+#define MAPPING_MAX_COMBOS 16
+#define MAPPING_MAX_IDS (MAPPING_MAX_BUTTONS + MAPPING_MAX_COMBOS)
+
+enum ButtonFunction {
+    NOTE,
+    CC,
+    STEP,   // toggles a step of the sequencer, value is the step index
+    SYSEX,  // sends a SysEx slot, value is the slot index
+    BUTTON_FUNCTION_COUNT
+};
+
+struct JoystickStatus {
+    ButtonFunction func = NOTE;
+    int channel = 0; // 0 to 15
+    int value = 0;   // 0 to 127
+};
+
+const char* button_function_str(ButtonFunction bf);
+const unsigned char button_function_val(ButtonFunction bf, bool release = false);
+
+// Indexed by button id. Fixed size so the looper can replay input through it
+// from the timing thread while joysticks come and go.
+extern JoystickStatus joystick_conf[MAPPING_MAX_BUTTONS];
+
+// The mapping of a button, copied under the mapping lock. Threads other than
+// the UI read joystick_conf through this.
+JoystickStatus mapping_conf(int button);
+// Change the mapping of a button under the lock. The UI reads joystick_conf
+// directly but writes it through this.
+void mapping_set(int button, const JoystickStatus& conf);
+// Swap joystick_conf with another mapping under the lock, readers see either
+// the old or the new mapping of a button.
+void mapping_swap(JoystickStatus* other);
+
+// Press or release an action. id is the button id, or the combo id, that
+// holds it, or -1 if it can't hold an MPE member channel.
+void mapping_button(const JoystickStatus& conf, int id, bool down);
+
+// Pass a smoothed axis position on to everything driven by axes.
+void mapping_axis(int axis, Sint16 value);
+
+// What the calling thread maps between these two is one input frame: OSC
+// messages go out as one bundle and XY pads send both axes together. Wrap
+// the handling of one input event, or one tick of replayed input, in them.
+void mapping_frame_begin();
+void mapping_frame_end();
+
+// Turn a joystick button or axis event into MIDI using joystick_conf.
+// Called from SDL_AppEvent and from the looper on the timing thread.
+void mapping_process(const SDL_Event* event);
@@ -0,0 +1,1067 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "imgui.h"
+
+#include "lockfree_queue.h"
+#include "midi_output.h"
+#if defined(__LINUX_ALSA__)
+#include "alsa_seq.h"
+#endif
+#if defined(__UNIX_JACK__)
+#include "jack_midi.h"
+#endif
+
+#define OUTPUT_QUEUE_SIZE 1024
+#define OUTPUT_BACKLOG OUTPUT_QUEUE_SIZE // room for a whole lane
+#define OUTPUT_IDLE_MS 100
+// Below this the worker stops trusting the OS scheduler, like the timing thread.
+#define OUTPUT_PRECISE_NS SDL_MS_TO_NS(2)
+#define OUTPUT_MAX_TAPS 4
+#define OUTPUT_BURST_NS (1 * SDL_NS_PER_MS) // let the driver buffer this much
+#define OUTPUT_STARVE_LIMIT 8 // times a class can be passed over before it goes next
+#define SLOTS_PER_CHANNEL 258 // 128 CCs, channel pressure, pitch bend, 128 poly pressures
+#define OUTPUT_SLOTS (16 * SLOTS_PER_CHANNEL)
+#define OUTPUT_SLOT_QUEUE 8192 // room for every slot
+#define SLOT_VALUE_MASK 0x3FFFull
+#define SLOT_SEQ_SHIFT 14
+#define SLOT_QUEUED (1ull << 46)
+#define OFF_VELOCITY_SHIFT 32
+#define OFF_PENDING (1ull << 40)
+#define DIN_BYTES_PER_SECOND 3125 // 31250 baud, 10 bits a byte
+
+// Each class has its own lane and is sent before the ones after it, so a
+// note-off never waits behind a burst of controller values.
+enum OutputClass {
+    OUTPUT_REALTIME, // clock and friends, sent as soon as the worker sees them
+    OUTPUT_NOTE_OFF,
+    OUTPUT_EVENT,    // note-ons and everything else that is never dropped
+    OUTPUT_CONTROL,  // controller values, see is_continuous()
+    OUTPUT_CLASSES
+};
+
+static const char* backend_names[BACKENDS] = { "RtMidi", "ALSA Seq", "JACK" };
+
+// The latest value of one controller of one channel. Sending a value only
+// queues the slot if it isn't queued yet, so the control queue never holds
+// more than one entry per controller however fast a stick sweeps. state
+// packs the value, the send order of the value that queued the slot and
+// SLOT_QUEUED.
+struct ControlSlot {
+    std::atomic<Uint64> state{ 0 };
+    std::atomic<Uint64> timestamp{ 0 }; // of the latest value
+    std::atomic<Uint64> queued_at{ 0 }; // timestamp of the value that queued it
+};
+
+// Taken off a lane but not sent yet, in order. Only the worker touches it.
+template <typename T, int Size>
+struct Backlog {
+    T items[Size];
+    int first = 0;
+    int count = 0;
+
+    T& at(int i) {
+        return items[(first + i) % Size];
+    }
+
+    void pop_front() {
+        first = (first + 1) % Size;
+        count--;
+    }
+
+    void remove(int i) {
+        if (i == 0) {
+            pop_front();
+            return;
+        }
+        for (; i + 1 < count; i++) {
+            at(i) = at(i + 1);
+        }
+        count--;
+    }
+};
+
+struct Output {
+    RtMidiOut* out = NULL; // output 0's belongs to the caller, the others to us
+    LockFreeQueue<MidiMessage, OUTPUT_QUEUE_SIZE> lanes[OUTPUT_CONTROL];
+    ControlSlot slots[OUTPUT_SLOTS];
+    LockFreeQueue<Uint16, OUTPUT_SLOT_QUEUE> control_lane; // queued slots
+    // A note-off its lane had no room for, per channel and key: the send
+    // order and velocity of the latest one and OFF_PENDING. The worker takes
+    // them once the backlog has room, so a note-off is never refused.
+    std::atomic<Uint64> pending_offs[16 * 128];
+    std::atomic<Uint64> pending_off_times[16 * 128];
+    std::atomic<bool> has_pending_offs{ false };
+    std::atomic<Uint32> next_seq{ 0 };
+    SDL_Semaphore* wakeup = NULL;
+    std::thread worker;
+    std::atomic<bool> open{ false };
+    // Only held by the worker while sending and by the UI while changing
+    // ports. The worker lets go of it while it waits between SysEx chunks.
+    std::mutex port_mutex;
+
+    // Bandwidth model, 0 bytes per second for a port that is never the
+    // bottleneck (USB, virtual ports).
+    std::atomic<int> bytes_per_second{ 0 };
+    std::atomic<int> max_latency_ms{ 20 };
+    std::atomic<int> backend{ BACKEND_RTMIDI };
+    Backlog<MidiMessage, OUTPUT_BACKLOG> backlog[OUTPUT_CONTROL];
+    Backlog<Uint16, OUTPUT_SLOTS> controls;
+    int passed[OUTPUT_CLASSES] = {}; // sends since the class last went
+    bool events_drained = false; // the event lane was empty after the last drain
+    Uint64 wire = 0; // when the port is done with what we sent so far
+
+    std::atomic<Uint32> sent{ 0 };
+    std::atomic<Uint32> coalesced{ 0 };
+    std::atomic<Uint32> dropped{ 0 }; // refused, their lane was full
+    std::atomic<Uint32> latency_us{ 0 }; // of the last message sent
+    std::atomic<Uint32> histogram[MIDI_LATENCY_BUCKETS];
+    // What the worker holds back, per class. The lanes are nearly always
+    // empty, the messages wait in the backlogs.
+    std::atomic<Uint32> backlog_depth[OUTPUT_CLASSES];
+};
+
+static_assert(OUTPUT_CLASSES == MIDI_OUTPUT_LANES, "one queue depth per class");
+
+static Output outputs[MIDI_OUTPUTS];
+static std::atomic<bool> running(false);
+// Every message goes out this long after its timestamp, 0 sends as soon as possible.
+static std::atomic<Uint32> fixed_latency_us(0);
+static MidiTap taps[OUTPUT_MAX_TAPS];
+static int tap_count = 0;
+static thread_local int route = 0;
+static thread_local Uint64 stamp = 0;
+
+
+static Uint64 fixed_latency() {
+    return (Uint64)fixed_latency_us.load(std::memory_order_relaxed) * SDL_NS_PER_US;
+}
+
+
+// How long the worker holds a message back after its timestamp.
+static Uint64 hold_time(const Output* o) {
+    return o->backend.load(std::memory_order_relaxed) == BACKEND_RTMIDI ? fixed_latency() : 0;
+}
+
+
+static bool backend_available(int backend) {
+    switch (backend) {
+    case BACKEND_RTMIDI:
+        return true;
+#if defined(__LINUX_ALSA__)
+    case BACKEND_ALSA_SEQ:
+        return alsa_seq_is_open();
+#endif
+#if defined(__UNIX_JACK__)
+    case BACKEND_JACK:
+        return jack_midi_is_open();
+#endif
+    default:
+        return false;
+    }
+}
+
+
+// When a message is due on a native backend, its timestamp plus the fixed latency.
+static Uint64 due_time(const MidiMessage& msg) {
+    return msg.timestamp + fixed_latency();
+}
+
+
+// Returns when the message goes out, 0 if it wasn't sent. The native backends
+// get it with its due time, for them that is when it is scheduled to go out,
+// not a measured delivery time.
+static Uint64 port_send(Output* o, const MidiMessage& msg, Uint64 due) {
+    int backend = o->backend.load(std::memory_order_relaxed);
+    if (backend != BACKEND_RTMIDI) {
+        bool queued = false;
+#if defined(__LINUX_ALSA__)
+        if (backend == BACKEND_ALSA_SEQ) {
+            queued = alsa_seq_send(msg, due);
+        }
+#endif
+#if defined(__UNIX_JACK__)
+        if (backend == BACKEND_JACK) {
+            queued = jack_midi_send(msg, due);
+        }
+#endif
+        return queued ? SDL_max(due, SDL_GetTicksNS()) : 0;
+    }
+    if (o->out == NULL) { // closed while the message was queued
+        return 0;
+    }
+    try {
+        if (msg.long_data) {
+            o->out->sendMessage(msg.long_data, msg.long_size);
+        }
+        else {
+            o->out->sendMessage(msg.bytes, msg.size);
+        }
+    }
+    catch (RtMidiError& error) {
+        error.printMessage();
+        return 0;
+    }
+    return SDL_GetTicksNS();
+}
+
+
+static Uint64 send_and_tap(Output* o, const MidiMessage& msg, Uint64 due) {
+    Uint64 sent = port_send(o, msg, due);
+    if (sent == 0) {
+        return 0;
+    }
+    for (int i = 0; i < tap_count; i++) {
+        taps[i](msg, sent);
+    }
+    return sent;
+}
+
+
+static Uint64 ns_per_byte(const Output* o) {
+    int rate = o->bytes_per_second.load(std::memory_order_relaxed);
+    return rate > 0 ? SDL_NS_PER_SECOND / rate : 0;
+}
+
+
+static void record_latency(Output* o, const MidiMessage& msg, Uint64 sent) {
+    Uint32 latency_us = sent > msg.timestamp ? (Uint32)((sent - msg.timestamp) / SDL_NS_PER_US) : 0;
+    o->latency_us.store(latency_us, std::memory_order_relaxed);
+    o->sent.fetch_add(1, std::memory_order_relaxed);
+    o->histogram[SDL_min(latency_us / MIDI_LATENCY_BUCKET_US, MIDI_LATENCY_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+// Send the realtime messages that are due. Returns when the next one is, 0 if
+// there is none.
+static Uint64 send_realtime(Output* o) {
+    Backlog<MidiMessage, OUTPUT_BACKLOG>& b = o->backlog[OUTPUT_REALTIME];
+    MidiMessage msg;
+    while (b.count < OUTPUT_BACKLOG && o->lanes[OUTPUT_REALTIME].pop(msg)) {
+        b.at(b.count++) = msg;
+    }
+    while (b.count > 0) {
+        Uint64 now = SDL_GetTicksNS();
+        Uint64 due = b.at(0).timestamp + hold_time(o);
+        if (due > now) {
+            return due;
+        }
+        msg = b.at(0);
+        b.pop_front();
+        Uint64 sent = send_and_tap(o, msg, due_time(msg));
+        o->wire = SDL_max(o->wire, now) + ns_per_byte(o);
+        if (sent != 0) {
+            record_latency(o, msg, sent);
+        }
+    }
+    return 0;
+}
+
+
+// Send a SysEx payload one F0..F7 message at a time. The worker sleeps between
+// chunks instead of sending anything else, so slow devices get their pause and
+// the dump is never interleaved with other messages. Realtime messages may go
+// in between, as MIDI allows. A native backend does the pausing itself: each
+// chunk is due the delay after the one before it. The port lock is let go
+// during the pauses, so the UI can change ports without waiting for the whole
+// dump. Returns when the last chunk goes out, 0 if it wasn't sent.
+static Uint64 send_long(Output* o, const MidiMessage& msg, std::unique_lock<std::mutex>& lock) {
+    MidiMessage chunk = msg;
+    Uint32 start = 0;
+    Uint64 sent = 0;
+    bool native = o->backend.load(std::memory_order_relaxed) != BACKEND_RTMIDI;
+    Uint64 due = SDL_max(due_time(msg), SDL_GetTicksNS());
+
+    while (start < msg.long_size) {
+        Uint32 end = start;
+        while (end < msg.long_size && msg.long_data[end] != 0xF7) {
+            end++;
+        }
+        end = SDL_min(end + 1, msg.long_size);
+
+        if (start > 0 && msg.chunk_delay_us > 0) {
+            if (native) {
+                due += (Uint64)msg.chunk_delay_us * SDL_NS_PER_US;
+            }
+            else {
+                lock.unlock();
+                SDL_DelayPrecise((Uint64)msg.chunk_delay_us * SDL_NS_PER_US);
+                lock.lock();
+            }
+        }
+        send_realtime(o);
+        chunk.long_data = msg.long_data + start;
+        chunk.long_size = end - start;
+        sent = send_and_tap(o, chunk, due);
+        start = end;
+    }
+    return sent;
+}
+
+
+// Controller values where only the latest one matters. Switches (64-69) and
+// channel mode messages (120-127) are events, like notes.
+static bool is_continuous(const MidiMessage& msg) {
+    if (msg.long_data || msg.size == 0) {
+        return false;
+    }
+    switch (msg.bytes[0] & 0xF0) {
+    case 0xA0: // poly pressure
+    case 0xD0: // channel pressure
+    case 0xE0: // pitch bend
+        return true;
+    case 0xB0:
+        return msg.bytes[1] < 64 || (msg.bytes[1] > 69 && msg.bytes[1] < 120);
+    default:
+        return false;
+    }
+}
+
+
+static bool is_note_on(const MidiMessage& msg) {
+    return !msg.long_data && msg.size == 3 && (msg.bytes[0] & 0xF0) == 0x90 && msg.bytes[2] != 0;
+}
+
+
+static int message_class(const MidiMessage& msg) {
+    if (!msg.long_data && msg.size == 1 && msg.bytes[0] >= 0xF8) {
+        return OUTPUT_REALTIME;
+    }
+    if (is_continuous(msg)) {
+        return OUTPUT_CONTROL;
+    }
+    int type = msg.bytes[0] & 0xF0;
+    if (!msg.long_data && (type == 0x80 || (type == 0x90 && !is_note_on(msg)))) {
+        return OUTPUT_NOTE_OFF;
+    }
+    return OUTPUT_EVENT;
+}
+
+
+static int control_slot(const MidiMessage& msg) {
+    int channel = msg.bytes[0] & 0x0F;
+    switch (msg.bytes[0] & 0xF0) {
+    case 0xB0:
+        return channel * SLOTS_PER_CHANNEL + msg.bytes[1];
+    case 0xD0:
+        return channel * SLOTS_PER_CHANNEL + 128;
+    case 0xE0:
+        return channel * SLOTS_PER_CHANNEL + 129;
+    default: // 0xA0
+        return channel * SLOTS_PER_CHANNEL + 130 + msg.bytes[1];
+    }
+}
+
+
+static Uint64 control_value(const MidiMessage& msg) {
+    switch (msg.bytes[0] & 0xF0) {
+    case 0xD0:
+        return msg.bytes[1];
+    case 0xE0:
+        return msg.bytes[1] | (msg.bytes[2] << 7);
+    default:
+        return msg.bytes[2];
+    }
+}
+
+
+static MidiMessage control_message(int slot, Uint64 state) {
+    MidiMessage msg;
+    int channel = slot / SLOTS_PER_CHANNEL;
+    int control = slot % SLOTS_PER_CHANNEL;
+    int value = (int)(state & SLOT_VALUE_MASK);
+    if (control < 128) {
+        msg.bytes[0] = (unsigned char)(0xB0 + channel);
+        msg.bytes[1] = (unsigned char)control;
+        msg.bytes[2] = (unsigned char)value;
+        msg.size = 3;
+    }
+    else if (control == 128) {
+        msg.bytes[0] = (unsigned char)(0xD0 + channel);
+        msg.bytes[1] = (unsigned char)value;
+        msg.size = 2;
+    }
+    else if (control == 129) {
+        msg.bytes[0] = (unsigned char)(0xE0 + channel);
+        msg.bytes[1] = (unsigned char)(value & 0x7F);
+        msg.bytes[2] = (unsigned char)(value >> 7);
+        msg.size = 3;
+    }
+    else {
+        msg.bytes[0] = (unsigned char)(0xA0 + channel);
+        msg.bytes[1] = (unsigned char)(control - 130);
+        msg.bytes[2] = (unsigned char)value;
+        msg.size = 3;
+    }
+    msg.seq = (Uint32)(state >> SLOT_SEQ_SHIFT);
+    return msg;
+}
+
+
+static bool sent_before(const MidiMessage& a, const MidiMessage& b) {
+    return (Sint32)(a.seq - b.seq) < 0;
+}
+
+
+// Store the value in its slot and queue the slot if it isn't yet. A queued
+// slot keeps its place in the order and sends the latest value.
+static bool send_control(Output& o, const MidiMessage& msg, Uint32 seq) {
+    ControlSlot& slot = o.slots[control_slot(msg)];
+    Uint64 value = control_value(msg);
+    Uint64 state = slot.state.load(std::memory_order_relaxed);
+    Uint64 next;
+
+    slot.timestamp.store(msg.timestamp, std::memory_order_relaxed);
+    do {
+        if (state & SLOT_QUEUED) {
+            next = (state & ~SLOT_VALUE_MASK) | value;
+        }
+        else {
+            next = SLOT_QUEUED | ((Uint64)seq << SLOT_SEQ_SHIFT) | value;
+        }
+    } while (!slot.state.compare_exchange_weak(state, next, std::memory_order_acq_rel));
+
+    if (state & SLOT_QUEUED) {
+        o.coalesced.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    slot.queued_at.store(msg.timestamp, std::memory_order_relaxed);
+    return o.control_lane.push((Uint16)control_slot(msg));
+}
+
+
+// Park a note-off its lane had no room for. A later note-off of the same
+// key takes its place, its note-on can't have gone before the one that
+// is parked.
+static void park_note_off(Output& o, const MidiMessage& msg) {
+    int key = (msg.bytes[0] & 0x0F) * 128 + (msg.bytes[1] & 0x7F);
+    Uint64 velocity = (msg.bytes[0] & 0xF0) == 0x80 ? msg.bytes[2] : 0;
+    o.pending_off_times[key].store(msg.timestamp, std::memory_order_relaxed);
+    o.pending_offs[key].store(OFF_PENDING | velocity << OFF_VELOCITY_SHIFT | msg.seq, std::memory_order_release);
+    o.has_pending_offs.store(true, std::memory_order_release);
+}
+
+
+// Take the parked note-offs the note-off backlog has room for, after the
+// lane, which holds the ones sent before them.
+static void take_parked_note_offs(Output* o) {
+    if (!o->has_pending_offs.exchange(false, std::memory_order_acquire)) {
+        return;
+    }
+    Backlog<MidiMessage, OUTPUT_BACKLOG>& b = o->backlog[OUTPUT_NOTE_OFF];
+    for (int key = 0; key < 16 * 128; key++) {
+        if (!(o->pending_offs[key].load(std::memory_order_relaxed) & OFF_PENDING)) {
+            continue;
+        }
+        if (b.count == OUTPUT_BACKLOG) {
+            o->has_pending_offs.store(true, std::memory_order_relaxed);
+            return;
+        }
+        Uint64 state = o->pending_offs[key].exchange(0, std::memory_order_acquire);
+        MidiMessage msg;
+        msg.timestamp = o->pending_off_times[key].load(std::memory_order_relaxed);
+        msg.bytes[0] = (unsigned char)(0x80 + key / 128);
+        msg.bytes[1] = (unsigned char)(key % 128);
+        msg.bytes[2] = (unsigned char)((state >> OFF_VELOCITY_SHIFT) & 0x7F);
+        msg.size = 3;
+        msg.output = (unsigned char)(o - outputs);
+        msg.seq = (Uint32)state;
+        b.at(b.count++) = msg;
+    }
+}
+
+
+// Take everything the backlogs have room for, the controls always fit.
+// Note-offs are taken first: once the event lane has been emptied after
+// them, a note-on sent before its note-off is always in the backlog.
+static void drain_lanes(Output* o) {
+    MidiMessage msg;
+    for (int c = OUTPUT_NOTE_OFF; c < OUTPUT_CONTROL; c++) {
+        Backlog<MidiMessage, OUTPUT_BACKLOG>& b = o->backlog[c];
+        while (b.count < OUTPUT_BACKLOG && o->lanes[c].pop(msg)) {
+            b.at(b.count++) = msg;
+        }
+        if (c == OUTPUT_NOTE_OFF && o->lanes[c].size() == 0) {
+            take_parked_note_offs(o);
+        }
+    }
+    o->events_drained = o->backlog[OUTPUT_EVENT].count < OUTPUT_BACKLOG;
+    Uint16 slot;
+    while (o->control_lane.pop(slot)) {
+        o->controls.at(o->controls.count++) = slot;
+    }
+}
+
+
+// Take a queued slot's value, it can be queued again from now on.
+static MidiMessage take_control(Output* o, int index) {
+    int slot = o->controls.at(index);
+    o->controls.remove(index);
+    Uint64 state = o->slots[slot].state.fetch_and(~SLOT_QUEUED, std::memory_order_acq_rel);
+    MidiMessage msg = control_message(slot, state);
+    msg.timestamp = o->slots[slot].timestamp.load(std::memory_order_relaxed);
+    msg.output = (unsigned char)(o - outputs);
+    return msg;
+}
+
+
+// A note-off may not overtake its own note-on.
+static bool note_off_may_go(Output* o) {
+    const MidiMessage& off = o->backlog[OUTPUT_NOTE_OFF].at(0);
+    Backlog<MidiMessage, OUTPUT_BACKLOG>& events = o->backlog[OUTPUT_EVENT];
+    if (!o->events_drained) {
+        return false; // its note-on may still be in the lane
+    }
+    for (int i = 0; i < events.count; i++) {
+        const MidiMessage& e = events.at(i);
+        if (is_note_on(e) && sent_before(e, off) && (e.bytes[0] & 0x0F) == (off.bytes[0] & 0x0F) &&
+            e.bytes[1] == off.bytes[1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// A note-on may not overtake an earlier note-off of its key either. Its
+// note-on was taken before the note-on that is waiting, so the note-off can
+// go. Returns the note-off to send first, or -1 if there is none.
+static int note_on_blocker(Output* o) {
+    const MidiMessage& on = o->backlog[OUTPUT_EVENT].at(0);
+    Backlog<MidiMessage, OUTPUT_BACKLOG>& offs = o->backlog[OUTPUT_NOTE_OFF];
+    if (!is_note_on(on)) {
+        return -1;
+    }
+    for (int i = 0; i < offs.count; i++) {
+        const MidiMessage& off = offs.at(i);
+        if (sent_before(off, on) && (off.bytes[0] & 0x0F) == (on.bytes[0] & 0x0F) && off.bytes[1] == on.bytes[1]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// An event may not overtake the controller values of its channel, an MPE note
+// needs its expression reset first. Returns the control to send before it, or
+// -1 if it may go.
+static int event_blocker(Output* o) {
+    const MidiMessage& event = o->backlog[OUTPUT_EVENT].at(0);
+    bool channel_message = !event.long_data && event.bytes[0] < 0xF0;
+    for (int i = 0; i < o->controls.count; i++) {
+        int slot = o->controls.at(i);
+        Uint32 seq = (Uint32)(o->slots[slot].state.load(std::memory_order_relaxed) >> SLOT_SEQ_SHIFT);
+        if ((Sint32)(seq - event.seq) < 0 && (!channel_message || slot / SLOTS_PER_CHANNEL == (event.bytes[0] & 0x0F))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// When the first message of a class may go, in fixed latency mode not before
+// its timestamp plus the latency. 0 if the class is empty.
+static Uint64 first_due(Output* o, int c) {
+    if (c == OUTPUT_CONTROL) {
+        if (o->controls.count == 0) {
+            return 0;
+        }
+        return o->slots[o->controls.at(0)].queued_at.load(std::memory_order_relaxed) + hold_time(o);
+    }
+    if (o->backlog[c].count == 0) {
+        return 0;
+    }
+    return o->backlog[c].at(0).timestamp + hold_time(o);
+}
+
+
+// A controller value a saturated DIN port couldn't send within the latency
+// budget. Sending it now would only hold up fresher messages, but it is the
+// latest value of its controller and nothing else would resend it, so it
+// waits until nothing else is queued.
+static bool control_late(Output* o, int slot, Uint64 now) {
+    Uint64 budget = fixed_latency() + SDL_MS_TO_NS(o->max_latency_ms.load(std::memory_order_relaxed));
+    return ns_per_byte(o) > 0 && now > o->slots[slot].timestamp.load(std::memory_order_relaxed) + budget;
+}
+
+
+// The first queued control that isn't late, -1 if there is none.
+static int fresh_control(Output* o, Uint64 now) {
+    for (int i = 0; i < o->controls.count; i++) {
+        if (!control_late(o, o->controls.at(i), now)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Returns the class to send from next and, in index, which of its messages:
+// the highest class that is due and may go, unless a lower one has been
+// passed over too often. A blocked note-off waits for its note-on, a blocked
+// event sends its blocking note-off or control first. Returns -1 and sets next_due to
+// the earliest due time if nothing can go now, 0 if nothing is queued.
+static int pick_message(Output* o, Uint64 now, int* index, Uint64* next_due) {
+    bool ready[OUTPUT_CLASSES] = {};
+    *next_due = 0;
+    for (int c = OUTPUT_NOTE_OFF; c < OUTPUT_CLASSES; c++) {
+        Uint64 due = first_due(o, c);
+        ready[c] = due != 0 && due <= now;
+        if (due > now && (*next_due == 0 || due < *next_due)) {
+            *next_due = due;
+        }
+    }
+    int fresh = ready[OUTPUT_CONTROL] ? fresh_control(o, now) : -1;
+    if (fresh < 0 && o->backlog[OUTPUT_NOTE_OFF].count + o->backlog[OUTPUT_EVENT].count > 0) {
+        ready[OUTPUT_CONTROL] = false; // only late values, they wait for the rest
+    }
+
+    int c;
+    if (o->passed[OUTPUT_CONTROL] >= OUTPUT_STARVE_LIMIT && ready[OUTPUT_CONTROL]) {
+        c = OUTPUT_CONTROL;
+    }
+    else if (o->passed[OUTPUT_EVENT] >= OUTPUT_STARVE_LIMIT && ready[OUTPUT_EVENT]) {
+        c = OUTPUT_EVENT;
+    }
+    else if (ready[OUTPUT_NOTE_OFF] && note_off_may_go(o)) {
+        c = OUTPUT_NOTE_OFF;
+    }
+    else if (ready[OUTPUT_EVENT]) {
+        c = OUTPUT_EVENT;
+    }
+    else if (ready[OUTPUT_CONTROL]) {
+        c = OUTPUT_CONTROL;
+    }
+    else {
+        return -1;
+    }
+
+    *index = 0;
+    if (c == OUTPUT_CONTROL) {
+        *index = SDL_max(fresh, 0);
+    }
+    else if (c == OUTPUT_EVENT) {
+        int blocker = note_on_blocker(o);
+        if (blocker >= 0) {
+            c = OUTPUT_NOTE_OFF;
+            *index = blocker;
+            return c;
+        }
+        blocker = event_blocker(o);
+        if (blocker >= 0) {
+            c = OUTPUT_CONTROL;
+            *index = blocker;
+        }
+    }
+    return c;
+}
+
+
+// Send what the port can take now. Returns how long until it can take more
+// or the next message is due, 0 if the backlogs are empty.
+static Uint64 send_backlog(Output* o, std::unique_lock<std::mutex>& lock) {
+    for (;;) {
+        Uint64 now = SDL_GetTicksNS();
+        if (o->wire > now + OUTPUT_BURST_NS) {
+            return o->wire - now - OUTPUT_BURST_NS;
+        }
+        Uint64 realtime_due = send_realtime(o);
+        int index;
+        Uint64 next_due;
+        now = SDL_GetTicksNS();
+        int c = pick_message(o, now, &index, &next_due);
+        if (c < 0) {
+            if (realtime_due != 0 && (next_due == 0 || realtime_due < next_due)) {
+                next_due = realtime_due;
+            }
+            return next_due > now ? next_due - now : 0;
+        }
+        for (int other = OUTPUT_NOTE_OFF; other < OUTPUT_CLASSES; other++) {
+            int queued = other == OUTPUT_CONTROL ? o->controls.count : o->backlog[other].count;
+            o->passed[other] = other == c ? 0 : o->passed[other] + (queued > 0);
+        }
+        MidiMessage msg;
+        if (c == OUTPUT_CONTROL) {
+            msg = take_control(o, index);
+        }
+        else {
+            msg = o->backlog[c].at(index);
+            o->backlog[c].remove(index);
+        }
+        Uint64 sent = msg.long_data ? send_long(o, msg, lock) : send_and_tap(o, msg, due_time(msg));
+        Uint32 bytes = msg.long_data ? msg.long_size : msg.size;
+        o->wire = SDL_max(o->wire, now) + bytes * ns_per_byte(o);
+        if (sent != 0) {
+            record_latency(o, msg, sent);
+        }
+        midi_message_release(msg);
+    }
+}
+
+
+static void output_worker(Output* o) {
+    Uint64 wait = 0;
+
+    SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+    while (running.load(std::memory_order_acquire)) {
+        if (wait == 0) {
+            SDL_WaitSemaphoreTimeout(o->wakeup, OUTPUT_IDLE_MS);
+        }
+        else if (wait > OUTPUT_PRECISE_NS) {
+            SDL_WaitSemaphoreTimeout(o->wakeup, (Sint32)((wait - OUTPUT_PRECISE_NS) / SDL_NS_PER_MS));
+        }
+        else {
+            SDL_DelayPrecise(wait);
+        }
+        std::unique_lock<std::mutex> lock(o->port_mutex);
+        drain_lanes(o);
+        wait = send_backlog(o, lock);
+        for (int c = 0; c < OUTPUT_CLASSES; c++) {
+            int count = c == OUTPUT_CONTROL ? o->controls.count : o->backlog[c].count;
+            o->backlog_depth[c].store((Uint32)count, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+void midi_message_retain(const MidiMessage& msg) {
+    if (msg.long_refs) {
+        msg.long_refs->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+void midi_message_release(const MidiMessage& msg) {
+    if (msg.long_refs) {
+        msg.long_refs->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+bool midi_output_add_tap(MidiTap tap) {
+    if (running.load() || tap_count == OUTPUT_MAX_TAPS) {
+        return false;
+    }
+    taps[tap_count++] = tap;
+    return true;
+}
+
+
+bool midi_output_start(RtMidiOut* mout) {
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        outputs[i].wakeup = SDL_CreateSemaphore(0);
+        if (outputs[i].wakeup == NULL) {
+            SDL_Log("Couldn't create output semaphore: %s", SDL_GetError());
+            return false;
+        }
+    }
+    outputs[0].out = mout;
+    outputs[0].open.store(true);
+    running.store(true);
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        outputs[i].worker = std::thread(output_worker, &outputs[i]);
+    }
+    return true;
+}
+
+
+void midi_output_stop() {
+    if (running.exchange(false)) {
+        for (int i = 0; i < MIDI_OUTPUTS; i++) {
+            SDL_SignalSemaphore(outputs[i].wakeup);
+            outputs[i].worker.join();
+        }
+    }
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        if (outputs[i].wakeup) {
+            SDL_DestroySemaphore(outputs[i].wakeup);
+            outputs[i].wakeup = NULL;
+        }
+        if (i > 0) {
+            delete outputs[i].out;
+        }
+        outputs[i].out = NULL;
+        outputs[i].open.store(false);
+    }
+}
+
+
+void midi_output_route(int output) {
+    route = output >= 0 && output < MIDI_OUTPUTS ? output : 0;
+}
+
+
+void midi_output_stamp(Uint64 timestamp) {
+    stamp = timestamp;
+}
+
+
+bool midi_output_send(const MidiMessage& msg) {
+    int o = outputs[route].open.load(std::memory_order_relaxed) ? route : 0;
+    MidiMessage routed = msg;
+    routed.output = (unsigned char)o;
+    routed.seq = outputs[o].next_seq.fetch_add(1, std::memory_order_relaxed);
+    int c = message_class(routed);
+    bool queued;
+    if (c == OUTPUT_CONTROL) {
+        queued = send_control(outputs[o], routed, routed.seq);
+    }
+    else {
+        queued = outputs[o].lanes[c].push(routed);
+    }
+    if (!queued && c == OUTPUT_NOTE_OFF) {
+        park_note_off(outputs[o], routed);
+        queued = true;
+    }
+    if (!queued) {
+        outputs[o].dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    SDL_SignalSemaphore(outputs[o].wakeup);
+    return true;
+}
+
+
+bool midi_output_send(unsigned char status, unsigned char data1) {
+    MidiMessage msg;
+    msg.timestamp = stamp != 0 ? stamp : SDL_GetTicksNS();
+    msg.bytes[0] = status;
+    msg.bytes[1] = data1;
+    msg.size = 2;
+    return midi_output_send(msg);
+}
+
+
+bool midi_output_send(unsigned char status, unsigned char data1, unsigned char data2) {
+    MidiMessage msg;
+    msg.timestamp = stamp != 0 ? stamp : SDL_GetTicksNS();
+    msg.bytes[0] = status;
+    msg.bytes[1] = data1;
+    msg.bytes[2] = data2;
+    msg.size = 3;
+    return midi_output_send(msg);
+}
+
+
+bool midi_output_send_long(const unsigned char* data, Uint32 size, Uint32 chunk_delay_us, std::atomic<int>* refs) {
+    MidiMessage msg;
+    msg.timestamp = stamp != 0 ? stamp : SDL_GetTicksNS();
+    msg.long_data = data;
+    msg.long_size = size;
+    msg.long_refs = refs;
+    msg.chunk_delay_us = chunk_delay_us;
+    // Taken before the worker can see the message, it releases it once sent.
+    midi_message_retain(msg);
+    if (!midi_output_send(msg)) {
+        midi_message_release(msg);
+        return false;
+    }
+    return true;
+}
+
+
+void midi_output_panic() {
+    int previous = route;
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        if (!outputs[i].open.load()) {
+            continue;
+        }
+        route = i;
+        for (unsigned char channel = 0; channel < 16; channel++) {
+            midi_output_send(0xB0 + channel, 120, 0); // all sound off
+            midi_output_send(0xB0 + channel, 123, 0); // all notes off
+        }
+    }
+    route = previous;
+}
+
+
+void midi_output_set_fixed_latency(Uint32 latency_us) {
+    fixed_latency_us.store(latency_us);
+}
+
+
+bool midi_output_set_backend(int output, int backend) {
+    if (output < 0 || output >= MIDI_OUTPUTS || backend < 0 || backend >= BACKENDS || !backend_available(backend)) {
+        return false;
+    }
+    outputs[output].backend.store(backend);
+    return true;
+}
+
+
+void midi_output_counters(int output, MidiOutputCounters* counters) {
+    const Output& o = outputs[output];
+    counters->open = o.open.load();
+    counters->sent = o.sent.load();
+    counters->coalesced = o.coalesced.load();
+    counters->dropped = o.dropped.load();
+    counters->latency_us = o.latency_us.load();
+    counters->backend = o.backend.load();
+    for (int c = 0; c < OUTPUT_CLASSES; c++) {
+        counters->queued[c] = o.backlog_depth[c].load(std::memory_order_relaxed);
+    }
+    for (int c = 0; c < OUTPUT_CONTROL; c++) {
+        counters->queued[c] += (Uint32)o.lanes[c].size();
+    }
+    counters->queued[OUTPUT_CONTROL] += (Uint32)o.control_lane.size();
+    for (int b = 0; b < MIDI_LATENCY_BUCKETS; b++) {
+        counters->histogram[b] = o.histogram[b].load();
+    }
+}
+
+
+void midi_output_open_port(int output, int port_id) {
+    if (output < 0 || output >= MIDI_OUTPUTS || (output == 0 && port_id < 0)) {
+        return;
+    }
+    Output& o = outputs[output];
+    std::lock_guard<std::mutex> lock(o.port_mutex);
+    o.open.store(output == 0);
+    if (o.out == NULL) {
+        if (port_id < 0) {
+            return;
+        }
+        try {
+            o.out = new RtMidiOut();
+        }
+        catch (RtMidiError& error) {
+            error.printMessage();
+            return;
+        }
+    }
+    o.out->closePort();
+    if (port_id < 0) {
+        return;
+    }
+    try {
+        SDL_Log("RtMidi open port %s on output %d", o.out->getPortName(port_id).c_str(), output);
+        o.out->openPort(port_id);
+    }
+    catch (RtMidiError& error) {
+        error.printMessage();
+        // TODO: show the error to user or crash the app.
+        return;
+    }
+    o.open.store(true);
+}
+
+
+// The latency under which a share of the messages went out, in ms.
+static float latency_percentile(const Uint32* counts, Uint32 total, float share) {
+    Uint32 seen = 0;
+    for (int i = 0; i < MIDI_LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= total * share) {
+            return (i + 1) * MIDI_LATENCY_BUCKET_US / 1000.0f;
+        }
+    }
+    return MIDI_LATENCY_BUCKETS * MIDI_LATENCY_BUCKET_US / 1000.0f;
+}
+
+
+static void latency_histogram_ui(int i, Output& o) {
+    Uint32 counts[MIDI_LATENCY_BUCKETS];
+    float values[MIDI_LATENCY_BUCKETS];
+    Uint32 total = 0;
+    for (int b = 0; b < MIDI_LATENCY_BUCKETS; b++) {
+        counts[b] = o.histogram[b].load(std::memory_order_relaxed);
+        values[b] = (float)counts[b];
+        total += counts[b];
+    }
+    if (total == 0) {
+        return;
+    }
+
+    // Jitter is the spread of the middle 98%, the max would only show the outliers.
+    char overlay[64];
+    float low = latency_percentile(counts, total, 0.01f);
+    float high = latency_percentile(counts, total, 0.99f);
+    SDL_snprintf(overlay, sizeof(overlay), "p50 %.2f ms, jitter %.2f ms", latency_percentile(counts, total, 0.5f), high - low);
+    char label[16];
+    SDL_snprintf(label, sizeof(label), "Port %d", i + 1);
+    ImGui::PlotHistogram(label, values, MIDI_LATENCY_BUCKETS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+}
+
+
+void midi_output_ui() {
+    ImGui::SeparatorText("Output Bandwidth");
+    if (ImGui::BeginTable("Outputs", 6)) {
+        ImGui::TableSetupColumn("Port");
+        ImGui::TableSetupColumn("DIN");
+        ImGui::TableSetupColumn("Max Latency ms");
+        ImGui::TableSetupColumn("Coalesced/Dropped");
+        ImGui::TableSetupColumn("Latency ms");
+        ImGui::TableSetupColumn("Backend");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < MIDI_OUTPUTS; i++) {
+            Output& o = outputs[i];
+            if (!o.open.load()) {
+                continue;
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", i + 1);
+            ImGui::PushID(i);
+            // DIN ports are limited to 31.25 kbaud, USB ports aren't modelled.
+            ImGui::TableNextColumn();
+            bool din = o.bytes_per_second.load() > 0;
+            if (ImGui::Checkbox("##DIN", &din)) {
+                o.bytes_per_second.store(din ? DIN_BYTES_PER_SECOND : 0);
+            }
+            ImGui::TableNextColumn();
+            int max_latency = o.max_latency_ms.load();
+            if (ImGui::SliderInt("##MaxLatency", &max_latency, 1, 200)) {
+                o.max_latency_ms.store(max_latency);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%u/%u", o.coalesced.load(), o.dropped.load());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", o.latency_us.load() / 1000.0f);
+            // The native backends send through ports of their own instead of the RtMidi port.
+            ImGui::TableNextColumn();
+            int backend = o.backend.load();
+            if (ImGui::BeginCombo("##Backend", backend_names[backend])) {
+                for (int b = 0; b < BACKENDS; b++) {
+                    if (backend_available(b) && ImGui::Selectable(backend_names[b], b == backend)) {
+                        o.backend.store(b);
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    // Sending every message a fixed time after its event turns the varying
+    // processing delay into a constant one, for recording.
+    ImGui::PushID("Latency");
+    int fixed_us = (int)fixed_latency_us.load();
+    bool fixed = fixed_us > 0;
+    if (ImGui::Checkbox("Fixed Latency", &fixed)) {
+        fixed_latency_us.store(fixed ? 3000 : 0);
+    }
+    if (fixed) {
+        ImGui::SameLine();
+        float fixed_ms = fixed_us / 1000.0f;
+        if (ImGui::SliderFloat("ms", &fixed_ms, 0.5f, 20.0f, "%.1f")) {
+            fixed_latency_us.store((Uint32)(fixed_ms * 1000));
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        for (int i = 0; i < MIDI_OUTPUTS; i++) {
+            for (int b = 0; b < MIDI_LATENCY_BUCKETS; b++) {
+                outputs[i].histogram[b].store(0);
+            }
+        }
+    }
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        if (outputs[i].open.load()) {
+            latency_histogram_ui(i, outputs[i]);
+        }
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+
+#include <SDL3/SDL.h>
+#include <RtMidi.h>
+
+// Output 0 is the port picked in the MIDI config, the others are opened on
+// demand, each has its own queue and worker.
+#define MIDI_OUTPUTS 4
+
+struct MidiMessage {
+    Uint64 timestamp = 0;   // SDL_GetTicksNS() time the message was produced
+    unsigned char bytes[3] = { 0, 0, 0 };
+    unsigned char size = 0;
+    // SysEx: points at a preallocated payload of one or more complete F0..F7
+    // messages, sent back to back with nothing else in between.
+    const unsigned char* long_data = NULL;
+    Uint32 long_size = 0;
+    std::atomic<int>* long_refs = NULL; // see midi_output_send_long()
+    Uint32 chunk_delay_us = 0; // pause between the messages of a long payload
+    unsigned char output = 0;  // set by midi_output_send()
+    Uint32 seq = 0;            // send order on the output, set by midi_output_send()
+};
+
+// Sees every message right after an output worker sent it. Runs on the
+// output workers, so it must not block and may be called concurrently.
+// A tap that reads long_data after it returned retains the message and
+// releases it once done.
+typedef void (*MidiTap)(const MidiMessage& msg, Uint64 sent);
+
+void midi_message_retain(const MidiMessage& msg);
+void midi_message_release(const MidiMessage& msg);
+
+// Register a tap. Must be called before midi_output_start().
+bool midi_output_add_tap(MidiTap tap);
+
+// All threads send through the output queues; only the output workers touch
+// the RtMidiOuts once they are started. mout becomes output 0.
+bool midi_output_start(RtMidiOut* mout);
+void midi_output_stop();
+
+// Messages sent from the calling thread go to this output from now on, or to
+// output 0 while it isn't open. Threads start on output 0.
+void midi_output_route(int output);
+
+// Messages sent from the calling thread get this timestamp instead of the
+// current time, 0 goes back to the current time. Set it to the SDL event
+// timestamp while turning an event into MIDI: in fixed latency mode every
+// message goes out a fixed time after its timestamp.
+void midi_output_stamp(Uint64 timestamp);
+
+// Never blocks. Returns false if the queue is full and the message was dropped.
+// Realtime messages go first, then note-offs, note-ons and other events, then
+// controller values, without reordering a note and what it depends on.
+// An output modelled as a DIN port sends no faster than the port can carry
+// and holds the rest back: newer controller values replace queued ones, and
+// controller values older than the latency budget wait until everything else
+// has been sent. Only a message refused by a full queue is ever dropped,
+// and never a note-off: one its queue has no room for is parked per key
+// until the worker can take it.
+// On Linux an output can send through its ALSA sequencer port, where the
+// kernel holds each message until it is due, or its JACK port, where it is
+// placed at the frame it is due on.
+bool midi_output_send(const MidiMessage& msg);
+bool midi_output_send(unsigned char status, unsigned char data1);
+bool midi_output_send(unsigned char status, unsigned char data1, unsigned char data2);
+// The payload must stay valid until it has been sent and no tap reads it any
+// more. refs, if given, counts the messages that still point at it, the
+// payload may be reused once it is back at 0.
+bool midi_output_send_long(const unsigned char* data, Uint32 size, Uint32 chunk_delay_us, std::atomic<int>* refs = NULL);
+
+// All sound off and all notes off on every channel of every open output.
+void midi_output_panic();
+
+// Where an output sends to. The native backends get every message with its
+// due time and do the waiting themselves, the worker hands it over at once.
+enum OutputBackend {
+    BACKEND_RTMIDI,
+    BACKEND_ALSA_SEQ, // kernel timed on a sequencer queue
+    BACKEND_JACK,     // placed at its frame in the JACK graph
+    BACKENDS
+};
+
+// What the fixed latency and backend settings of the UI set.
+void midi_output_set_fixed_latency(Uint32 latency_us);
+// Returns false if the backend isn't open.
+bool midi_output_set_backend(int output, int backend);
+
+// Latency from message timestamp to send, the last bucket takes everything
+// later. On a native backend a message counts as sent at the time it is
+// scheduled for, MidiBench measures when it actually arrives.
+#define MIDI_LATENCY_BUCKETS 64
+#define MIDI_LATENCY_BUCKET_US 250
+// Realtime, note-off, event and controller lanes.
+#define MIDI_OUTPUT_LANES 4
+
+struct MidiOutputCounters {
+    bool open = false;
+    int backend = BACKEND_RTMIDI;
+    Uint32 sent = 0;
+    Uint32 coalesced = 0;
+    Uint32 dropped = 0;
+    Uint32 latency_us = 0; // of the last message sent
+    // Waiting in the lane or held back by the worker, as of its last pass. A
+    // controller is queued once however often it changed.
+    Uint32 queued[MIDI_OUTPUT_LANES] = {};
+    Uint32 histogram[MIDI_LATENCY_BUCKETS] = {};
+};
+
+// Safe to call from any thread.
+void midi_output_counters(int output, MidiOutputCounters* counters);
+
+// Switch the port of an output from the UI thread without racing its worker.
+// A negative port_id closes the output, output 0 can't be closed.
+void midi_output_open_port(int output, int port_id);
+
+// Bandwidth model, backpressure counters, backend, fixed latency mode and
+// the latency histogram of each output.
+void midi_output_ui();
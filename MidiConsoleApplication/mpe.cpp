@@ -0,0 +1,210 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "mapping.h"
+#include "midi_output.h"
+#include "mpe.h"
+
+#define MPE_MAX_MEMBERS 15
+#define MPE_TIMBRE_CC 74
+
+enum MpeZone {
+    MPE_LOWER, // manager channel 1, members from channel 2 up
+    MPE_UPPER  // manager channel 16, members from channel 15 down
+};
+
+static std::atomic<bool> enabled(false);
+static std::atomic<int> zone(MPE_LOWER);
+static std::atomic<int> member_count(MPE_MAX_MEMBERS);
+static std::atomic<int> bend_range(48); // semitones
+static std::atomic<int> bend_axis(0);
+static std::atomic<int> pressure_axis(1);
+static std::atomic<int> timbre_axis(-1);
+
+// One bit per member channel, set when the channel is free. Allocating is a
+// single CAS on the highest free bit and releasing a single fetch_or, so both
+// are O(1), lock-free and safe from SDL_AppEvent and the timing thread.
+static std::atomic<Uint32> free_members((1u << MPE_MAX_MEMBERS) - 1);
+// The note held by each button, see held_note(), 0 for none. It keeps the
+// channel and note number it went out with, the zone or the mapping may
+// change while it is held.
+static std::atomic<Uint32> button_member[MAPPING_MAX_IDS];
+// The last note played, it gets the axis expression.
+static std::atomic<int> last_member(0);
+
+
+static unsigned char manager_channel() {
+    return zone.load(std::memory_order_relaxed) == MPE_LOWER ? 0 : 15;
+}
+
+
+static unsigned char member_channel(int member) {
+    return zone.load(std::memory_order_relaxed) == MPE_LOWER ? 1 + member : 14 - member;
+}
+
+
+// Member index + 1 in the low byte, then the channel, then the note.
+static int held_note(int member, unsigned char channel, unsigned char note) {
+    return (note << 16) | (channel << 8) | (member + 1);
+}
+
+
+static int allocate_member() {
+    Uint32 usable = (1u << member_count.load(std::memory_order_relaxed)) - 1;
+    Uint32 free = free_members.load(std::memory_order_relaxed);
+    for (;;) {
+        Uint32 available = free & usable;
+        if (available == 0) {
+            return -1;
+        }
+        int member = SDL_MostSignificantBitIndex32(available);
+        if (free_members.compare_exchange_weak(free, free & ~(1u << member), std::memory_order_acquire)) {
+            return member;
+        }
+    }
+}
+
+
+static void release_member(int member) {
+    free_members.fetch_or(1u << member, std::memory_order_release);
+}
+
+
+static void release_held(int held) {
+    int member = (held & 0xFF) - 1;
+    midi_output_send(0x80 + ((held >> 8) & 0xFF), held >> 16, 0);
+    int expected = held;
+    last_member.compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+    release_member(member);
+}
+
+
+static void send_rpn(unsigned char channel, unsigned char rpn, unsigned char value) {
+    midi_output_send(0xB0 + channel, 101, 0);
+    midi_output_send(0xB0 + channel, 100, rpn);
+    midi_output_send(0xB0 + channel, 6, value);
+}
+
+
+// MPE Configuration Message, plus the pitch bend range of every member.
+static void send_configuration() {
+    int members = enabled.load() ? member_count.load() : 0;
+    send_rpn(manager_channel(), 6, (unsigned char)members);
+    for (int m = 0; m < members; m++) {
+        send_rpn(member_channel(m), 0, (unsigned char)bend_range.load());
+    }
+}
+
+
+bool mpe_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+
+bool mpe_note_on(int button, unsigned char note, unsigned char velocity) {
+    // A second down without an up in between, e.g. from two devices on the
+    // same id: end the first note, or its member channel is never freed.
+    mpe_note_off(button);
+
+    int member = allocate_member();
+    if (member < 0) {
+        return false;
+    }
+    unsigned char channel = member_channel(member);
+
+    // Reset the expression left over from the last note on this channel.
+    midi_output_send(0xE0 + channel, 0x00, 0x40);
+    midi_output_send(0xD0 + channel, 0);
+    midi_output_send(0xB0 + channel, MPE_TIMBRE_CC, 64);
+    midi_output_send(0x90 + channel, note, velocity);
+
+    int held = held_note(member, channel, note);
+    button_member[button].store((Uint32)held, std::memory_order_relaxed);
+    last_member.store(held, std::memory_order_relaxed);
+    return true;
+}
+
+
+bool mpe_note_off(int button) {
+    int held = button_member[button].exchange(0, std::memory_order_relaxed);
+    if (held == 0) {
+        return false;
+    }
+    release_held(held);
+    return true;
+}
+
+
+void mpe_axis(int axis, Sint16 value) {
+    int held = last_member.load(std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed) || held == 0) {
+        return;
+    }
+    unsigned char channel = (unsigned char)((held >> 8) & 0xFF);
+    int position = value + 32768; // 0 to 65535
+
+    if (axis == bend_axis.load(std::memory_order_relaxed)) {
+        int bend = position >> 2; // 14 bits
+        midi_output_send(0xE0 + channel, bend & 0x7F, bend >> 7);
+    }
+    if (axis == pressure_axis.load(std::memory_order_relaxed)) {
+        midi_output_send(0xD0 + channel, position >> 9);
+    }
+    if (axis == timbre_axis.load(std::memory_order_relaxed)) {
+        midi_output_send(0xB0 + channel, MPE_TIMBRE_CC, position >> 9);
+    }
+}
+
+
+void mpe_ui() {
+    bool changed = false;
+
+    ImGui::SeparatorText("MPE");
+    ImGui::PushID("MPE");
+    bool on = enabled.load();
+    if (ImGui::Checkbox("Enabled", &on)) {
+        enabled.store(on);
+        changed = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Lower Zone", zone.load() == MPE_LOWER)) {
+        zone.store(MPE_LOWER);
+        changed = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Upper Zone", zone.load() == MPE_UPPER)) {
+        zone.store(MPE_UPPER);
+        changed = true;
+    }
+
+    int members = member_count.load();
+    if (ImGui::SliderInt("Members", &members, 1, MPE_MAX_MEMBERS)) {
+        member_count.store(members);
+        changed = true;
+    }
+    int range = bend_range.load();
+    if (ImGui::SliderInt("Bend Range", &range, 1, 96)) {
+        bend_range.store(range);
+        changed = true;
+    }
+
+    // -1 means the dimension isn't mapped to an axis.
+    int axis = bend_axis.load();
+    if (ImGui::SliderInt("Bend Axis", &axis, -1, 15)) {
+        bend_axis.store(axis);
+    }
+    axis = pressure_axis.load();
+    if (ImGui::SliderInt("Pressure Axis", &axis, -1, 15)) {
+        pressure_axis.store(axis);
+    }
+    axis = timbre_axis.load();
+    if (ImGui::SliderInt("Timbre Axis", &axis, -1, 15)) {
+        timbre_axis.store(axis);
+    }
+    ImGui::PopID();
+
+    if (changed) {
+        send_configuration();
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+bool mpe_enabled();
+
+// Play a NOTE button on its own member channel. Returns false if the zone
+// has no free channel left.
+bool mpe_note_on(int button, unsigned char note, unsigned char velocity);
+// Ends the note the button holds on its member channel. Returns false if
+// the button doesn't hold an MPE channel.
+bool mpe_note_off(int button);
+
+// Per-note pitch bend, pressure and timbre (CC74) for the last note played.
+void mpe_axis(int axis, Sint16 value);
+
+void mpe_ui();
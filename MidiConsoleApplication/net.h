@@ -0,0 +1,86 @@
+#pragma once
+
+// The few socket calls the network outputs share, on Winsock or BSD sockets.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET NetSocket;
+#define NET_NO_SOCKET INVALID_SOCKET
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int NetSocket;
+#define NET_NO_SOCKET -1
+#endif
+
+#include <SDL3/SDL.h>
+
+// Every successful net_startup() needs its net_cleanup().
+static inline bool net_startup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    return true;
+#endif
+}
+
+
+static inline void net_cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+
+static inline void net_close(NetSocket sock) {
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+
+static inline bool net_set_nonblocking(NetSocket sock) {
+#ifdef _WIN32
+    u_long nonblocking = 1;
+    return ioctlsocket(sock, FIONBIO, &nonblocking) == 0;
+#else
+    return fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+}
+
+
+// A UDP socket bound to port on every interface, any port for 0. Receiving
+// from it never blocks. NET_NO_SOCKET on failure.
+static inline NetSocket net_udp_socket(Uint16 port) {
+    NetSocket sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == NET_NO_SOCKET) {
+        return NET_NO_SOCKET;
+    }
+    sockaddr_in local;
+    SDL_zero(local);
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(port);
+    if (!net_set_nonblocking(sock) || bind(sock, (const sockaddr*)&local, sizeof(local)) != 0) {
+        net_close(sock);
+        return NET_NO_SOCKET;
+    }
+    return sock;
+}
+
+
+// Fills in address and port of an IPv4 address in dotted form.
+static inline bool net_address(const char* host, int port, sockaddr_in* address) {
+    SDL_zerop(address);
+    address->sin_family = AF_INET;
+    address->sin_port = htons((Uint16)port);
+    return port > 0 && port <= 65535 && inet_pton(AF_INET, host, &address->sin_addr) == 1;
+}
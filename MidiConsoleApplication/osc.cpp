@@ -0,0 +1,328 @@
+#include <atomic>
+#include <thread>
+
+#include "imgui.h"
+
+#include "lockfree_queue.h"
+#include "mapping.h"
+#include "net.h"
+#include "osc.h"
+
+#define OSC_MAX_ADDRESS 64
+#define OSC_MAX_MESSAGE (OSC_MAX_ADDRESS + 8) // address, ",f" and the float
+#define OSC_MAX_PACKET 512
+#define OSC_QUEUE_SIZE 256
+#define OSC_AXES 16
+#define OSC_DEFAULT_PORT 9000
+#define OSC_IDLE_MS 100
+#define OSC_BUNDLE_HEADER 16 // "#bundle" and the time tag
+
+struct OscPacket {
+    Uint16 size = 0;
+    unsigned char data[OSC_MAX_PACKET];
+};
+
+// A message encoded when its address is set, sending only patches in the
+// float. Two buffers so an edit never changes the one being sent.
+struct OscTemplate {
+    unsigned char data[2][OSC_MAX_MESSAGE];
+    int size[2] = { 0, 0 }; // 0 without an address
+    std::atomic<int> current{ 0 };
+    char text[OSC_MAX_ADDRESS] = "";
+};
+
+// The bundle of the input event the thread is handling.
+struct OscFrame {
+    OscPacket packet;
+    int messages = 0;
+    int depth = 0;
+};
+
+static OscTemplate buttons[MAPPING_MAX_IDS];
+// The button addresses of the mode that isn't active, only the UI touches it.
+static char other_text[MAPPING_MAX_BUTTONS][OSC_MAX_ADDRESS];
+static OscTemplate axes[OSC_AXES];
+static LockFreeQueue<OscPacket, OSC_QUEUE_SIZE> queue;
+static SDL_Semaphore* wakeup = NULL;
+static std::thread worker;
+static std::atomic<bool> running(false);
+static std::atomic<bool> enabled(true);
+static NetSocket sock = NET_NO_SOCKET;
+// Both in network byte order.
+static std::atomic<Uint32> target_address(0);
+static std::atomic<Uint16> target_port(0);
+static std::atomic<Uint32> sent(0);
+static std::atomic<Uint32> dropped(0);
+static thread_local OscFrame frame;
+static char host_text[64] = "127.0.0.1";
+static int port_value = OSC_DEFAULT_PORT;
+
+// Time tag 1 means immediately.
+static const unsigned char bundle_header[OSC_BUNDLE_HEADER] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+
+
+// OSC strings end with at least one NUL and are padded to 4 bytes.
+static int padded_size(int length) {
+    return (length + 4) & ~3;
+}
+
+
+static void set_address(OscTemplate& t, const char* address) {
+    int next = 1 - t.current.load();
+    int length = (int)SDL_strlen(address);
+    t.size[next] = 0;
+    if (length > 0 && length < OSC_MAX_ADDRESS && address[0] == '/') {
+        SDL_memset(t.data[next], 0, OSC_MAX_MESSAGE);
+        SDL_memcpy(t.data[next], address, length);
+        int size = padded_size(length);
+        SDL_memcpy(t.data[next] + size, ",f", 2);
+        t.size[next] = size + 8;
+    }
+    t.current.store(next, std::memory_order_release);
+}
+
+
+static void push(const OscPacket& packet) {
+    if (!queue.push(packet)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    SDL_SignalSemaphore(wakeup);
+}
+
+
+static void flush_frame() {
+    OscPacket& p = frame.packet;
+    if (frame.messages == 1) {
+        // A bundle of one is only overhead, send the bare message.
+        SDL_memmove(p.data, p.data + OSC_BUNDLE_HEADER + 4, p.size - OSC_BUNDLE_HEADER - 4);
+        p.size -= OSC_BUNDLE_HEADER + 4;
+    }
+    if (frame.messages > 0) {
+        push(p);
+    }
+    p.size = 0;
+    frame.messages = 0;
+}
+
+
+static void send_message(const OscTemplate& t, float value) {
+    if (!running.load(std::memory_order_relaxed) || !enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    int current = t.current.load(std::memory_order_acquire);
+    int size = t.size[current];
+    if (size == 0) {
+        return;
+    }
+    Uint32 bits;
+    SDL_memcpy(&bits, &value, sizeof(bits));
+    bits = SDL_Swap32BE(bits);
+
+    if (frame.depth == 0) {
+        OscPacket p;
+        SDL_memcpy(p.data, t.data[current], size);
+        SDL_memcpy(p.data + size - 4, &bits, 4);
+        p.size = (Uint16)size;
+        push(p);
+        return;
+    }
+
+    OscPacket& p = frame.packet;
+    if (p.size + 4 + size > OSC_MAX_PACKET) {
+        flush_frame();
+    }
+    if (p.size == 0) {
+        SDL_memcpy(p.data, bundle_header, OSC_BUNDLE_HEADER);
+        p.size = OSC_BUNDLE_HEADER;
+    }
+    Uint32 element_size = SDL_Swap32BE((Uint32)size);
+    SDL_memcpy(p.data + p.size, &element_size, 4);
+    SDL_memcpy(p.data + p.size + 4, t.data[current], size);
+    SDL_memcpy(p.data + p.size + size, &bits, 4);
+    p.size += (Uint16)(4 + size);
+    frame.messages++;
+}
+
+
+static void socket_worker() {
+    OscPacket packet;
+    while (running.load(std::memory_order_acquire)) {
+        SDL_WaitSemaphoreTimeout(wakeup, OSC_IDLE_MS);
+        while (queue.pop(packet)) {
+            sockaddr_in to;
+            SDL_zero(to);
+            to.sin_family = AF_INET;
+            to.sin_addr.s_addr = target_address.load(std::memory_order_relaxed);
+            to.sin_port = target_port.load(std::memory_order_relaxed);
+            if (sendto(sock, (const char*)packet.data, packet.size, 0, (const sockaddr*)&to, sizeof(to)) < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                sent.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+
+static bool set_target(const char* host, int port) {
+    sockaddr_in address;
+    if (!net_address(host, port, &address)) {
+        return false;
+    }
+    target_address.store(address.sin_addr.s_addr);
+    target_port.store(address.sin_port);
+    return true;
+}
+
+
+bool osc_start() {
+    if (!net_startup()) {
+        SDL_Log("Couldn't start networking");
+        return false;
+    }
+    sock = net_udp_socket(0);
+    if (sock == NET_NO_SOCKET) {
+        SDL_Log("Couldn't create the OSC socket");
+        net_cleanup();
+        return false;
+    }
+    wakeup = SDL_CreateSemaphore(0);
+    if (wakeup == NULL) {
+        SDL_Log("Couldn't create OSC semaphore: %s", SDL_GetError());
+        return false;
+    }
+    set_target(host_text, port_value);
+    running.store(true);
+    worker = std::thread(socket_worker);
+    return true;
+}
+
+
+void osc_stop() {
+    if (running.exchange(false)) {
+        SDL_SignalSemaphore(wakeup);
+        worker.join();
+    }
+    if (wakeup) {
+        SDL_DestroySemaphore(wakeup);
+        wakeup = NULL;
+    }
+    if (sock != NET_NO_SOCKET) {
+        net_close(sock);
+        sock = NET_NO_SOCKET;
+        net_cleanup();
+    }
+}
+
+
+void osc_frame_begin() {
+    frame.depth++;
+}
+
+
+void osc_frame_end() {
+    if (frame.depth > 0 && --frame.depth == 0) {
+        flush_frame();
+    }
+}
+
+
+void osc_button(int id, bool down) {
+    if (id >= 0 && id < MAPPING_MAX_IDS) {
+        send_message(buttons[id], down ? 1.0f : 0.0f);
+    }
+}
+
+
+void osc_axis(int axis, Sint16 value) {
+    if (axis >= 0 && axis < OSC_AXES) {
+        send_message(axes[axis], SDL_max(value / 32767.0f, -1.0f));
+    }
+}
+
+
+bool osc_set_target(const char* host, int port) {
+    if (!set_target(host, port)) {
+        return false;
+    }
+    SDL_strlcpy(host_text, host, sizeof(host_text));
+    port_value = port;
+    return true;
+}
+
+
+void osc_set_button_address(int id, const char* address) {
+    if (id >= 0 && id < MAPPING_MAX_IDS) {
+        SDL_strlcpy(buttons[id].text, address, sizeof(buttons[id].text));
+        set_address(buttons[id], buttons[id].text);
+    }
+}
+
+
+void osc_set_axis_address(int axis, const char* address) {
+    if (axis >= 0 && axis < OSC_AXES) {
+        SDL_strlcpy(axes[axis].text, address, sizeof(axes[axis].text));
+        set_address(axes[axis], axes[axis].text);
+    }
+}
+
+
+void osc_address_ui(int id) {
+    ImGui::PushID(id);
+    if (ImGui::InputText("##OSC", buttons[id].text, sizeof(buttons[id].text))) {
+        set_address(buttons[id], buttons[id].text);
+    }
+    ImGui::PopID();
+}
+
+
+void osc_swap_buttons() {
+    char text[OSC_MAX_ADDRESS];
+    for (int i = 0; i < MAPPING_MAX_BUTTONS; i++) {
+        SDL_strlcpy(text, buttons[i].text, sizeof(text));
+        SDL_strlcpy(buttons[i].text, other_text[i], sizeof(buttons[i].text));
+        SDL_strlcpy(other_text[i], text, sizeof(other_text[i]));
+        set_address(buttons[i], buttons[i].text);
+    }
+}
+
+
+void osc_ui(SDL_Joystick* joystick) {
+    ImGui::SeparatorText("OSC");
+    ImGui::PushID("OSC");
+    bool on = enabled.load();
+    if (ImGui::Checkbox("Enabled", &on)) {
+        enabled.store(on);
+    }
+    ImGui::SameLine();
+    ImGui::Text("sent %u dropped %u", sent.load(), dropped.load());
+    ImGui::InputText("Host", host_text, sizeof(host_text));
+    ImGui::InputInt("Port", &port_value);
+    if (ImGui::Button("Set")) {
+        if (!set_target(host_text, port_value)) {
+            SDL_Log("Invalid OSC destination %s:%d", host_text, port_value);
+        }
+    }
+
+    int axis_count = joystick ? SDL_min(SDL_GetNumJoystickAxes(joystick), OSC_AXES) : 0;
+    if (axis_count > 0 && ImGui::BeginTable("OSC Axes", 2)) {
+        ImGui::TableSetupColumn("Axis");
+        ImGui::TableSetupColumn("Address");
+        ImGui::TableHeadersRow();
+        for (int a = 0; a < axis_count; a++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", a);
+            ImGui::TableNextColumn();
+            ImGui::PushID(a);
+            if (ImGui::InputText("##Address", axes[a].text, sizeof(axes[a].text))) {
+                set_address(axes[a], axes[a].text);
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// OSC over UDP for lighting and media servers, next to MIDI. A button or axis
+// with an OSC address sends a message with one float: 1 or 0 for a button,
+// -1 to 1 for an axis. Messages are encoded when the address is set, and a
+// socket thread sends them, so sending never blocks.
+
+bool osc_start();
+void osc_stop();
+
+// Messages sent from the calling thread between these two go out as one
+// bundle. mapping_frame_begin/end() wrap one input event in them.
+void osc_frame_begin();
+void osc_frame_end();
+
+void osc_button(int id, bool down);
+void osc_axis(int axis, Sint16 value);
+
+// What the UI sets, for MidiBench. An empty address sends nothing.
+bool osc_set_target(const char* host, int port);
+void osc_set_button_address(int id, const char* address);
+void osc_set_axis_address(int axis, const char* address);
+
+// The address field of a button in the mapping table.
+void osc_address_ui(int id);
+// Switch to the button addresses of the other mapping mode, they are kept
+// apart like the mappings. See gamepad_set_mode().
+void osc_swap_buttons();
+// Destination, counters and the axis addresses.
+void osc_ui(SDL_Joystick* joystick);
@@ -0,0 +1,244 @@
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "imgui.h"
+
+#include "gamepad.h"
+#include "mapping.h"
+#include "profiles.h"
+
+#define PROFILE_KEYS 3 // serial, GUID, USB ids
+
+struct ControllerProfile {
+    std::string name;
+    std::string keys[PROFILE_KEYS];
+    bool gamepad = false;
+    JoystickStatus buttons[MAPPING_MAX_BUTTONS];
+};
+
+static std::vector<ControllerProfile> profiles;
+static std::unordered_map<std::string, int> profile_index;
+static bool dirty = false;
+
+
+// Most specific first. Keys have no spaces so they can go in the file as is.
+static void device_keys(SDL_Joystick* joystick, std::string keys[PROFILE_KEYS]) {
+    char buffer[160];
+    Uint16 vendor = SDL_GetJoystickVendor(joystick);
+    Uint16 product = SDL_GetJoystickProduct(joystick);
+    const char* serial = SDL_GetJoystickSerial(joystick);
+
+    keys[0].clear();
+    if (serial && *serial) {
+        SDL_snprintf(buffer, sizeof(buffer), "serial:%04x:%04x:%s", vendor, product, serial);
+        keys[0] = buffer;
+        for (size_t i = 0; i < keys[0].size(); i++) {
+            if (keys[0][i] == ' ') {
+                keys[0][i] = '_';
+            }
+        }
+    }
+    SDL_strlcpy(buffer, "guid:", sizeof(buffer));
+    SDL_GUIDToString(SDL_GetJoystickGUID(joystick), buffer + 5, 33);
+    keys[1] = buffer;
+    keys[2].clear();
+    if (vendor != 0 || product != 0) {
+        SDL_snprintf(buffer, sizeof(buffer), "usb:%04x:%04x", vendor, product);
+        keys[2] = buffer;
+    }
+}
+
+
+static int find_key(const std::string& key) {
+    if (key.empty()) {
+        return -1;
+    }
+    std::unordered_map<std::string, int>::const_iterator it = profile_index.find(key);
+    return it == profile_index.end() ? -1 : it->second;
+}
+
+
+static void index_profile(int profile) {
+    for (int k = 0; k < PROFILE_KEYS; k++) {
+        if (!profiles[profile].keys[k].empty()) {
+            profile_index[profiles[profile].keys[k]] = profile;
+        }
+    }
+}
+
+
+int profile_find(SDL_Joystick* joystick) {
+    std::string keys[PROFILE_KEYS];
+    device_keys(joystick, keys);
+    for (int k = 0; k < PROFILE_KEYS; k++) {
+        int profile = find_key(keys[k]);
+        if (profile >= 0) {
+            return profile;
+        }
+    }
+    return -1;
+}
+
+
+int profile_count() {
+    return (int)profiles.size();
+}
+
+
+bool profile_gamepad(int profile) {
+    return profiles[profile].gamepad;
+}
+
+
+void profile_apply(int profile) {
+    JoystickStatus conf[MAPPING_MAX_BUTTONS];
+    for (int i = 0; i < MAPPING_MAX_BUTTONS; i++) {
+        conf[i] = profiles[profile].buttons[i];
+    }
+    mapping_swap(conf);
+    dirty = false;
+}
+
+
+void profile_buttons(int profile, JoystickStatus* conf) {
+    for (int i = 0; i < MAPPING_MAX_BUTTONS; i++) {
+        conf[i] = profiles[profile].buttons[i];
+    }
+}
+
+
+void profile_clear() {
+    JoystickStatus conf[MAPPING_MAX_BUTTONS];
+    mapping_swap(conf);
+    dirty = false;
+}
+
+
+void profile_store(SDL_Joystick* joystick) {
+    std::string keys[PROFILE_KEYS];
+    device_keys(joystick, keys);
+
+    // Only a profile of this very device is overwritten. One found by USB ids
+    // belongs to another unit of the same model, and so does one found by
+    // GUID that has a serial, whether this device has none or another one.
+    int profile = find_key(keys[0]);
+    if (profile < 0) {
+        profile = find_key(keys[1]);
+    }
+    if (profile < 0 || profiles[profile].keys[0] != keys[0]) {
+        profile = (int)profiles.size();
+        profiles.push_back(ControllerProfile());
+    }
+
+    ControllerProfile& p = profiles[profile];
+    p.name = SDL_GetJoystickName(joystick) ? SDL_GetJoystickName(joystick) : "";
+    for (int k = 0; k < PROFILE_KEYS; k++) {
+        p.keys[k] = keys[k];
+    }
+    p.gamepad = gamepad_mode();
+    for (int i = 0; i < MAPPING_MAX_BUTTONS; i++) {
+        p.buttons[i] = joystick_conf[i];
+    }
+    index_profile(profile);
+    dirty = false;
+}
+
+
+void profile_mark_dirty() {
+    dirty = true;
+}
+
+
+void profile_store_dirty(SDL_Joystick* joystick) {
+    if (dirty) {
+        profile_store(joystick);
+    }
+}
+
+
+// One "profile" line with the mode and keys, "-" for a missing key, then one
+// line per mapped button, then the device name on the "end" line.
+bool profiles_save(const char* path) {
+    SDL_IOStream* io = SDL_IOFromFile(path, "w");
+    if (io == NULL) {
+        SDL_Log("Couldn't save profiles to %s: %s", path, SDL_GetError());
+        return false;
+    }
+    const JoystickStatus unmapped;
+    for (size_t i = 0; i < profiles.size(); i++) {
+        const ControllerProfile& p = profiles[i];
+        SDL_IOprintf(io, "profile %d", p.gamepad ? 1 : 0);
+        for (int k = 0; k < PROFILE_KEYS; k++) {
+            SDL_IOprintf(io, " %s", p.keys[k].empty() ? "-" : p.keys[k].c_str());
+        }
+        SDL_IOprintf(io, "\n");
+        for (int btn = 0; btn < MAPPING_MAX_BUTTONS; btn++) {
+            const JoystickStatus& b = p.buttons[btn];
+            if (b.func != unmapped.func || b.channel != unmapped.channel || b.value != unmapped.value) {
+                SDL_IOprintf(io, "%d %d %d %d\n", btn, (int)b.func, b.channel, b.value);
+            }
+        }
+        SDL_IOprintf(io, "end %s\n", p.name.c_str());
+    }
+    SDL_CloseIO(io);
+    return true;
+}
+
+
+bool profiles_load(const char* path) {
+    char* text = (char*)SDL_LoadFile(path, NULL);
+    if (text == NULL) {
+        return false;
+    }
+
+    ControllerProfile p;
+    bool open = false;
+    char* save = NULL;
+    for (char* line = SDL_strtok_r(text, "\r\n", &save); line; line = SDL_strtok_r(NULL, "\r\n", &save)) {
+        char keys[PROFILE_KEYS][160];
+        int gamepad;
+        int btn, func, channel, value;
+        if (SDL_sscanf(line, "profile %d %159s %159s %159s", &gamepad, keys[0], keys[1], keys[2]) == 4) {
+            p = ControllerProfile();
+            p.gamepad = gamepad != 0;
+            for (int k = 0; k < PROFILE_KEYS; k++) {
+                p.keys[k] = SDL_strcmp(keys[k], "-") == 0 ? "" : keys[k];
+            }
+            open = true;
+        }
+        else if (open && SDL_strncmp(line, "end", 3) == 0) {
+            p.name = line[3] == ' ' ? line + 4 : "";
+            profiles.push_back(p);
+            index_profile((int)profiles.size() - 1);
+            open = false;
+        }
+        else if (open && SDL_sscanf(line, "%d %d %d %d", &btn, &func, &channel, &value) == 4 &&
+                 btn >= 0 && btn < MAPPING_MAX_BUTTONS && func >= 0 && func < BUTTON_FUNCTION_COUNT) {
+            p.buttons[btn].func = (ButtonFunction)func;
+            p.buttons[btn].channel = SDL_clamp(channel, 0, 15);
+            p.buttons[btn].value = SDL_clamp(value, 0, 127);
+        }
+    }
+    SDL_free(text);
+    return true;
+}
+
+
+void profile_ui(SDL_Joystick* joystick) {
+    if (joystick == NULL) {
+        return;
+    }
+    int profile = profile_find(joystick);
+    if (ImGui::Button("Save Profile")) {
+        profile_store(joystick);
+    }
+    ImGui::SameLine();
+    if (profile >= 0) {
+        ImGui::Text("%s, %d profiles", profiles[profile].keys[0].empty() ? profiles[profile].keys[1].c_str() :
+            profiles[profile].keys[0].c_str(), (int)profiles.size());
+    }
+    else {
+        ImGui::Text("No profile, %d profiles", (int)profiles.size());
+    }
+}
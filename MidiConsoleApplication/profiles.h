@@ -0,0 +1,31 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Button mappings remembered per controller, found by serial number, then
+// GUID, then USB vendor and product, so the same model shares a mapping
+// unless one unit has its own.
+
+// Returns the profile of a device, or -1 if it has none.
+int profile_find(SDL_Joystick* joystick);
+int profile_count();
+// Whether the profile was made in gamepad mode, its buttons are semantic ids then.
+bool profile_gamepad(int profile);
+// Load a profile into joystick_conf.
+void profile_apply(int profile);
+// Copy the buttons of a profile, for a controller on a lane of its own.
+void profile_buttons(int profile, JoystickStatus* conf);
+// Clear joystick_conf for a device that has no profile yet.
+void profile_clear();
+// Save joystick_conf as the profile of a device.
+void profile_store(SDL_Joystick* joystick);
+
+// The mapping was edited since it was loaded, cleared or stored.
+void profile_mark_dirty();
+// profile_store() only if the mapping was edited, for unplug and quit.
+void profile_store_dirty(SDL_Joystick* joystick);
+
+bool profiles_load(const char* path);
+bool profiles_save(const char* path);
+
+void profile_ui(SDL_Joystick* joystick);
@@ -0,0 +1,705 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "imgui.h"
+
+#include "lockfree_queue.h"
+#include "midi_output.h"
+#include "net.h"
+#include "rtp_midi.h"
+
+#define RTP_SESSION_NAME "MidiConsoleApplication"
+#define RTP_QUEUE_SIZE 1024
+#define RTP_MAX_COMMANDS 1024 // bytes of MIDI in one packet
+#define RTP_MAX_PACKET 16384  // a journal of every channel still fits
+#define RTP_MAX_DATAGRAM 1472 // what a 1500 byte MTU leaves after the IP and UDP headers
+#define RTP_BATCH_NS SDL_NS_PER_MS // messages sent this close together share a packet
+#define RTP_PAYLOAD_TYPE 0x61
+#define RTP_TICKS_PER_SECOND 10000 // RTP and clock sync timestamps
+#define RTP_POLL_MS 10
+#define RTP_INVITE_INTERVAL_NS SDL_NS_PER_SECOND
+#define RTP_INVITE_TRIES 12
+#define RTP_SYNC_INTERVAL_NS (10 * SDL_NS_PER_SECOND)
+// A note-on recovered later than this isn't played any more.
+#define RTP_NOTE_FRESH_NS SDL_MS_TO_NS(100)
+#define APPLEMIDI_VERSION 2
+
+enum RtpState {
+    RTP_IDLE,
+    RTP_INVITING_CONTROL,
+    RTP_INVITING_DATA,
+    RTP_CONNECTED
+};
+
+static const char* state_names[] = { "Idle", "Inviting", "Inviting", "Connected" };
+
+enum RtpRequest {
+    RTP_REQUEST_NONE,
+    RTP_REQUEST_INVITE,
+    RTP_REQUEST_END
+};
+
+struct RtpEvent {
+    MidiMessage msg;
+    Uint64 sent = 0;
+};
+
+// What the recovery journal restores on one channel. Every value keeps the
+// sequence number of the packet that last changed it, 0 for none.
+struct ChannelState {
+    Uint32 changed = 0; // the latest of the ones below
+    Uint8 velocity[128] = {}; // 0 when the note is off
+    Uint32 note_seq[128] = {};
+    Uint64 note_time[128] = {};
+    Uint8 controller[128] = {};
+    Uint32 controller_seq[128] = {};
+    Uint8 program = 0;
+    Uint32 program_seq = 0;
+    Uint16 bend = 0;
+    Uint32 bend_seq = 0;
+    Uint8 pressure = 0;
+    Uint32 pressure_seq = 0;
+};
+
+static LockFreeQueue<RtpEvent, RTP_QUEUE_SIZE> queue;
+static SDL_Semaphore* wakeup = NULL;
+static std::thread worker;
+static std::atomic<bool> running(false);
+static std::atomic<int> source_output(0);
+static std::atomic<int> state(RTP_IDLE);
+static std::atomic<int> request(RTP_REQUEST_NONE);
+static std::atomic<bool> batching(false); // the first message of a batch woke the thread
+static std::atomic<Uint32> invite_address(0); // network byte order
+static std::atomic<Uint16> invite_port(0);
+static std::atomic<Uint32> packets_sent(0);
+static std::atomic<Uint32> journal_size(0); // of the last packet
+static std::atomic<Uint32> forced_checkpoints(0);
+static std::atomic<Uint32> latency_us(0);   // half the clock sync round trip
+static std::mutex name_mutex;
+static char peer_name[64] = "";
+
+// Only the session thread touches these.
+static bool networking = false;
+static NetSocket control_sock = NET_NO_SOCKET;
+static NetSocket data_sock = NET_NO_SOCKET;
+static sockaddr_in peer_control;
+static sockaddr_in peer_data;
+static Uint32 ssrc = 0;
+static Uint32 token = 0;
+static bool initiator = false;
+static Uint64 origin = 0;
+static Uint64 invite_time = 0;
+static int invite_tries = 0;
+static Uint64 sync_time = 0;
+static Uint32 seq = 0;        // of the last packet sent, extended past 16 bits
+static Uint32 checkpoint = 0; // the journal covers the packets after it
+static ChannelState channels[16];
+
+// UI only, local_port is set before the session thread starts.
+static int local_port = RTP_DEFAULT_PORT;
+static char host_text[64] = "127.0.0.1";
+static int port_value = RTP_DEFAULT_PORT;
+
+
+static void put16(unsigned char* p, Uint32 v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+
+static void put32(unsigned char* p, Uint32 v) {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+
+static void put64(unsigned char* p, Uint64 v) {
+    put32(p, (Uint32)(v >> 32));
+    put32(p + 4, (Uint32)v);
+}
+
+
+static Uint32 get32(const unsigned char* p) {
+    return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | p[3];
+}
+
+
+static Uint64 get64(const unsigned char* p) {
+    return ((Uint64)get32(p) << 32) | get32(p + 4);
+}
+
+
+static Uint64 ticks(Uint64 ns) {
+    return ns > origin ? (ns - origin) * RTP_TICKS_PER_SECOND / SDL_NS_PER_SECOND : 0;
+}
+
+
+static void send_to(NetSocket sock, const sockaddr_in& to, const unsigned char* data, int size) {
+    sendto(sock, (const char*)data, size, 0, (const sockaddr*)&to, sizeof(to));
+}
+
+
+// IN, OK, NO and BY share a layout, the name only goes in IN and OK.
+static void send_session_command(NetSocket sock, const sockaddr_in& to, const char* command, Uint32 command_token) {
+    unsigned char p[16 + sizeof(RTP_SESSION_NAME)];
+    p[0] = 0xFF;
+    p[1] = 0xFF;
+    p[2] = command[0];
+    p[3] = command[1];
+    put32(p + 4, APPLEMIDI_VERSION);
+    put32(p + 8, command_token);
+    put32(p + 12, ssrc);
+    int size = 16;
+    if (command[0] == 'I' || command[0] == 'O') {
+        SDL_memcpy(p + 16, RTP_SESSION_NAME, sizeof(RTP_SESSION_NAME));
+        size += sizeof(RTP_SESSION_NAME);
+    }
+    send_to(sock, to, p, size);
+}
+
+
+static void send_sync(int count, Uint64 ts1, Uint64 ts2, Uint64 ts3) {
+    unsigned char p[36] = { 0xFF, 0xFF, 'C', 'K' };
+    put32(p + 4, ssrc);
+    p[8] = (unsigned char)count;
+    put64(p + 12, ts1);
+    put64(p + 20, ts2);
+    put64(p + 28, ts3);
+    send_to(data_sock, peer_data, p, sizeof(p));
+}
+
+
+static void set_state(int s, const char* name) {
+    state.store(s);
+    std::lock_guard<std::mutex> lock(name_mutex);
+    SDL_strlcpy(peer_name, name, sizeof(peer_name));
+}
+
+
+static void start_session() {
+    for (int c = 0; c < 16; c++) {
+        channels[c] = ChannelState();
+    }
+    seq = (SDL_rand_bits() & 0xFFFF) + 1; // 0 is "never changed"
+    checkpoint = seq;
+    sync_time = 0;
+}
+
+
+static void invite(Uint64 now) {
+    SDL_zero(peer_control);
+    peer_control.sin_family = AF_INET;
+    peer_control.sin_addr.s_addr = invite_address.load();
+    peer_control.sin_port = invite_port.load();
+    peer_data = peer_control;
+    peer_data.sin_port = htons((Uint16)(ntohs(peer_control.sin_port) + 1));
+    token = SDL_rand_bits();
+    initiator = true;
+    invite_time = now;
+    invite_tries = 1;
+    set_state(RTP_INVITING_CONTROL, "");
+    send_session_command(control_sock, peer_control, "IN", token);
+}
+
+
+static void end_session() {
+    if (state.load() != RTP_IDLE) {
+        send_session_command(control_sock, peer_control, "BY", token);
+    }
+    set_state(RTP_IDLE, "");
+}
+
+
+// The peer has everything up to the sequence number it reports.
+static void receiver_feedback(Uint32 reported) {
+    Uint32 extended = (seq & ~0xFFFFu) | (reported & 0xFFFF);
+    if (extended > seq) {
+        extended -= 0x10000;
+    }
+    if ((Sint32)(extended - checkpoint) > 0) {
+        checkpoint = extended;
+    }
+}
+
+
+static void handle_command(bool data, const unsigned char* p, int size, const sockaddr_in& from, Uint64 now) {
+    NetSocket sock = data ? data_sock : control_sock;
+    char name[64] = "";
+    if (size > 16) {
+        SDL_strlcpy(name, (const char*)p + 16, sizeof(name)); // the caller ends p with a NUL
+    }
+
+    if (p[2] == 'I' && p[3] == 'N' && size >= 16) {
+        // Accept every invitation, the session goes to whoever asked last.
+        token = get32(p + 8);
+        send_session_command(sock, from, "OK", token);
+        if (data) {
+            peer_data = from;
+            start_session();
+            set_state(RTP_CONNECTED, name);
+        }
+        else {
+            peer_control = from;
+            initiator = false;
+            set_state(RTP_INVITING_DATA, name);
+        }
+    }
+    else if (p[2] == 'O' && p[3] == 'K' && size >= 16 && initiator && get32(p + 8) == token) {
+        if (!data && state.load() == RTP_INVITING_CONTROL) {
+            invite_time = now;
+            invite_tries = 1;
+            set_state(RTP_INVITING_DATA, name);
+            send_session_command(data_sock, peer_data, "IN", token);
+        }
+        else if (data && state.load() == RTP_INVITING_DATA) {
+            start_session();
+            set_state(RTP_CONNECTED, name);
+        }
+    }
+    else if (p[2] == 'N' && p[3] == 'O' && initiator && state.load() != RTP_CONNECTED) {
+        SDL_Log("RTP-MIDI invitation declined");
+        set_state(RTP_IDLE, "");
+    }
+    else if (p[2] == 'B' && p[3] == 'Y') {
+        set_state(RTP_IDLE, "");
+    }
+    else if (p[2] == 'C' && p[3] == 'K' && size >= 36 && state.load() == RTP_CONNECTED) {
+        int count = p[8];
+        Uint64 ts1 = get64(p + 12);
+        Uint64 ts2 = get64(p + 20);
+        Uint64 ts3 = ticks(now);
+        if (count == 0) {
+            send_sync(1, ts1, ts3, 0);
+        }
+        else if (count == 1) {
+            send_sync(2, ts1, ts2, ts3);
+            latency_us.store((Uint32)((ts3 - ts1) * 1000000 / RTP_TICKS_PER_SECOND / 2));
+        }
+    }
+    else if (p[2] == 'R' && p[3] == 'S' && size >= 10) {
+        receiver_feedback(((Uint32)p[8] << 8) | p[9]);
+    }
+}
+
+
+static void receive(bool data, Uint64 now) {
+    NetSocket sock = data ? data_sock : control_sock;
+    unsigned char p[513]; // room for a NUL after the name
+    sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    int size;
+    while ((size = (int)recvfrom(sock, (char*)p, sizeof(p) - 1, 0, (sockaddr*)&from, &from_size)) >= 4) {
+        p[size] = 0;
+        // RTP packets from the peer are MIDI for us, this is an output only.
+        if (p[0] == 0xFF && p[1] == 0xFF) {
+            handle_command(data, p, size, from, now);
+        }
+        from_size = sizeof(from);
+    }
+}
+
+
+static void record(const MidiMessage& msg, Uint32 packet) {
+    if (msg.long_data || msg.size == 0 || msg.bytes[0] >= 0xF0) {
+        return;
+    }
+    ChannelState& c = channels[msg.bytes[0] & 0x0F];
+    unsigned char d1 = msg.bytes[1] & 0x7F;
+    switch (msg.bytes[0] & 0xF0) {
+    case 0x80:
+    case 0x90:
+        c.velocity[d1] = (msg.bytes[0] & 0xF0) == 0x90 ? msg.bytes[2] : 0;
+        c.note_seq[d1] = packet;
+        c.note_time[d1] = msg.timestamp;
+        break;
+    case 0xB0:
+        c.controller[d1] = msg.bytes[2];
+        c.controller_seq[d1] = packet;
+        break;
+    case 0xC0:
+        c.program = d1;
+        c.program_seq = packet;
+        break;
+    case 0xD0:
+        c.pressure = d1;
+        c.pressure_seq = packet;
+        break;
+    case 0xE0:
+        c.bend = (Uint16)(d1 | (msg.bytes[2] << 7));
+        c.bend_seq = packet;
+        break;
+    default:
+        return; // poly pressure isn't journaled
+    }
+    c.changed = packet;
+}
+
+
+static bool after_checkpoint(Uint32 packet) {
+    return packet != 0 && (Sint32)(packet - checkpoint) > 0;
+}
+
+
+// One channel journal with chapters P, C, W, N and T. Returns its size.
+static int write_channel_journal(unsigned char* out, int channel, Uint64 now) {
+    const ChannelState& c = channels[channel];
+    int pos = 3;
+    unsigned char toc = 0;
+
+    if (after_checkpoint(c.program_seq)) {
+        out[pos++] = c.program; // no bank
+        out[pos++] = 0;
+        out[pos++] = 0;
+        toc |= 0x80;
+    }
+
+    int controllers = 0;
+    for (int n = 0; n < 128; n++) {
+        if (after_checkpoint(c.controller_seq[n]) && controllers < 128) {
+            out[pos + 1 + controllers * 2] = (unsigned char)n;
+            out[pos + 2 + controllers * 2] = c.controller[n];
+            controllers++;
+        }
+    }
+    if (controllers > 0) {
+        out[pos] = (unsigned char)(controllers - 1);
+        pos += 1 + controllers * 2;
+        toc |= 0x40;
+    }
+
+    if (after_checkpoint(c.bend_seq)) {
+        out[pos++] = c.bend & 0x7F;
+        out[pos++] = c.bend >> 7;
+        toc |= 0x10;
+    }
+
+    // Notes played since the checkpoint, then a bit for every note released.
+    int logs = 0;
+    int low = 16;
+    int high = -1;
+    for (int n = 0; n < 128; n++) {
+        if (!after_checkpoint(c.note_seq[n])) {
+            continue;
+        }
+        if (c.velocity[n] > 0 && logs < 127) {
+            bool fresh = now - c.note_time[n] < RTP_NOTE_FRESH_NS;
+            out[pos + 2 + logs * 2] = (unsigned char)n;
+            out[pos + 3 + logs * 2] = (unsigned char)((fresh ? 0x80 : 0) | c.velocity[n]);
+            logs++;
+        }
+        else if (c.velocity[n] == 0) {
+            low = SDL_min(low, n / 8);
+            high = n / 8;
+        }
+    }
+    if (logs > 0 || high >= 0) {
+        if (high < 0) {
+            low = 1; // LOW above HIGH, no off bits
+            high = 0;
+        }
+        out[pos] = (unsigned char)logs;
+        out[pos + 1] = (unsigned char)((low << 4) | high);
+        pos += 2 + logs * 2;
+        for (int octet = low; octet <= high; octet++) {
+            unsigned char bits = 0;
+            for (int n = octet * 8; n < octet * 8 + 8; n++) {
+                if (after_checkpoint(c.note_seq[n]) && c.velocity[n] == 0) {
+                    bits |= 0x80 >> (n % 8);
+                }
+            }
+            out[pos++] = bits;
+        }
+        toc |= 0x08;
+    }
+
+    if (after_checkpoint(c.pressure_seq)) {
+        out[pos++] = c.pressure;
+        toc |= 0x02;
+    }
+
+    out[0] = (unsigned char)((channel << 3) | ((pos >> 8) & 0x03));
+    out[1] = (unsigned char)pos;
+    out[2] = toc;
+    return pos;
+}
+
+
+// The recovery journal of what changed after the checkpoint, 0 bytes if
+// nothing did.
+static int write_journal(unsigned char* out, Uint64 now) {
+    int pos = 3;
+    int count = 0;
+    for (int ch = 0; ch < 16; ch++) {
+        if (after_checkpoint(channels[ch].changed)) {
+            pos += write_channel_journal(out + pos, ch, now);
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    out[0] = (unsigned char)(0x20 | (count - 1)); // channel journals, no system journal
+    put16(out + 1, checkpoint);
+    return pos;
+}
+
+
+static int write_delta(unsigned char* out, Uint32 delta) {
+    int size = 0;
+    for (int shift = 21; shift > 0; shift -= 7) {
+        if (delta >> shift || size > 0) {
+            out[size++] = (unsigned char)(0x80 | ((delta >> shift) & 0x7F));
+        }
+    }
+    out[size++] = (unsigned char)(delta & 0x7F);
+    return size;
+}
+
+
+// Send what the output sent since the last packet, as few packets as fit.
+static void send_midi(Uint64 now) {
+    static unsigned char packet[RTP_MAX_PACKET];
+    RtpEvent event;
+    bool pending = false;
+
+    for (;;) {
+        if (!pending && !queue.pop(event)) {
+            return;
+        }
+        pending = false;
+        if (state.load(std::memory_order_relaxed) != RTP_CONNECTED) {
+            midi_message_release(event.msg);
+            continue;
+        }
+
+        unsigned char commands[RTP_MAX_COMMANDS];
+        int size = 0;
+        Uint64 first = ticks(event.sent);
+        Uint64 previous = first;
+        RtpEvent batch[RTP_MAX_COMMANDS / 2];
+        int count = 0;
+        do {
+            const MidiMessage& msg = event.msg;
+            const unsigned char* bytes = msg.long_data ? msg.long_data : msg.bytes;
+            int length = msg.long_data ? (int)msg.long_size : msg.size;
+            Uint64 t = ticks(event.sent);
+            unsigned char delta[4];
+            int delta_size = count > 0 ? write_delta(delta, (Uint32)(t - SDL_min(t, previous))) : 0;
+            if (length == 0 || length + delta_size > RTP_MAX_COMMANDS) {
+                midi_message_release(msg);
+                continue; // a SysEx dump too big for any packet
+            }
+            if (size + delta_size + length > RTP_MAX_COMMANDS) {
+                pending = true; // starts the next packet
+                break;
+            }
+            SDL_memcpy(commands + size, delta, delta_size);
+            SDL_memcpy(commands + size + delta_size, bytes, length);
+            midi_message_release(msg); // copied, the payload may be reused
+            size += delta_size + length;
+            previous = SDL_max(previous, t);
+            batch[count++] = event;
+        } while (count < RTP_MAX_COMMANDS / 2 && queue.pop(event));
+        if (count == 0) {
+            continue;
+        }
+
+        seq++;
+        packet[0] = 0x80; // version 2
+        packet[1] = RTP_PAYLOAD_TYPE;
+        put16(packet + 2, seq);
+        put32(packet + 4, (Uint32)first);
+        put32(packet + 8, ssrc);
+        // The journal covers the packets before this one. If it doesn't fit
+        // the datagram, move the checkpoint up and give up recovering the
+        // oldest packets, down to no journal at all.
+        int header = size > 15 ? 2 : 1;
+        int room = RTP_MAX_DATAGRAM - 12 - header - size;
+        int journal = write_journal(packet + 12 + header + size, now);
+        if (journal > room) {
+            forced_checkpoints.fetch_add(1, std::memory_order_relaxed);
+        }
+        while (journal > room) {
+            checkpoint += (seq - checkpoint + 1) / 2;
+            journal = write_journal(packet + 12 + header + size, now);
+        }
+        unsigned char flags = journal > 0 ? 0x40 : 0;
+        if (header == 2) {
+            packet[12] = (unsigned char)(0x80 | flags | (size >> 8));
+            packet[13] = (unsigned char)size;
+        }
+        else {
+            packet[12] = (unsigned char)(flags | size);
+        }
+        SDL_memcpy(packet + 12 + header, commands, size);
+        send_to(data_sock, peer_data, packet, 12 + header + size + journal);
+
+        for (int i = 0; i < count; i++) {
+            record(batch[i].msg, seq);
+        }
+        packets_sent.fetch_add(1, std::memory_order_relaxed);
+        journal_size.store(journal, std::memory_order_relaxed);
+    }
+}
+
+
+static void session_worker() {
+    while (running.load(std::memory_order_acquire)) {
+        SDL_WaitSemaphoreTimeout(wakeup, RTP_POLL_MS);
+        if (batching.load(std::memory_order_acquire)) {
+            // Let the rest of the batch come in. A message after the flag is
+            // cleared starts the next one.
+            SDL_DelayPrecise(RTP_BATCH_NS);
+            batching.store(false, std::memory_order_release);
+        }
+        Uint64 now = SDL_GetTicksNS();
+
+        int r = request.exchange(RTP_REQUEST_NONE);
+        if (r == RTP_REQUEST_INVITE) {
+            end_session();
+            invite(now);
+        }
+        else if (r == RTP_REQUEST_END) {
+            end_session();
+        }
+        receive(false, now);
+        receive(true, now);
+
+        int s = state.load();
+        if ((s == RTP_INVITING_CONTROL || s == RTP_INVITING_DATA) && initiator && now - invite_time >= RTP_INVITE_INTERVAL_NS) {
+            if (invite_tries == RTP_INVITE_TRIES) {
+                SDL_Log("RTP-MIDI peer didn't answer");
+                set_state(RTP_IDLE, "");
+            }
+            else {
+                invite_time = now;
+                invite_tries++;
+                if (s == RTP_INVITING_CONTROL) {
+                    send_session_command(control_sock, peer_control, "IN", token);
+                }
+                else {
+                    send_session_command(data_sock, peer_data, "IN", token);
+                }
+            }
+        }
+        // The initiator keeps the clocks in sync.
+        if (s == RTP_CONNECTED && initiator && (sync_time == 0 || now - sync_time >= RTP_SYNC_INTERVAL_NS)) {
+            sync_time = now;
+            send_sync(0, ticks(now), 0, 0);
+        }
+        send_midi(now);
+    }
+    end_session();
+}
+
+
+static void rtp_tap(const MidiMessage& msg, Uint64 sent) {
+    if (msg.output != source_output.load(std::memory_order_relaxed) || state.load(std::memory_order_relaxed) != RTP_CONNECTED) {
+        return;
+    }
+    RtpEvent event;
+    event.msg = msg;
+    event.sent = sent;
+    midi_message_retain(msg);
+    if (queue.push(event)) {
+        if (!batching.exchange(true, std::memory_order_acq_rel)) {
+            SDL_SignalSemaphore(wakeup);
+        }
+    }
+    else {
+        midi_message_release(msg);
+    }
+}
+
+
+bool rtp_midi_init() {
+    return midi_output_add_tap(rtp_tap);
+}
+
+
+bool rtp_midi_start(int port) {
+    local_port = port;
+    networking = net_startup();
+    if (!networking) {
+        SDL_Log("Couldn't start networking");
+        return false;
+    }
+    control_sock = net_udp_socket((Uint16)local_port);
+    data_sock = net_udp_socket((Uint16)(local_port + 1));
+    wakeup = SDL_CreateSemaphore(0);
+    if (control_sock == NET_NO_SOCKET || data_sock == NET_NO_SOCKET || wakeup == NULL) {
+        SDL_Log("Couldn't open the RTP-MIDI ports %d and %d", local_port, local_port + 1);
+        rtp_midi_stop();
+        return false;
+    }
+    origin = SDL_GetTicksNS();
+    ssrc = SDL_rand_bits();
+    running.store(true);
+    worker = std::thread(session_worker);
+    return true;
+}
+
+
+void rtp_midi_stop() {
+    if (running.exchange(false)) {
+        SDL_SignalSemaphore(wakeup);
+        worker.join();
+    }
+    if (wakeup) {
+        SDL_DestroySemaphore(wakeup);
+        wakeup = NULL;
+    }
+    if (control_sock != NET_NO_SOCKET) {
+        net_close(control_sock);
+        control_sock = NET_NO_SOCKET;
+    }
+    if (data_sock != NET_NO_SOCKET) {
+        net_close(data_sock);
+        data_sock = NET_NO_SOCKET;
+    }
+    if (networking) {
+        net_cleanup();
+        networking = false;
+    }
+}
+
+
+void rtp_midi_ui() {
+    if (!running.load()) {
+        return;
+    }
+    ImGui::SeparatorText("RTP-MIDI");
+    ImGui::PushID("RTP");
+    {
+        std::lock_guard<std::mutex> lock(name_mutex);
+        ImGui::Text("Port %d: %s %s", local_port, state_names[state.load()], peer_name);
+    }
+    ImGui::Text("packets %u, journal %u bytes, latency %.1f ms", packets_sent.load(), journal_size.load(), latency_us.load() / 1000.0f);
+    ImGui::Text("forced checkpoints %u", forced_checkpoints.load());
+
+    int output = source_output.load() + 1;
+    if (ImGui::SliderInt("Output", &output, 1, MIDI_OUTPUTS)) {
+        source_output.store(output - 1);
+    }
+    ImGui::InputText("Peer", host_text, sizeof(host_text));
+    ImGui::InputInt("Peer Port", &port_value);
+    if (ImGui::Button("Invite")) {
+        sockaddr_in address;
+        if (net_address(host_text, port_value, &address)) {
+            invite_address.store(address.sin_addr.s_addr);
+            invite_port.store(address.sin_port);
+            request.store(RTP_REQUEST_INVITE);
+            SDL_SignalSemaphore(wakeup);
+        }
+        else {
+            SDL_Log("Invalid RTP-MIDI peer %s:%d", host_text, port_value);
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("End")) {
+        request.store(RTP_REQUEST_END);
+        SDL_SignalSemaphore(wakeup);
+    }
+    ImGui::PopID();
+}
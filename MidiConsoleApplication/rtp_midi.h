@@ -0,0 +1,20 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// RTP-MIDI (RFC 6295) session with the AppleMIDI session protocol, so DAWs on
+// the LAN receive what an output sends. The session thread invites a peer or
+// accepts its invitation and keeps the clocks in sync. The messages an output
+// sends within a short window go in one RTP packet, with a recovery journal
+// of the state since the last packet the peer reported, in one Ethernet frame.
+
+// Register the output tap. Must be called before midi_output_start().
+bool rtp_midi_init();
+
+#define RTP_DEFAULT_PORT 5004 // control port, the data port is the next one
+
+// Bind the control port and the data port after it, start the session thread.
+bool rtp_midi_start(int port = RTP_DEFAULT_PORT);
+void rtp_midi_stop();
+
+void rtp_midi_ui();
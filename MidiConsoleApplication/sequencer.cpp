@@ -0,0 +1,294 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "mapping.h"
+#include "midi_output.h"
+#include "sequencer.h"
+#include "timing.h"
+
+struct SeqTrack {
+    std::atomic<int> func;    // ButtonFunction, NOTE or CC
+    std::atomic<int> channel; // 0 to 15
+    std::atomic<int> value;   // note or controller number
+};
+
+// Steps are one bit each so the UI, the joystick and the timing thread can
+// all edit or switch patterns with single atomic operations, no locks.
+struct SeqPattern {
+    std::atomic<Uint64> steps[SEQ_TRACKS];
+    std::atomic<Uint8> values[SEQ_TRACKS][SEQ_MAX_STEPS]; // velocity or CC value
+    std::atomic<int> length; // 16, 32 or 64
+};
+
+static SeqTrack tracks[SEQ_TRACKS];
+static SeqPattern patterns[SEQ_PATTERNS];
+
+static std::atomic<bool> playing(false);
+static std::atomic<int> bpm(120);
+static std::atomic<int> active_pattern(0);
+static std::atomic<int> edit_track(0);
+static std::atomic<int> edit_step(0);
+static std::atomic<int> value_axis(-1);
+static std::atomic<int> current_step(-1);
+
+// Only touched by the timing thread.
+static Uint64 next_step_time = 0;
+static Uint64 gate_off_time = 0;
+static int step_index = 0;
+static Uint32 notes_on = 0; // one bit per track waiting for its note-off
+static unsigned char off_status[SEQ_TRACKS];
+static unsigned char off_note[SEQ_TRACKS];
+
+static const int step_lengths[] = { 16, 32, 64 };
+
+
+static void send_note_offs() {
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+        if (notes_on & (1u << t)) {
+            midi_output_send(off_status[t], off_note[t], 0);
+        }
+    }
+    notes_on = 0;
+}
+
+
+static void play_step(int step) {
+    const SeqPattern& pattern = patterns[active_pattern.load(std::memory_order_relaxed)];
+
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+        if ((pattern.steps[t].load(std::memory_order_relaxed) & (1ull << step)) == 0) {
+            continue;
+        }
+        ButtonFunction func = (ButtonFunction)tracks[t].func.load(std::memory_order_relaxed);
+        unsigned char channel = (unsigned char)tracks[t].channel.load(std::memory_order_relaxed);
+        unsigned char value = (unsigned char)tracks[t].value.load(std::memory_order_relaxed);
+        unsigned char amount = pattern.values[t][step].load(std::memory_order_relaxed);
+
+        if (func == ButtonFunction::NOTE) {
+            if (amount == 0) {
+                amount = 1; // velocity 0 would be a note-off
+            }
+            midi_output_send(button_function_val(func, false) + channel, value, amount);
+            off_status[t] = button_function_val(func, true) + channel;
+            off_note[t] = value;
+            notes_on |= 1u << t;
+        }
+        else {
+            midi_output_send(button_function_val(func, false) + channel, value, amount);
+        }
+    }
+}
+
+
+static Uint64 sequencer_tick(Uint64 now, void* userdata) {
+    if (!playing.load(std::memory_order_acquire)) {
+        if (notes_on) {
+            send_note_offs();
+        }
+        next_step_time = 0;
+        current_step.store(-1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    if (next_step_time == 0) {
+        next_step_time = now;
+        step_index = 0;
+    }
+    // Stamped with the time they were due rather than when the thread woke up,
+    // so fixed latency and kernel timed outputs take the wake-up jitter out.
+    if (notes_on && now >= gate_off_time) {
+        midi_output_stamp(gate_off_time);
+        send_note_offs();
+    }
+    if (now >= next_step_time) {
+        int length = patterns[active_pattern.load(std::memory_order_relaxed)].length.load(std::memory_order_relaxed);
+        if (step_index >= length) {
+            step_index = 0;
+        }
+        midi_output_stamp(next_step_time);
+        play_step(step_index);
+        current_step.store(step_index, std::memory_order_relaxed);
+        step_index++;
+
+        // Sixteenth notes, the gate is half a step long.
+        Uint64 step_ns = SDL_NS_PER_SECOND * 60 / (bpm.load(std::memory_order_relaxed) * 4);
+        gate_off_time = next_step_time + step_ns / 2;
+        next_step_time += step_ns;
+        if (next_step_time < now) {
+            // We fell behind (debugger, suspended machine), don't play a burst of steps.
+            next_step_time = now + step_ns;
+        }
+    }
+    midi_output_stamp(0);
+
+    if (notes_on && gate_off_time < next_step_time) {
+        return gate_off_time;
+    }
+    return next_step_time;
+}
+
+
+bool sequencer_init() {
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+        tracks[t].func.store(ButtonFunction::NOTE);
+        tracks[t].channel.store(9);
+        tracks[t].value.store(36 + t);
+    }
+    for (int p = 0; p < SEQ_PATTERNS; p++) {
+        patterns[p].length.store(16);
+        for (int t = 0; t < SEQ_TRACKS; t++) {
+            for (int s = 0; s < SEQ_MAX_STEPS; s++) {
+                patterns[p].values[t][s].store(100);
+            }
+        }
+    }
+    return timing_add(sequencer_tick, NULL);
+}
+
+
+void sequencer_play() {
+    playing.store(true, std::memory_order_release);
+    timing_wake();
+}
+
+
+void sequencer_stop() {
+    playing.store(false, std::memory_order_release);
+    timing_wake();
+}
+
+
+void sequencer_toggle_step(int step) {
+    if (step < 0 || step >= SEQ_MAX_STEPS) {
+        return;
+    }
+    SeqPattern& pattern = patterns[active_pattern.load(std::memory_order_relaxed)];
+    pattern.steps[edit_track.load(std::memory_order_relaxed)].fetch_xor(1ull << step, std::memory_order_relaxed);
+    edit_step.store(step, std::memory_order_relaxed);
+}
+
+
+void sequencer_axis(int axis, Sint16 value) {
+    if (axis != value_axis.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Uint8 amount = (Uint8)((value + 32768) >> 9); // 0 to 127
+    SeqPattern& pattern = patterns[active_pattern.load(std::memory_order_relaxed)];
+    pattern.values[edit_track.load(std::memory_order_relaxed)][edit_step.load(std::memory_order_relaxed)].store(amount, std::memory_order_relaxed);
+}
+
+
+void sequencer_ui() {
+    ImGui::SeparatorText("Sequencer");
+
+    if (playing.load()) {
+        if (ImGui::Button("Stop")) {
+            sequencer_stop();
+        }
+    }
+    else if (ImGui::Button("Play")) {
+        sequencer_play();
+    }
+    ImGui::SameLine();
+    int tempo = bpm.load();
+    if (ImGui::SliderInt("BPM", &tempo, 40, 240)) {
+        bpm.store(tempo);
+    }
+
+    int pattern_id = active_pattern.load() + 1;
+    if (ImGui::SliderInt("Pattern", &pattern_id, 1, SEQ_PATTERNS)) {
+        active_pattern.store(pattern_id - 1);
+    }
+    SeqPattern& pattern = patterns[pattern_id - 1];
+
+    int length = pattern.length.load();
+    char length_str[8];
+    SDL_snprintf(length_str, sizeof(length_str), "%d", length);
+    if (ImGui::BeginCombo("Steps", length_str, ImGuiComboFlags_None)) {
+        for (unsigned int i = 0; i < SDL_arraysize(step_lengths); i++) {
+            const bool is_selected = (length == step_lengths[i]);
+            SDL_snprintf(length_str, sizeof(length_str), "%d", step_lengths[i]);
+            if (ImGui::Selectable(length_str, is_selected)) {
+                pattern.length.store(step_lengths[i]);
+            }
+            if (is_selected)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+
+    int axis = value_axis.load();
+    if (ImGui::SliderInt("Value Axis", &axis, -1, 15)) {
+        value_axis.store(axis);
+    }
+
+    if (ImGui::BeginTable("Tracks", 4)) {
+        ImGui::TableSetupColumn("Trk");
+        ImGui::TableSetupColumn("Func");
+        ImGui::TableSetupColumn("Chnl");
+        ImGui::TableSetupColumn("Val");
+        ImGui::TableHeadersRow();
+        for (int t = 0; t < SEQ_TRACKS; t++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::PushID(t);
+            char track_str[8];
+            SDL_snprintf(track_str, sizeof(track_str), "%d", t + 1);
+            if (ImGui::Selectable(track_str, edit_track.load() == t)) {
+                edit_track.store(t);
+            }
+            ImGui::TableNextColumn();
+            ButtonFunction func = (ButtonFunction)tracks[t].func.load();
+            if (ImGui::BeginCombo("##Func", button_function_str(func), ImGuiComboFlags_None)) {
+                // Only NOTE and CC make sense for a track.
+                for (unsigned int i = 0; i < ButtonFunction::STEP; i++) {
+                    const bool is_selected = (func == i);
+                    if (ImGui::Selectable(button_function_str((ButtonFunction)i), is_selected)) {
+                        tracks[t].func.store(i);
+                    }
+                    if (is_selected)
+                        ImGui::SetItemDefaultFocus();
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::TableNextColumn();
+            int channel = tracks[t].channel.load() + 1;
+            if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
+                tracks[t].channel.store(channel - 1);
+            }
+            ImGui::TableNextColumn();
+            int value = tracks[t].value.load();
+            if (ImGui::SliderInt("##Val", &value, 0, 127)) {
+                tracks[t].value.store(value);
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    // Step grid of the edit track, 16 steps per row.
+    int track = edit_track.load();
+    int playing_step = current_step.load();
+    Uint64 steps = pattern.steps[track].load();
+    for (int s = 0; s < length; s++) {
+        if (s % 16 != 0) {
+            ImGui::SameLine();
+        }
+        ImGui::PushID(s);
+        bool on = (steps & (1ull << s)) != 0;
+        if (ImGui::Checkbox(s == playing_step ? ">" : "##step", &on)) {
+            pattern.steps[track].fetch_xor(1ull << s);
+            edit_step.store(s);
+        }
+        ImGui::PopID();
+    }
+
+    int step = edit_step.load();
+    int amount = pattern.values[track][step].load();
+    char label[32];
+    SDL_snprintf(label, sizeof(label), "Step %d Value", step + 1);
+    if (ImGui::SliderInt(label, &amount, 0, 127)) {
+        pattern.values[track][step].store((Uint8)amount);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define SEQ_MAX_STEPS 64
+#define SEQ_TRACKS 8
+#define SEQ_PATTERNS 8
+
+// Registers the sequencer on the timing thread. Call before timing_start().
+bool sequencer_init();
+
+void sequencer_play();
+void sequencer_stop();
+
+// Edits go to the step of the edit track in the active pattern.
+// Both are safe to call while the sequencer is playing.
+void sequencer_toggle_step(int step);
+void sequencer_axis(int axis, Sint16 value);
+
+void sequencer_ui();
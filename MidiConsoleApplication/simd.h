@@ -0,0 +1,100 @@
+#pragma once
+
+// The few float vector operations the batch kernels need, on the widest
+// instruction set the compiler targets. Kernels are written once against
+// these, the scalar fallback is the same code one lane at a time.
+
+#include <stdint.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_LANES 8
+typedef __m256 VecF;
+typedef __m256 VecMask;
+
+static inline VecF vec_load(const float* p) { return _mm256_load_ps(p); }
+static inline void vec_store(float* p, VecF a) { _mm256_store_ps(p, a); }
+static inline VecF vec_set(float a) { return _mm256_set1_ps(a); }
+static inline VecF vec_add(VecF a, VecF b) { return _mm256_add_ps(a, b); }
+static inline VecF vec_sub(VecF a, VecF b) { return _mm256_sub_ps(a, b); }
+static inline VecF vec_mul(VecF a, VecF b) { return _mm256_mul_ps(a, b); }
+static inline VecF vec_div(VecF a, VecF b) { return _mm256_div_ps(a, b); }
+static inline VecF vec_min(VecF a, VecF b) { return _mm256_min_ps(a, b); }
+static inline VecF vec_max(VecF a, VecF b) { return _mm256_max_ps(a, b); }
+static inline VecF vec_abs(VecF a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline VecF vec_round(VecF a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+static inline VecMask vec_lt(VecF a, VecF b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline VecMask vec_neq(VecF a, VecF b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+static inline VecF vec_select(VecMask m, VecF a, VecF b) { return _mm256_blendv_ps(b, a, m); }
+static inline uint32_t vec_bits(VecMask m) { return (uint32_t)_mm256_movemask_ps(m); }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_LANES 4
+typedef __m128 VecF;
+typedef __m128 VecMask;
+
+static inline VecF vec_load(const float* p) { return _mm_load_ps(p); }
+static inline void vec_store(float* p, VecF a) { _mm_store_ps(p, a); }
+static inline VecF vec_set(float a) { return _mm_set1_ps(a); }
+static inline VecF vec_add(VecF a, VecF b) { return _mm_add_ps(a, b); }
+static inline VecF vec_sub(VecF a, VecF b) { return _mm_sub_ps(a, b); }
+static inline VecF vec_mul(VecF a, VecF b) { return _mm_mul_ps(a, b); }
+static inline VecF vec_div(VecF a, VecF b) { return _mm_div_ps(a, b); }
+static inline VecF vec_min(VecF a, VecF b) { return _mm_min_ps(a, b); }
+static inline VecF vec_max(VecF a, VecF b) { return _mm_max_ps(a, b); }
+static inline VecF vec_abs(VecF a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// Rounds to nearest with the default MXCSR, fine for the +-32768 range used here.
+static inline VecF vec_round(VecF a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+static inline VecMask vec_lt(VecF a, VecF b) { return _mm_cmplt_ps(a, b); }
+static inline VecMask vec_neq(VecF a, VecF b) { return _mm_cmpneq_ps(a, b); }
+static inline VecF vec_select(VecMask m, VecF a, VecF b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline uint32_t vec_bits(VecMask m) { return (uint32_t)_mm_movemask_ps(m); }
+
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SIMD_LANES 4
+typedef float32x4_t VecF;
+typedef uint32x4_t VecMask;
+
+static inline VecF vec_load(const float* p) { return vld1q_f32(p); }
+static inline void vec_store(float* p, VecF a) { vst1q_f32(p, a); }
+static inline VecF vec_set(float a) { return vdupq_n_f32(a); }
+static inline VecF vec_add(VecF a, VecF b) { return vaddq_f32(a, b); }
+static inline VecF vec_sub(VecF a, VecF b) { return vsubq_f32(a, b); }
+static inline VecF vec_mul(VecF a, VecF b) { return vmulq_f32(a, b); }
+static inline VecF vec_div(VecF a, VecF b) { return vdivq_f32(a, b); }
+static inline VecF vec_min(VecF a, VecF b) { return vminq_f32(a, b); }
+static inline VecF vec_max(VecF a, VecF b) { return vmaxq_f32(a, b); }
+static inline VecF vec_abs(VecF a) { return vabsq_f32(a); }
+static inline VecF vec_round(VecF a) { return vrndnq_f32(a); }
+static inline VecMask vec_lt(VecF a, VecF b) { return vcltq_f32(a, b); }
+static inline VecMask vec_neq(VecF a, VecF b) { return vmvnq_u32(vceqq_f32(a, b)); }
+static inline VecF vec_select(VecMask m, VecF a, VecF b) { return vbslq_f32(m, a, b); }
+static inline uint32_t vec_bits(VecMask m) {
+    const uint32_t weights[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+}
+
+#else
+#include <math.h>
+#define SIMD_LANES 1
+typedef float VecF;
+typedef bool VecMask;
+
+static inline VecF vec_load(const float* p) { return *p; }
+static inline void vec_store(float* p, VecF a) { *p = a; }
+static inline VecF vec_set(float a) { return a; }
+static inline VecF vec_add(VecF a, VecF b) { return a + b; }
+static inline VecF vec_sub(VecF a, VecF b) { return a - b; }
+static inline VecF vec_mul(VecF a, VecF b) { return a * b; }
+static inline VecF vec_div(VecF a, VecF b) { return a / b; }
+static inline VecF vec_min(VecF a, VecF b) { return a < b ? a : b; }
+static inline VecF vec_max(VecF a, VecF b) { return a > b ? a : b; }
+static inline VecF vec_abs(VecF a) { return fabsf(a); }
+static inline VecF vec_round(VecF a) { return nearbyintf(a); }
+static inline VecMask vec_lt(VecF a, VecF b) { return a < b; }
+static inline VecMask vec_neq(VecF a, VecF b) { return a != b; }
+static inline VecF vec_select(VecMask m, VecF a, VecF b) { return m ? a : b; }
+static inline uint32_t vec_bits(VecMask m) { return m ? 1 : 0; }
+#endif
@@ -0,0 +1,496 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+
+#include "imgui.h"
+
+#include "midi_output.h"
+#include "smf_player.h"
+#include "timing.h"
+
+#define SMF_MAX_TRACKS 64
+#define SMF_DEFAULT_TEMPO 500000 // us per quarter note, 120 BPM
+#define SMF_SYSEX_BUFFERS 8
+#define SMF_SYSEX_SIZE 4096
+
+enum PlayerState {
+    PLAYER_STOPPED,
+    PLAYER_PLAYING,
+    PLAYER_STOPPING
+};
+
+struct MappedFile {
+    const Uint8* data = NULL;
+    size_t size = 0;
+};
+
+// A SysEx copied out of the file, F0 and all. refs counts the player while it
+// fills the buffer and every message still pointing at it.
+struct SysexBuffer {
+    unsigned char data[SMF_SYSEX_SIZE];
+    std::atomic<int> refs{ 0 };
+};
+
+// Decodes one track in place, straight from the mapped file.
+struct SmfCursor {
+    const Uint8* start = NULL;
+    const Uint8* end = NULL;
+    const Uint8* pos = NULL; // next event, after its delta time
+    Uint64 tick = 0;         // absolute tick of the next event
+    Uint8 running_status = 0;
+    bool done = true;
+    SysexBuffer* sysex = NULL; // a SysEx split into F7 packets, until its F7
+    Uint32 sysex_size = 0;
+};
+
+static MappedFile file;
+static int format = 0;
+static int division = 0;
+static int track_count = 0;
+static SmfCursor cursors[SMF_MAX_TRACKS];
+
+static std::atomic<int> state(PLAYER_STOPPED);
+static std::atomic<Uint32> sysex_skipped(0);
+static SysexBuffer sysex_buffers[SMF_SYSEX_BUFFERS];
+
+// Only touched by the timing thread while playing.
+static Uint64 start_time = 0;
+static Uint64 tempo_tick = 0;
+static Uint64 tempo_ns = 0;
+static Uint32 tempo = SMF_DEFAULT_TEMPO;
+
+
+static bool map_file(const char* path, MappedFile& mapped) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (mapping == NULL) {
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL) {
+        return false;
+    }
+    mapped.size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    mapped.size = (size_t)st.st_size;
+#endif
+    mapped.data = (const Uint8*)data;
+    return true;
+}
+
+
+static void unmap_file(MappedFile& mapped) {
+    if (mapped.data == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapped.data);
+#else
+    munmap((void*)mapped.data, mapped.size);
+#endif
+    mapped.data = NULL;
+    mapped.size = 0;
+}
+
+
+static Uint32 read_be(const Uint8* p, int size) {
+    Uint32 value = 0;
+    for (int i = 0; i < size; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+
+static bool read_varlen(SmfCursor& c, Uint32& value) {
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        if (c.pos >= c.end) {
+            return false;
+        }
+        Uint8 byte = *c.pos++;
+        value = (value << 7) | (byte & 0x7F);
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Read the delta time of the next event, or mark the track done.
+static void cursor_advance(SmfCursor& c) {
+    Uint32 delta;
+    if (c.pos >= c.end || !read_varlen(c, delta)) {
+        c.done = true;
+        return;
+    }
+    c.tick += delta;
+}
+
+
+static void drop_sysex(SmfCursor& c) {
+    if (c.sysex) {
+        c.sysex->refs.fetch_sub(1, std::memory_order_release);
+        c.sysex = NULL;
+        sysex_skipped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+static void cursor_rewind(SmfCursor& c) {
+    drop_sysex(c);
+    c.pos = c.start;
+    c.tick = 0;
+    c.running_status = 0;
+    c.done = false;
+    cursor_advance(c);
+}
+
+
+static Uint64 tick_to_ns(Uint64 tick) {
+    Uint64 ticks = tick - tempo_tick;
+    if (division & 0x8000) {
+        // SMPTE: frames per second in the high byte, ticks per frame in the low byte.
+        Uint64 ticks_per_second = (Uint64)(256 - (division >> 8)) * (division & 0xFF);
+        return tempo_ns + ticks * SDL_NS_PER_SECOND / ticks_per_second;
+    }
+    return tempo_ns + ticks * tempo * SDL_NS_PER_US / division;
+}
+
+
+// Only the timing thread claims buffers, the output workers only release them.
+static SysexBuffer* claim_sysex_buffer() {
+    for (int i = 0; i < SMF_SYSEX_BUFFERS; i++) {
+        int expected = 0;
+        if (sysex_buffers[i].refs.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+            return &sysex_buffers[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void send_sysex(SmfCursor& c, Uint64 time) {
+    midi_output_stamp(time);
+    if (!midi_output_send_long(c.sysex->data, c.sysex_size, 0, &c.sysex->refs)) {
+        sysex_skipped.fetch_add(1, std::memory_order_relaxed);
+    }
+    midi_output_stamp(0);
+    c.sysex->refs.fetch_sub(1, std::memory_order_release); // the player is done with it
+    c.sysex = NULL;
+}
+
+
+// An F0 event starts a SysEx, F7 events continue it until one ends with F7,
+// then it goes out. An F7 event on its own escapes bytes to send as they are:
+// a whole SysEx or a short message. SysEx too big for a buffer, or sent while
+// every buffer is still in flight, is skipped.
+static void play_sysex(SmfCursor& c, Uint8 status, const Uint8* data, Uint32 length, Uint64 time) {
+    if (status == 0xF7 && c.sysex == NULL) {
+        if (length > 0 && length <= 3 && data[0] >= 0x80 && data[0] != 0xF0) {
+            MidiMessage msg;
+            msg.timestamp = time;
+            SDL_memcpy(msg.bytes, data, length);
+            msg.size = (unsigned char)length;
+            midi_output_send(msg);
+            return;
+        }
+        if (length < 2 || data[0] != 0xF0 || data[length - 1] != 0xF7) {
+            return;
+        }
+    }
+    if (status == 0xF0) {
+        drop_sysex(c); // never finished
+        c.sysex = claim_sysex_buffer();
+        if (c.sysex == NULL) {
+            sysex_skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        c.sysex->data[0] = 0xF0;
+        c.sysex_size = 1;
+    }
+    else if (c.sysex == NULL) {
+        c.sysex = claim_sysex_buffer(); // an escaped SysEx, F0 included
+        if (c.sysex == NULL) {
+            sysex_skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        c.sysex_size = 0;
+    }
+    if (length > SMF_SYSEX_SIZE - c.sysex_size) {
+        drop_sysex(c);
+        return;
+    }
+    SDL_memcpy(c.sysex->data + c.sysex_size, data, length);
+    c.sysex_size += length;
+    if (length > 0 && data[length - 1] == 0xF7) {
+        send_sysex(c, time);
+    }
+}
+
+
+// Decode the event at the cursor, send it if it is a message and move on.
+static void cursor_play(SmfCursor& c, Uint64 time) {
+    if (c.pos >= c.end) {
+        c.done = true;
+        return;
+    }
+
+    Uint8 status = *c.pos;
+    if (status & 0x80) {
+        c.pos++;
+    }
+    else if (c.running_status != 0) {
+        status = c.running_status;
+    }
+    else {
+        c.done = true; // data byte without a status, corrupt track
+        return;
+    }
+
+    if (status < 0xF0) {
+        c.running_status = status;
+        int size = ((status & 0xE0) == 0xC0) ? 1 : 2; // program change and channel pressure
+        if (c.end - c.pos < size) {
+            c.done = true;
+            return;
+        }
+        MidiMessage msg;
+        msg.timestamp = time;
+        msg.bytes[0] = status;
+        msg.bytes[1] = c.pos[0];
+        msg.bytes[2] = size == 2 ? c.pos[1] : 0;
+        msg.size = 1 + size;
+        c.pos += size;
+        midi_output_send(msg);
+    }
+    else if (status == 0xF0 || status == 0xF7) {
+        // SysEx and meta events cancel running status.
+        c.running_status = 0;
+        Uint32 length;
+        if (!read_varlen(c, length) || (Uint32)(c.end - c.pos) < length) {
+            c.done = true;
+            return;
+        }
+        play_sysex(c, status, c.pos, length, time);
+        c.pos += length;
+    }
+    else if (status == 0xFF) {
+        c.running_status = 0;
+        Uint32 length;
+        if (c.pos >= c.end) {
+            c.done = true;
+            return;
+        }
+        Uint8 type = *c.pos++;
+        if (!read_varlen(c, length) || (Uint32)(c.end - c.pos) < length) {
+            c.done = true;
+            return;
+        }
+        if (type == 0x2F) {
+            c.done = true; // end of track
+            return;
+        }
+        if (type == 0x51 && length == 3) {
+            tempo_ns = tick_to_ns(c.tick);
+            tempo_tick = c.tick;
+            tempo = read_be(c.pos, 3);
+        }
+        c.pos += length;
+    }
+    else {
+        c.done = true;
+        return;
+    }
+    cursor_advance(c);
+}
+
+
+static void all_notes_off() {
+    for (unsigned char channel = 0; channel < 16; channel++) {
+        midi_output_send(0xB0 + channel, 123, 0);
+    }
+}
+
+
+static Uint64 smf_player_tick(Uint64 now, void* userdata) {
+    int s = state.load(std::memory_order_acquire);
+    if (s == PLAYER_STOPPING) {
+        for (int i = 0; i < track_count; i++) {
+            drop_sysex(cursors[i]);
+        }
+        all_notes_off();
+        state.store(PLAYER_STOPPED, std::memory_order_release);
+        return 0;
+    }
+    if (s != PLAYER_PLAYING) {
+        return 0;
+    }
+
+    for (;;) {
+        // Merge the tracks: the earliest pending event across all of them is next.
+        SmfCursor* next = NULL;
+        for (int i = 0; i < track_count; i++) {
+            if (!cursors[i].done && (next == NULL || cursors[i].tick < next->tick)) {
+                next = &cursors[i];
+            }
+        }
+        if (next == NULL) {
+            for (int i = 0; i < track_count; i++) {
+                drop_sysex(cursors[i]);
+            }
+            state.store(PLAYER_STOPPED, std::memory_order_release);
+            return 0;
+        }
+
+        Uint64 time = start_time + tick_to_ns(next->tick);
+        if (time > now) {
+            return time;
+        }
+        cursor_play(*next, time);
+    }
+}
+
+
+bool smf_player_init() {
+    return timing_add(smf_player_tick, NULL);
+}
+
+
+bool smf_player_load(const char* path) {
+    if (state.load() != PLAYER_STOPPED) {
+        return false;
+    }
+    unmap_file(file);
+    track_count = 0;
+
+    if (!map_file(path, file)) {
+        SDL_Log("Couldn't open MIDI file %s", path);
+        return false;
+    }
+    if (file.size < 14 || SDL_memcmp(file.data, "MThd", 4) != 0 || read_be(file.data + 4, 4) < 6) {
+        SDL_Log("%s is not a Standard MIDI File", path);
+        unmap_file(file);
+        return false;
+    }
+    format = read_be(file.data + 8, 2);
+    division = read_be(file.data + 12, 2);
+    if (division == 0) {
+        SDL_Log("%s has no time division", path);
+        unmap_file(file);
+        return false;
+    }
+
+    // Only walk the chunk headers, the track data is decoded while playing.
+    size_t offset = 8 + read_be(file.data + 4, 4);
+    while (offset + 8 <= file.size && track_count < SMF_MAX_TRACKS) {
+        Uint32 length = read_be(file.data + offset + 4, 4);
+        const Uint8* data = file.data + offset + 8;
+        if (length > file.size - offset - 8) {
+            length = (Uint32)(file.size - offset - 8); // truncated file, play what is there
+        }
+        if (SDL_memcmp(file.data + offset, "MTrk", 4) == 0) {
+            cursors[track_count].start = data;
+            cursors[track_count].end = data + length;
+            cursors[track_count].done = true;
+            track_count++;
+        }
+        offset += 8 + (size_t)length;
+    }
+
+    SDL_Log("Loaded %s: format %d, %d tracks", path, format, track_count);
+    return true;
+}
+
+
+void smf_player_play() {
+    if (state.load() != PLAYER_STOPPED || track_count == 0) {
+        return;
+    }
+    for (int i = 0; i < track_count; i++) {
+        cursor_rewind(cursors[i]);
+    }
+    tempo = SMF_DEFAULT_TEMPO;
+    tempo_tick = 0;
+    tempo_ns = 0;
+    start_time = SDL_GetTicksNS();
+    state.store(PLAYER_PLAYING, std::memory_order_release);
+    timing_wake();
+}
+
+
+void smf_player_stop() {
+    int expected = PLAYER_PLAYING;
+    if (state.compare_exchange_strong(expected, PLAYER_STOPPING)) {
+        timing_wake();
+    }
+}
+
+
+void smf_player_quit() {
+    unmap_file(file);
+}
+
+
+void smf_player_ui() {
+    static char path[256] = "";
+    int s = state.load();
+
+    ImGui::SeparatorText("File Player");
+    ImGui::PushID("Player");
+    ImGui::InputText("File", path, sizeof(path));
+    if (s == PLAYER_STOPPED) {
+        if (ImGui::Button("Load")) {
+            smf_player_load(path);
+        }
+        if (track_count > 0) {
+            ImGui::SameLine();
+            if (ImGui::Button("Play")) {
+                smf_player_play();
+            }
+        }
+    }
+    else if (ImGui::Button("Stop")) {
+        smf_player_stop();
+    }
+    if (file.data) {
+        ImGui::Text("Format %d, %d tracks, %u bytes", format, track_count, (unsigned int)file.size);
+        ImGui::Text("SysEx skipped %u", sysex_skipped.load());
+    }
+    ImGui::PopID();
+}
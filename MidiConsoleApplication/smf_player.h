@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Registers the player on the timing thread. Call before timing_start().
+bool smf_player_init();
+
+// Map a Standard MIDI File. Only the chunk headers are read here, the tracks
+// are decoded while playing, so big files load instantly.
+bool smf_player_load(const char* path);
+void smf_player_play();
+void smf_player_stop();
+
+// Unmaps the file, the timing thread must be stopped.
+void smf_player_quit();
+
+void smf_player_ui();
@@ -0,0 +1,299 @@
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "imgui.h"
+
+#include "lockfree_queue.h"
+#include "midi_output.h"
+#include "smf_writer.h"
+
+#define SMF_CAPTURE_QUEUE_SIZE 8192
+#define SMF_TRACKS 17           // conductor track + one per channel
+#define SMF_TRACK_BUFFER 4096
+#define SMF_DIVISION 9600       // ticks per quarter note, ~52 us per tick at 120 BPM
+#define SMF_TEMPO 500000        // us per quarter note, 120 BPM
+#define SMF_WRITER_POLL_MS 20
+
+struct CapturedMessage {
+    MidiMessage msg;
+    Uint64 sent = 0;
+};
+
+// Each track streams into its own temp file through a small buffer, so a long
+// session never holds more than SMF_TRACKS * SMF_TRACK_BUFFER bytes in memory.
+struct SmfTrack {
+    SDL_IOStream* io = NULL; // opened on the first event of the track
+    Uint32 length = 0;       // bytes of track data written so far
+    Uint64 last_tick = 0;
+    Uint32 buffered = 0;
+    unsigned char buffer[SMF_TRACK_BUFFER];
+};
+
+static LockFreeQueue<CapturedMessage, SMF_CAPTURE_QUEUE_SIZE> capture_queue;
+static std::atomic<bool> capturing(false);
+static std::atomic<Uint32> captured(0);
+static std::atomic<Uint32> dropped(0);
+static std::thread writer;
+static std::string file_path;
+static Uint64 start_time = 0;
+
+// Only touched by the writer thread.
+static SmfTrack tracks[SMF_TRACKS];
+
+
+static std::string track_path(int index) {
+    return file_path + "." + std::to_string(index) + ".tmp";
+}
+
+
+static void track_flush(SmfTrack& track) {
+    if (track.buffered > 0) {
+        if (SDL_WriteIO(track.io, track.buffer, track.buffered) != track.buffered) {
+            SDL_Log("Couldn't write MIDI capture: %s", SDL_GetError());
+        }
+        track.buffered = 0;
+    }
+}
+
+
+static void track_write(SmfTrack& track, const unsigned char* data, Uint32 size) {
+    for (Uint32 i = 0; i < size; i++) {
+        if (track.buffered == SMF_TRACK_BUFFER) {
+            track_flush(track);
+        }
+        track.buffer[track.buffered++] = data[i];
+    }
+    track.length += size;
+}
+
+
+static void track_write_varlen(SmfTrack& track, Uint32 value) {
+    unsigned char bytes[5];
+    int count = 0;
+
+    bytes[4] = value & 0x7F;
+    count++;
+    while ((value >>= 7) != 0) {
+        bytes[4 - count] = (value & 0x7F) | 0x80;
+        count++;
+    }
+    track_write(track, &bytes[5 - count], count);
+}
+
+
+static bool track_open(int index) {
+    SmfTrack& track = tracks[index];
+    track.io = SDL_IOFromFile(track_path(index).c_str(), "wb");
+    if (track.io == NULL) {
+        SDL_Log("Couldn't open MIDI capture track: %s", SDL_GetError());
+        return false;
+    }
+    track.length = 0;
+    track.last_tick = 0;
+    track.buffered = 0;
+
+    if (index == 0) {
+        const unsigned char tempo[] = { 0x00, 0xFF, 0x51, 0x03, (SMF_TEMPO >> 16) & 0xFF, (SMF_TEMPO >> 8) & 0xFF, SMF_TEMPO & 0xFF };
+        track_write(track, tempo, sizeof(tempo));
+    }
+    else {
+        char name[16];
+        int length = SDL_snprintf(name, sizeof(name), "Channel %d", index);
+        const unsigned char meta[] = { 0x00, 0xFF, 0x03, (unsigned char)length };
+        track_write(track, meta, sizeof(meta));
+        track_write(track, (const unsigned char*)name, length);
+    }
+    return true;
+}
+
+
+static void track_event(const CapturedMessage& captured_msg) {
+    const MidiMessage& msg = captured_msg.msg;
+    const unsigned char* bytes = msg.long_data ? msg.long_data : msg.bytes;
+    Uint32 size = msg.long_data ? msg.long_size : msg.size;
+    if (size == 0 || captured_msg.sent < start_time) {
+        return; // left over from a previous capture
+    }
+
+    // Channel messages go to their channel's track, everything else to the conductor track.
+    unsigned char status = bytes[0];
+    int index = status < 0xF0 ? 1 + (status & 0x0F) : 0;
+    SmfTrack& track = tracks[index];
+    if (track.io == NULL && !track_open(index)) {
+        return;
+    }
+
+    Uint64 tick = (captured_msg.sent - start_time) * SMF_DIVISION / (SMF_TEMPO * (Uint64)SDL_NS_PER_US);
+    // The output workers tap concurrently and native backends report due
+    // times, so a message can come in stamped before the last one. A delta
+    // can't be negative, it goes at the same tick instead.
+    track_write_varlen(track, tick < track.last_tick ? 0 : (Uint32)(tick - track.last_tick));
+    track.last_tick = SDL_max(track.last_tick, tick);
+
+    if (status < 0xF0) {
+        track_write(track, bytes, size);
+    }
+    else if (status == 0xF0) {
+        track_write(track, &status, 1);
+        track_write_varlen(track, size - 1);
+        track_write(track, bytes + 1, size - 1);
+    }
+    else {
+        // System common and realtime messages need the escape form.
+        const unsigned char escape = 0xF7;
+        track_write(track, &escape, 1);
+        track_write_varlen(track, size);
+        track_write(track, bytes, size);
+    }
+    captured.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+static void write_be(SDL_IOStream* io, Uint32 value, int size) {
+    unsigned char bytes[4];
+    for (int i = 0; i < size; i++) {
+        bytes[i] = (value >> (8 * (size - 1 - i))) & 0xFF;
+    }
+    SDL_WriteIO(io, bytes, size);
+}
+
+
+// Close every track and glue them behind the header into the final file.
+static void write_file() {
+    const unsigned char end_of_track[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    int track_count = 0;
+
+    for (int i = 0; i < SMF_TRACKS; i++) {
+        if (tracks[i].io) {
+            track_write(tracks[i], end_of_track, sizeof(end_of_track));
+            track_flush(tracks[i]);
+            SDL_CloseIO(tracks[i].io);
+            tracks[i].io = NULL;
+            track_count++;
+        }
+        else {
+            tracks[i].length = 0;
+        }
+    }
+
+    SDL_IOStream* io = SDL_IOFromFile(file_path.c_str(), "wb");
+    if (io == NULL) {
+        SDL_Log("Couldn't create %s: %s", file_path.c_str(), SDL_GetError());
+    }
+    else {
+        SDL_WriteIO(io, "MThd", 4);
+        write_be(io, 6, 4);
+        write_be(io, 1, 2); // format 1
+        write_be(io, track_count, 2);
+        write_be(io, SMF_DIVISION, 2);
+    }
+
+    for (int i = 0; i < SMF_TRACKS; i++) {
+        if (tracks[i].length == 0) {
+            continue;
+        }
+        std::string path = track_path(i);
+        if (io) {
+            SDL_WriteIO(io, "MTrk", 4);
+            write_be(io, tracks[i].length, 4);
+            SDL_IOStream* tmp = SDL_IOFromFile(path.c_str(), "rb");
+            if (tmp) {
+                size_t read;
+                // The track buffer is free now, reuse it for the copy.
+                while ((read = SDL_ReadIO(tmp, tracks[i].buffer, SMF_TRACK_BUFFER)) > 0) {
+                    SDL_WriteIO(io, tracks[i].buffer, read);
+                }
+                SDL_CloseIO(tmp);
+            }
+        }
+        SDL_RemovePath(path.c_str());
+        tracks[i].length = 0;
+    }
+
+    if (io) {
+        SDL_CloseIO(io);
+        SDL_Log("MIDI capture written to %s", file_path.c_str());
+    }
+}
+
+
+static void writer_loop() {
+    CapturedMessage msg;
+
+    track_open(0);
+    for (;;) {
+        bool active = capturing.load(std::memory_order_acquire);
+        while (capture_queue.pop(msg)) {
+            track_event(msg);
+            midi_message_release(msg.msg);
+        }
+        if (!active) {
+            break;
+        }
+        SDL_Delay(SMF_WRITER_POLL_MS);
+    }
+    write_file();
+}
+
+
+static void smf_capture_tap(const MidiMessage& msg, Uint64 sent) {
+    if (!capturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    CapturedMessage captured_msg;
+    captured_msg.msg = msg;
+    captured_msg.sent = sent;
+    // The writer reads a SysEx payload later.
+    midi_message_retain(msg);
+    if (!capture_queue.push(captured_msg)) {
+        midi_message_release(msg);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+bool smf_writer_init() {
+    return midi_output_add_tap(smf_capture_tap);
+}
+
+
+bool smf_capture_start(const char* path) {
+    if (capturing.load()) {
+        return false;
+    }
+    file_path = path;
+    start_time = SDL_GetTicksNS();
+    captured.store(0);
+    dropped.store(0);
+    capturing.store(true, std::memory_order_release);
+    writer = std::thread(writer_loop);
+    return true;
+}
+
+
+void smf_capture_stop() {
+    if (capturing.exchange(false)) {
+        writer.join();
+    }
+}
+
+
+void smf_writer_ui() {
+    static char path[256] = "capture.mid";
+
+    ImGui::SeparatorText("Capture");
+    if (!capturing.load()) {
+        ImGui::InputText("File", path, sizeof(path));
+        if (ImGui::Button("Start Capture")) {
+            smf_capture_start(path);
+        }
+    }
+    else {
+        ImGui::Text("Capturing to %s", path);
+        if (ImGui::Button("Stop Capture")) {
+            smf_capture_stop();
+        }
+    }
+    ImGui::Text("%u messages, %u dropped", captured.load(), dropped.load());
+}
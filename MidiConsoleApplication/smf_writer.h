@@ -0,0 +1,13 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Registers the capture tap on the output worker. Call before midi_output_start().
+bool smf_writer_init();
+
+// Capture everything sent to the MIDI port into a Standard MIDI File
+// (format 1, one track per channel). The file is written when capture stops.
+bool smf_capture_start(const char* path);
+void smf_capture_stop();
+
+void smf_writer_ui();
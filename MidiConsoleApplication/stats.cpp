@@ -0,0 +1,142 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "device_lanes.h"
+#include "midi_output.h"
+#include "stats.h"
+#include "stats_shm.h"
+
+#define STATS_INTERVAL_NS SDL_MS_TO_NS(10)
+
+static_assert(MIDI_OUTPUTS == STATS_OUTPUTS && MIDI_OUTPUT_LANES == STATS_LANES &&
+    MIDI_LATENCY_BUCKETS == STATS_LATENCY_BUCKETS && MIDI_LATENCY_BUCKET_US == STATS_LATENCY_BUCKET_US &&
+    DEVICE_LANES + 1 == STATS_DEVICES, "stats_shm.h is out of date");
+
+static StatsBlock* block = NULL;
+#ifdef _WIN32
+static HANDLE mapping = NULL;
+#endif
+// Only the main thread touches these.
+static StatsData snapshot;
+static Uint64 published_at = 0;
+
+
+bool stats_open() {
+#ifdef _WIN32
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(StatsBlock), STATS_SHM_NAME);
+    if (mapping == NULL) {
+        SDL_Log("Couldn't create the stats mapping: %lu", GetLastError());
+        return false;
+    }
+    void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(StatsBlock));
+    if (memory == NULL) {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+#else
+    int fd = shm_open(STATS_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        SDL_Log("Couldn't create the stats segment %s", STATS_SHM_NAME);
+        return false;
+    }
+    void* memory = NULL;
+    if (ftruncate(fd, sizeof(StatsBlock)) == 0) {
+        memory = mmap(NULL, sizeof(StatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            memory = NULL;
+        }
+    }
+    close(fd);
+    if (memory == NULL) {
+        shm_unlink(STATS_SHM_NAME);
+    }
+#endif
+    if (memory == NULL) {
+        SDL_Log("Couldn't map the stats segment");
+        return false;
+    }
+    block = (StatsBlock*)memory;
+    SDL_memset(&block->data, 0, sizeof(block->data));
+    block->sequence.store(0);
+    block->size = sizeof(StatsBlock);
+    block->version = STATS_VERSION;
+    // Last, a reader takes the block for valid once it sees the magic.
+    std::atomic_thread_fence(std::memory_order_release);
+    block->magic = STATS_MAGIC;
+    return true;
+}
+
+
+void stats_close() {
+    if (block == NULL) {
+        return;
+    }
+    block->magic = 0;
+#ifdef _WIN32
+    UnmapViewOfFile(block);
+    CloseHandle(mapping);
+    mapping = NULL;
+#else
+    munmap(block, sizeof(StatsBlock));
+    shm_unlink(STATS_SHM_NAME);
+#endif
+    block = NULL;
+}
+
+
+static void device_stats(StatsDevice& d, SDL_JoystickID id, const char* name, int output, int channel, Uint32 queued, Uint32 dropped) {
+    d.id = id;
+    d.output = output;
+    d.channel = channel;
+    d.queued = queued;
+    d.dropped = dropped;
+    SDL_strlcpy(d.name, name ? name : "", sizeof(d.name));
+}
+
+
+void stats_publish(SDL_Joystick* joystick) {
+    Uint64 now = SDL_GetTicksNS();
+    if (block == NULL || now - published_at < STATS_INTERVAL_NS) {
+        return;
+    }
+    published_at = now;
+
+    // Gathered first so the write below is a plain copy, readers retry less.
+    SDL_zero(snapshot);
+    snapshot.time_ns = now;
+    snapshot.publishes = block->data.publishes + 1;
+    for (int i = 0; i < MIDI_OUTPUTS; i++) {
+        MidiOutputCounters counters;
+        midi_output_counters(i, &counters);
+        StatsOutput& o = snapshot.outputs[i];
+        o.open = counters.open;
+        o.backend = counters.backend;
+        o.sent = counters.sent;
+        o.coalesced = counters.coalesced;
+        o.dropped = counters.dropped;
+        o.latency_us = counters.latency_us;
+        SDL_memcpy(o.queued, counters.queued, sizeof(o.queued));
+        SDL_memcpy(o.histogram, counters.histogram, sizeof(o.histogram));
+    }
+    if (joystick) {
+        device_stats(snapshot.devices[0], SDL_GetJoystickID(joystick), SDL_GetJoystickName(joystick), 0, -1, 0, 0);
+    }
+    for (int i = 0; i < DEVICE_LANES; i++) {
+        LaneCounters lane;
+        if (lanes_counters(i, &lane)) {
+            device_stats(snapshot.devices[i + 1], lane.id, lane.name, lane.output, lane.channel, lane.queued, lane.dropped);
+        }
+    }
+
+    Uint32 sequence = block->sequence.load(std::memory_order_relaxed);
+    block->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    SDL_memcpy(&block->data, &snapshot, sizeof(snapshot));
+    block->sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Live counters, latency histograms, queue depths and controllers exported
+// in shared memory (see stats_shm.h), so a monitor can watch them without
+// the app logging anything. The producers only keep the atomics they
+// already keep, the main thread copies them out.
+
+bool stats_open();
+void stats_close();
+
+// Copy the current stats out, at most every few milliseconds. Call once a
+// frame from the main thread, joystick is the first controller.
+void stats_publish(SDL_Joystick* joystick);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// The layout of the stats the app exports in shared memory, for MidiStats and
+// other monitors. Plain fixed size types only, the reader doesn't use SDL.
+
+#ifdef _WIN32
+#define STATS_SHM_NAME "Local\\MidiConsoleStats"
+#else
+#define STATS_SHM_NAME "/midiconsole-stats"
+#endif
+#define STATS_MAGIC 0x5453434D // "MCST"
+#define STATS_VERSION 1
+#define STATS_OUTPUTS 4
+#define STATS_LANES 4 // realtime, note-off, event and controller queues
+#define STATS_LATENCY_BUCKETS 64
+#define STATS_LATENCY_BUCKET_US 250
+#define STATS_DEVICES 17 // the first controller, then one per lane
+#define STATS_NAME_SIZE 64
+
+struct StatsOutput {
+    uint32_t open;
+    uint32_t backend; // 0 RtMidi, 1 ALSA sequencer, 2 JACK
+    uint32_t sent;
+    uint32_t coalesced;
+    uint32_t dropped;
+    uint32_t latency_us; // of the last message sent
+    uint32_t queued[STATS_LANES];
+    uint32_t histogram[STATS_LATENCY_BUCKETS];
+};
+
+struct StatsDevice {
+    uint32_t id; // SDL joystick id, 0 for an unused entry
+    int32_t output;
+    int32_t channel; // -1 plays the channels of the mapping
+    uint32_t queued;
+    uint32_t dropped;
+    char name[STATS_NAME_SIZE];
+};
+
+struct StatsData {
+    uint64_t time_ns; // SDL_GetTicksNS() of the app when published
+    uint32_t publishes;
+    uint32_t padding;
+    StatsOutput outputs[STATS_OUTPUTS];
+    StatsDevice devices[STATS_DEVICES];
+};
+
+// A seqlock: sequence is odd while the app writes data. A reader copies data
+// and keeps the copy if sequence was the same even value before and after.
+struct StatsBlock {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t size; // of StatsBlock
+    StatsData data;
+};
@@ -0,0 +1,201 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "midi_output.h"
+#include "sysex.h"
+
+#define SYSEX_MAX_SIZE 32768
+
+struct SysexSlot {
+    // Two buffers so a new payload never overwrites the one sysex_send()
+    // uses, current. refs counts the messages still pointing at a buffer, in
+    // the output queues or kept by a tap.
+    unsigned char data[2][SYSEX_MAX_SIZE];
+    Uint32 size[2];
+    std::atomic<int> refs[2];
+    std::atomic<int> current;
+    std::atomic<int> delay_ms; // between the messages of a multi-message dump
+    char text[256];
+    char status[64];
+};
+
+static SysexSlot slots[SYSEX_SLOTS];
+
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+// Returns the number of bytes, or -1 on anything that isn't hex.
+static int parse_hex(const char* text, unsigned char* out, int max_size) {
+    int size = 0;
+    int high = -1;
+
+    for (const char* c = text; *c; c++) {
+        if (*c == ' ' || *c == ',' || *c == '\t') {
+            continue;
+        }
+        int digit = hex_digit(*c);
+        if (digit < 0 || (high < 0 && size == max_size)) {
+            return -1;
+        }
+        if (high < 0) {
+            high = digit;
+        }
+        else {
+            out[size++] = (unsigned char)((high << 4) | digit);
+            high = -1;
+        }
+    }
+    return high < 0 ? size : -1;
+}
+
+
+// One or more complete F0..F7 messages with only data bytes in between.
+// Returns the number of messages, or 0 if the payload is invalid.
+static int validate(const unsigned char* data, Uint32 size) {
+    int messages = 0;
+    bool open = false;
+
+    for (Uint32 i = 0; i < size; i++) {
+        if (data[i] == 0xF0) {
+            if (open) {
+                return 0;
+            }
+            open = true;
+        }
+        else if (data[i] == 0xF7) {
+            if (!open) {
+                return 0;
+            }
+            open = false;
+            messages++;
+        }
+        else if (!open || data[i] >= 0x80) {
+            return 0;
+        }
+    }
+    return open ? 0 : messages;
+}
+
+
+static bool is_syx_path(const char* text) {
+    size_t length = SDL_strlen(text);
+    return length > 4 && SDL_strcasecmp(text + length - 4, ".syx") == 0;
+}
+
+
+bool sysex_set(int slot, const char* text) {
+    if (slot < 0 || slot >= SYSEX_SLOTS) {
+        return false;
+    }
+    SysexSlot& s = slots[slot];
+    int next = 1 - s.current.load();
+    int size;
+
+    // Sent before the last Set and not done yet.
+    if (s.refs[next].load() > 0) {
+        SDL_snprintf(s.status, sizeof(s.status), "Busy, try again");
+        return false;
+    }
+
+    if (is_syx_path(text)) {
+        size_t file_size;
+        void* file = SDL_LoadFile(text, &file_size);
+        if (file == NULL) {
+            SDL_snprintf(s.status, sizeof(s.status), "Can't read file");
+            return false;
+        }
+        size = file_size <= SYSEX_MAX_SIZE ? (int)file_size : -1;
+        if (size > 0) {
+            SDL_memcpy(s.data[next], file, size);
+        }
+        SDL_free(file);
+    }
+    else {
+        size = parse_hex(text, s.data[next], SYSEX_MAX_SIZE);
+    }
+
+    int messages = size > 0 ? validate(s.data[next], size) : 0;
+    if (messages == 0) {
+        SDL_snprintf(s.status, sizeof(s.status), "Invalid SysEx");
+        return false;
+    }
+    s.size[next] = size;
+    s.current.store(next);
+    SDL_snprintf(s.status, sizeof(s.status), "%d bytes, %d msg", size, messages);
+    return true;
+}
+
+
+bool sysex_send(int slot) {
+    if (slot < 0 || slot >= SYSEX_SLOTS) {
+        return false;
+    }
+    SysexSlot& s = slots[slot];
+    int current;
+
+    // Hold the buffer before reading it, or two sysex_set() calls could
+    // rewrite it in between. If current moved while we took the hold, the
+    // set may not have seen it: let go and pick the new buffer.
+    for (;;) {
+        current = s.current.load();
+        s.refs[current].fetch_add(1);
+        if (s.current.load() == current) {
+            break;
+        }
+        s.refs[current].fetch_sub(1);
+    }
+
+    bool sent = false;
+    if (s.size[current] > 0) {
+        sent = midi_output_send_long(s.data[current], s.size[current], s.delay_ms.load(std::memory_order_relaxed) * 1000, &s.refs[current]);
+    }
+    s.refs[current].fetch_sub(1, std::memory_order_release);
+    return sent;
+}
+
+
+void sysex_ui() {
+    ImGui::SeparatorText("SysEx");
+    if (ImGui::BeginTable("SysEx", 4)) {
+        ImGui::TableSetupColumn("Slot");
+        ImGui::TableSetupColumn("Payload (hex or .syx)");
+        ImGui::TableSetupColumn("Delay ms");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < SYSEX_SLOTS; i++) {
+            SysexSlot& s = slots[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", i);
+            ImGui::TableNextColumn();
+            ImGui::PushID(i);
+            ImGui::InputText("##Payload", s.text, sizeof(s.text));
+            ImGui::TableNextColumn();
+            int delay = s.delay_ms.load();
+            if (ImGui::SliderInt("##Delay", &delay, 0, 500)) {
+                s.delay_ms.store(delay);
+            }
+            ImGui::TableNextColumn();
+            if (ImGui::Button("Set")) {
+                sysex_set(i, s.text);
+            }
+            ImGui::SameLine();
+            ImGui::TextUnformatted(s.status);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define SYSEX_SLOTS 8
+
+// Parse "F0 .. F7" hex text, or load a .syx file, into a slot. The payload is
+// validated here so pressing the button only queues a pointer.
+bool sysex_set(int slot, const char* text);
+
+// Queue the payload of a slot. Never blocks or allocates.
+bool sysex_send(int slot);
+
+void sysex_ui();
@@ -0,0 +1,97 @@
+#include <atomic>
+#include <thread>
+
+#include "timing.h"
+
+#define TIMING_MAX_CLIENTS 8
+// Below this we stop trusting the OS scheduler and let SDL_DelayPrecise finish the wait.
+#define TIMING_PRECISE_NS SDL_MS_TO_NS(2)
+#define TIMING_IDLE_MS 100
+
+struct TimingClient {
+    TimingCallback callback = NULL;
+    void* userdata = NULL;
+};
+
+static TimingClient clients[TIMING_MAX_CLIENTS];
+static int client_count = 0;
+
+static SDL_Semaphore* wakeup = NULL;
+static std::thread timing_thread;
+static std::atomic<bool> running(false);
+
+
+static void timing_loop() {
+    SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+    while (running.load(std::memory_order_acquire)) {
+        Uint64 now = SDL_GetTicksNS();
+        Uint64 next = 0;
+        for (int i = 0; i < client_count; i++) {
+            Uint64 due = clients[i].callback(now, clients[i].userdata);
+            if (due != 0 && (next == 0 || due < next)) {
+                next = due;
+            }
+        }
+
+        if (next == 0) {
+            SDL_WaitSemaphoreTimeout(wakeup, TIMING_IDLE_MS);
+            continue;
+        }
+
+        now = SDL_GetTicksNS();
+        if (next > now && next - now > TIMING_PRECISE_NS) {
+            Sint32 wait_ms = (Sint32)((next - now - TIMING_PRECISE_NS) / SDL_NS_PER_MS);
+            if (SDL_WaitSemaphoreTimeout(wakeup, wait_ms)) {
+                // Someone scheduled something new, ask the clients again.
+                continue;
+            }
+            now = SDL_GetTicksNS();
+        }
+        if (next > now) {
+            SDL_DelayPrecise(next - now);
+        }
+    }
+}
+
+
+bool timing_add(TimingCallback callback, void* userdata) {
+    if (running.load() || client_count == TIMING_MAX_CLIENTS) {
+        return false;
+    }
+    clients[client_count].callback = callback;
+    clients[client_count].userdata = userdata;
+    client_count++;
+    return true;
+}
+
+
+bool timing_start() {
+    wakeup = SDL_CreateSemaphore(0);
+    if (wakeup == NULL) {
+        SDL_Log("Couldn't create timing semaphore: %s", SDL_GetError());
+        return false;
+    }
+    running.store(true);
+    timing_thread = std::thread(timing_loop);
+    return true;
+}
+
+
+void timing_stop() {
+    if (running.exchange(false)) {
+        timing_wake();
+        timing_thread.join();
+    }
+    if (wakeup) {
+        SDL_DestroySemaphore(wakeup);
+        wakeup = NULL;
+    }
+}
+
+
+void timing_wake() {
+    if (wakeup) {
+        SDL_SignalSemaphore(wakeup);
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Runs on the timing thread every time it wakes up, so it may be called before
+// it is due. Gets the current SDL_GetTicksNS() time and returns the time it
+// wants to be called again, or 0 if nothing is scheduled.
+typedef Uint64 (*TimingCallback)(Uint64 now, void* userdata);
+
+// Register a client. Must be called before timing_start().
+bool timing_add(TimingCallback callback, void* userdata);
+
+bool timing_start();
+void timing_stop();
+
+// Wake the timing thread after scheduling something earlier than before.
+void timing_wake();
@@ -0,0 +1,234 @@
+#include <atomic>
+
+#include "imgui.h"
+
+#include "lockfree_queue.h"
+#include "midi_output.h"
+#include "ump.h"
+
+#define UMP_LOOPBACK_SIZE 4096
+#define UMP_HISTORY 8
+
+#define UMP_MIDI1_CHANNEL_VOICE 0x2
+#define UMP_MIDI2_CHANNEL_VOICE 0x4
+
+static std::atomic<bool> enabled(false);
+static std::atomic<bool> midi2(true); // MIDI 2.0 protocol, otherwise MIDI 1.0 in 32-bit packets
+static std::atomic<int> axis_channel(0);
+static std::atomic<int> axis_cc_base(-1); // controller of axis 0, -1 when axes are off
+static std::atomic<Uint32> packet_count(0);
+
+// The loopback endpoint, read back by the monitor in the UI.
+static LockFreeQueue<UmpPacket, UMP_LOOPBACK_SIZE> loopback;
+
+
+Uint32 ump_scale_up(Uint32 value, int src_bits, int dst_bits) {
+    int scale_bits = dst_bits - src_bits;
+    Uint64 shifted = (Uint64)value << scale_bits;
+    Uint32 center = 1u << (src_bits - 1);
+    if (value <= center) {
+        return (Uint32)shifted;
+    }
+
+    // Above the center, repeat the lower bits so the maximum maps to the maximum.
+    int repeat_bits = src_bits - 1;
+    Uint64 repeat = value & ((1u << repeat_bits) - 1);
+    if (scale_bits > repeat_bits) {
+        repeat <<= scale_bits - repeat_bits;
+    }
+    else {
+        repeat >>= repeat_bits - scale_bits;
+    }
+    while (repeat != 0) {
+        shifted |= repeat;
+        repeat >>= repeat_bits;
+    }
+    return (Uint32)shifted;
+}
+
+
+UmpPacket ump_midi1(Uint8 group, const unsigned char* bytes, int size) {
+    UmpPacket packet;
+    if (size < 1 || bytes[0] < 0x80 || bytes[0] >= 0xF0) {
+        return packet;
+    }
+    packet.timestamp = SDL_GetTicksNS();
+    packet.words[0] = (UMP_MIDI1_CHANNEL_VOICE << 28) | ((group & 0xF) << 24) | (bytes[0] << 16) |
+        ((size > 1 ? bytes[1] & 0x7F : 0) << 8) | (size > 2 ? bytes[2] & 0x7F : 0);
+    packet.size = 1;
+    return packet;
+}
+
+
+static UmpPacket midi2_packet(Uint8 group, Uint8 status, Uint8 channel, Uint8 index, Uint8 extra, Uint32 data) {
+    UmpPacket packet;
+    packet.timestamp = SDL_GetTicksNS();
+    packet.words[0] = (UMP_MIDI2_CHANNEL_VOICE << 28) | ((group & 0xF) << 24) | ((status & 0xF) << 20) |
+        ((channel & 0xF) << 16) | (index << 8) | extra;
+    packet.words[1] = data;
+    packet.size = 2;
+    return packet;
+}
+
+
+UmpPacket ump_note_on(Uint8 group, Uint8 channel, Uint8 note, Uint16 velocity) {
+    return midi2_packet(group, 0x9, channel, note & 0x7F, 0, (Uint32)velocity << 16);
+}
+
+
+UmpPacket ump_note_off(Uint8 group, Uint8 channel, Uint8 note, Uint16 velocity) {
+    return midi2_packet(group, 0x8, channel, note & 0x7F, 0, (Uint32)velocity << 16);
+}
+
+
+UmpPacket ump_control_change(Uint8 group, Uint8 channel, Uint8 index, Uint32 value) {
+    return midi2_packet(group, 0xB, channel, index & 0x7F, 0, value);
+}
+
+
+UmpPacket ump_channel_pressure(Uint8 group, Uint8 channel, Uint32 value) {
+    return midi2_packet(group, 0xD, channel, 0, 0, value);
+}
+
+
+UmpPacket ump_pitch_bend(Uint8 group, Uint8 channel, Uint32 value) {
+    return midi2_packet(group, 0xE, channel, 0, 0, value);
+}
+
+
+UmpPacket ump_from_midi1(Uint8 group, const unsigned char* bytes, int size) {
+    UmpPacket packet;
+    if (size < 2 || bytes[0] < 0x80 || bytes[0] >= 0xF0) {
+        return packet;
+    }
+    Uint8 status = bytes[0] >> 4;
+    Uint8 channel = bytes[0] & 0x0F;
+    Uint8 data1 = bytes[1] & 0x7F;
+    Uint8 data2 = size > 2 ? bytes[2] & 0x7F : 0;
+
+    switch (status) {
+    case 0x8:
+        packet = ump_note_off(group, channel, data1, (Uint16)ump_scale_up(data2, 7, 16));
+        break;
+    case 0x9:
+        if (data2 == 0) {
+            packet = ump_note_off(group, channel, data1, 0x8000); // MIDI 1.0 note-off by velocity 0
+        }
+        else {
+            packet = ump_note_on(group, channel, data1, (Uint16)ump_scale_up(data2, 7, 16));
+        }
+        break;
+    case 0xA:
+        packet = midi2_packet(group, 0xA, channel, data1, 0, ump_scale_up(data2, 7, 32));
+        break;
+    case 0xB:
+        packet = ump_control_change(group, channel, data1, ump_scale_up(data2, 7, 32));
+        break;
+    case 0xC:
+        packet = midi2_packet(group, 0xC, channel, 0, 0, (Uint32)data1 << 24);
+        break;
+    case 0xD:
+        packet = ump_channel_pressure(group, channel, ump_scale_up(data1, 7, 32));
+        break;
+    case 0xE:
+        packet = ump_pitch_bend(group, channel, ump_scale_up(data1 | (data2 << 7), 14, 32));
+        break;
+    }
+    return packet;
+}
+
+
+static void ump_send(const UmpPacket& packet) {
+    if (packet.size != 0 && loopback.push(packet)) {
+        packet_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+// Every MIDI 1.0 message also goes out translated on the UMP endpoint, in the
+// group of the output it was sent on.
+static void ump_tap(const MidiMessage& msg, Uint64 sent) {
+    if (!enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    UmpPacket packet;
+    if (midi2.load(std::memory_order_relaxed)) {
+        packet = ump_from_midi1(msg.output, msg.bytes, msg.size);
+    }
+    else {
+        packet = ump_midi1(msg.output, msg.bytes, msg.size);
+    }
+    packet.timestamp = sent;
+    ump_send(packet);
+}
+
+
+bool ump_output_init() {
+    return midi_output_add_tap(ump_tap);
+}
+
+
+void ump_axis(int axis, Sint16 value) {
+    int base = axis_cc_base.load(std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed) || !midi2.load(std::memory_order_relaxed) || base < 0 || base + axis > 127) {
+        return;
+    }
+    Uint32 position = (Uint32)(value + 32768); // 0 to 65535
+    ump_send(ump_control_change(0, (Uint8)axis_channel.load(std::memory_order_relaxed), (Uint8)(base + axis),
+        ump_scale_up(position, 16, 32)));
+}
+
+
+void ump_ui() {
+    static UmpPacket history[UMP_HISTORY];
+    static int history_pos = 0;
+    static Uint64 rate_time = 0;
+    static Uint32 rate_count = 0;
+    static Uint32 rate = 0;
+
+    ImGui::SeparatorText("MIDI 2.0 (UMP Loopback)");
+    ImGui::PushID("UMP");
+    bool on = enabled.load();
+    if (ImGui::Checkbox("Enabled", &on)) {
+        enabled.store(on);
+    }
+    ImGui::SameLine();
+    bool protocol2 = midi2.load();
+    if (ImGui::Checkbox("MIDI 2.0 Protocol", &protocol2)) {
+        midi2.store(protocol2);
+    }
+    int channel = axis_channel.load() + 1;
+    if (ImGui::SliderInt("Axis Chnl", &channel, 1, 16)) {
+        axis_channel.store(channel - 1);
+    }
+    int base = axis_cc_base.load();
+    if (ImGui::SliderInt("Axis CC Base", &base, -1, 127)) {
+        axis_cc_base.store(base);
+    }
+
+    // Drain the loopback, keep the last few packets for display.
+    UmpPacket packet;
+    while (loopback.pop(packet)) {
+        history[history_pos] = packet;
+        history_pos = (history_pos + 1) % UMP_HISTORY;
+    }
+
+    Uint64 now = SDL_GetTicksNS();
+    if (now - rate_time >= SDL_NS_PER_SECOND) {
+        Uint32 count = packet_count.load();
+        rate = count - rate_count;
+        rate_count = count;
+        rate_time = now;
+    }
+    ImGui::Text("%u packets, %u/s", packet_count.load(), rate);
+    for (int i = 0; i < UMP_HISTORY; i++) {
+        const UmpPacket& p = history[(history_pos + UMP_HISTORY - 1 - i) % UMP_HISTORY];
+        if (p.size == 2) {
+            ImGui::Text("%08X %08X", p.words[0], p.words[1]);
+        }
+        else if (p.size == 1) {
+            ImGui::Text("%08X", p.words[0]);
+        }
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+// Universal MIDI Packet, 32 or 64 bits.
+struct UmpPacket {
+    Uint64 timestamp = 0;
+    Uint32 words[2] = { 0, 0 };
+    Uint8 size = 0; // in 32-bit words
+};
+
+// Min-center-max upscaling from the MIDI 2.0 spec (e.g. 7 to 16 or 32 bits).
+Uint32 ump_scale_up(Uint32 value, int src_bits, int dst_bits);
+
+// MIDI 1.0 channel voice message in a 32-bit packet.
+UmpPacket ump_midi1(Uint8 group, const unsigned char* bytes, int size);
+
+// MIDI 2.0 channel voice messages (64-bit).
+UmpPacket ump_note_on(Uint8 group, Uint8 channel, Uint8 note, Uint16 velocity);
+UmpPacket ump_note_off(Uint8 group, Uint8 channel, Uint8 note, Uint16 velocity);
+UmpPacket ump_control_change(Uint8 group, Uint8 channel, Uint8 index, Uint32 value);
+UmpPacket ump_channel_pressure(Uint8 group, Uint8 channel, Uint32 value);
+UmpPacket ump_pitch_bend(Uint8 group, Uint8 channel, Uint32 value);
+
+// Translate a MIDI 1.0 message to MIDI 2.0. Returns an empty packet for
+// anything that isn't a channel voice message.
+UmpPacket ump_from_midi1(Uint8 group, const unsigned char* bytes, int size);
+
+// Registers the loopback endpoint on the output worker. Call before midi_output_start().
+bool ump_output_init();
+
+// Sends a joystick axis as a 32-bit controller, straight from its 16 bits.
+void ump_axis(int axis, Sint16 value);
+
+void ump_ui();
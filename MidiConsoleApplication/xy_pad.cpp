@@ -0,0 +1,273 @@
+#include <atomic>
+#include <mutex>
+
+#include "imgui.h"
+
+#include "midi_output.h"
+#include "xy_pad.h"
+
+#define XY_FULL 32767
+#define XY_ANGLE_STEPS 4096 // per turn
+#define XY_MOVED_X 1
+#define XY_MOVED_Y 2
+
+enum XyMode {
+    XY_CARTESIAN, // X and Y CCs
+    XY_POLAR      // radius and angle CCs
+};
+
+// Edited by the UI, applied by configure().
+struct XyConfig {
+    int x_axis = -1;
+    int y_axis = -1;
+    int mode = XY_CARTESIAN;
+    int channel = 0;
+    int cc_a = 16;           // X or radius
+    int cc_b = 17;           // Y or angle
+    int deadzone = 2048;     // radius under which the stick is at rest
+    bool square_gate = false;
+};
+
+struct XyPad {
+    std::atomic<int> x_axis;
+    std::atomic<int> y_axis;
+    std::atomic<int> mode;
+    std::atomic<int> channel;
+    std::atomic<int> cc_a;
+    std::atomic<int> cc_b;
+    std::atomic<int> deadzone;
+    std::atomic<bool> square_gate;
+    std::atomic<int> x; // latest positions, up is positive
+    std::atomic<int> y;
+    // Input frames run on the main and the timing thread.
+    std::mutex emitting;
+    int sent_a;
+    int sent_b;
+    int angle;
+};
+
+// The axes each pad got in the input frame the thread is handling.
+struct XyFrame {
+    int moved[XY_PADS] = {};
+    int depth = 0;
+};
+
+static XyConfig configs[XY_PADS];
+static XyPad pads[XY_PADS];
+static thread_local XyFrame frame;
+
+// atan(i / 256) in XY_ANGLE_STEPS, the first octant of the circle.
+static Uint16 atan_table[257];
+
+
+static Uint32 isqrt(Uint32 n) {
+    Uint32 root = 0;
+    Uint32 bit = 1u << 30;
+
+    while (bit > n) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+// Integer atan2 by folding into the first octant. 0 points right, counter-clockwise.
+static int angle_of(int x, int y) {
+    int ax = SDL_abs(x);
+    int ay = SDL_abs(y);
+    int a;
+
+    if (ax >= ay) {
+        a = atan_table[(ay << 8) / ax];
+    }
+    else {
+        a = XY_ANGLE_STEPS / 4 - atan_table[(ax << 8) / ay];
+    }
+    if (x < 0) {
+        a = XY_ANGLE_STEPS / 2 - a;
+    }
+    if (y < 0) {
+        a = XY_ANGLE_STEPS - a;
+    }
+    return a & (XY_ANGLE_STEPS - 1);
+}
+
+
+static int to_cc(int position) {
+    return SDL_clamp((position + 32768) >> 9, 0, 127);
+}
+
+
+static void emit(XyPad& pad) {
+    std::lock_guard<std::mutex> lock(pad.emitting);
+    int x = pad.x.load(std::memory_order_relaxed);
+    int y = pad.y.load(std::memory_order_relaxed);
+    int deadzone = pad.deadzone.load(std::memory_order_relaxed);
+    Uint32 length = isqrt((Uint32)(x * x) + (Uint32)(y * y));
+
+    // A square gate lets the diagonals go past the circle, measure those
+    // sticks by their largest axis so every direction tops out together.
+    int radius = pad.square_gate.load(std::memory_order_relaxed) ? SDL_max(SDL_abs(x), SDL_abs(y)) : (int)length;
+    if (radius <= deadzone || length == 0) {
+        radius = 0;
+    }
+    else {
+        radius = SDL_min((radius - deadzone) * XY_FULL / (XY_FULL - deadzone), XY_FULL);
+    }
+
+    int a;
+    int b;
+    if (pad.mode.load(std::memory_order_relaxed) == XY_POLAR) {
+        if (radius != 0) {
+            pad.angle = angle_of(x, y);
+        }
+        a = radius >> 8;
+        b = pad.angle * 128 / XY_ANGLE_STEPS;
+    }
+    else {
+        // Same direction, corrected length.
+        a = radius == 0 ? 64 : to_cc(x * radius / (int)length);
+        b = radius == 0 ? 64 : to_cc(y * radius / (int)length);
+    }
+
+    if (a == pad.sent_a && b == pad.sent_b) {
+        return;
+    }
+    unsigned char status = 0xB0 + (unsigned char)pad.channel.load(std::memory_order_relaxed);
+    midi_output_send(status, (unsigned char)pad.cc_a.load(std::memory_order_relaxed), (unsigned char)a);
+    midi_output_send(status, (unsigned char)pad.cc_b.load(std::memory_order_relaxed), (unsigned char)b);
+    pad.sent_a = a;
+    pad.sent_b = b;
+}
+
+
+static void configure(int p) {
+    const XyConfig& cfg = configs[p];
+    XyPad& pad = pads[p];
+
+    pad.x_axis.store(cfg.x_axis);
+    pad.y_axis.store(cfg.y_axis);
+    pad.mode.store(cfg.mode);
+    pad.channel.store(cfg.channel);
+    pad.cc_a.store(cfg.cc_a);
+    pad.cc_b.store(cfg.cc_b);
+    pad.deadzone.store(cfg.deadzone);
+    pad.square_gate.store(cfg.square_gate);
+}
+
+
+bool xy_init() {
+    for (int i = 0; i <= 256; i++) {
+        atan_table[i] = (Uint16)(SDL_atan(i / 256.0) * XY_ANGLE_STEPS / (2 * SDL_PI_D) + 0.5);
+    }
+    for (int p = 0; p < XY_PADS; p++) {
+        configure(p);
+        pads[p].sent_a = -1;
+        pads[p].sent_b = -1;
+    }
+    return true;
+}
+
+
+void xy_axis(int axis, Sint16 value) {
+    for (int p = 0; p < XY_PADS; p++) {
+        XyPad& pad = pads[p];
+        int position = SDL_max(value, -XY_FULL);
+        if (axis == pad.x_axis.load(std::memory_order_relaxed)) {
+            pad.x.store(position, std::memory_order_relaxed);
+            frame.moved[p] |= XY_MOVED_X;
+        }
+        else if (axis == pad.y_axis.load(std::memory_order_relaxed)) {
+            pad.y.store(-position, std::memory_order_relaxed); // joystick Y points down
+            frame.moved[p] |= XY_MOVED_Y;
+        }
+        else {
+            continue;
+        }
+        // Outside a frame every axis goes out alone.
+        if (frame.depth == 0 || frame.moved[p] == (XY_MOVED_X | XY_MOVED_Y)) {
+            frame.moved[p] = 0;
+            emit(pad);
+        }
+    }
+}
+
+
+void xy_frame_begin() {
+    frame.depth++;
+}
+
+
+// A pad with one axis moved goes out with the other where it was.
+void xy_frame_end() {
+    if (frame.depth == 0 || --frame.depth > 0) {
+        return;
+    }
+    for (int p = 0; p < XY_PADS; p++) {
+        if (frame.moved[p] != 0) {
+            frame.moved[p] = 0;
+            emit(pads[p]);
+        }
+    }
+}
+
+
+void xy_ui() {
+    static const char* mode_names[] = { "X/Y", "Radius/Angle" };
+
+    ImGui::SeparatorText("XY Pads");
+    ImGui::PushID("XY");
+    if (ImGui::BeginTable("XY", 8)) {
+        ImGui::TableSetupColumn("X");
+        ImGui::TableSetupColumn("Y");
+        ImGui::TableSetupColumn("Mode");
+        ImGui::TableSetupColumn("Chnl");
+        ImGui::TableSetupColumn("CC A");
+        ImGui::TableSetupColumn("CC B");
+        ImGui::TableSetupColumn("Dead");
+        ImGui::TableSetupColumn("Sq");
+        ImGui::TableHeadersRow();
+        for (int p = 0; p < XY_PADS; p++) {
+            XyConfig& cfg = configs[p];
+            bool changed = false;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::PushID(p);
+            changed |= ImGui::SliderInt("##X", &cfg.x_axis, -1, 15);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Y", &cfg.y_axis, -1, 15);
+            ImGui::TableNextColumn();
+            changed |= ImGui::Combo("##Mode", &cfg.mode, mode_names, 2);
+            ImGui::TableNextColumn();
+            int channel = cfg.channel + 1;
+            if (ImGui::SliderInt("##Chnl", &channel, 1, 16)) {
+                cfg.channel = channel - 1;
+                changed = true;
+            }
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##A", &cfg.cc_a, 0, 127);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##B", &cfg.cc_b, 0, 127);
+            ImGui::TableNextColumn();
+            changed |= ImGui::SliderInt("##Dead", &cfg.deadzone, 0, 16384);
+            ImGui::TableNextColumn();
+            changed |= ImGui::Checkbox("##Sq", &cfg.square_gate);
+            ImGui::PopID();
+            if (changed) {
+                configure(p);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::PopID();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+
+#define XY_PADS 2
+
+bool xy_init();
+
+// Combine two axes into X/Y or radius/angle CCs. In an input frame a pad goes
+// out once both of its axes moved, or at the end of the frame.
+void xy_axis(int axis, Sint16 value);
+
+// Called by mapping_frame_begin/end().
+void xy_frame_begin();
+void xy_frame_end();
+
+void xy_ui();
@@ -0,0 +1,188 @@
+/*
+ * Shows the stats MidiConsoleApplication exports in shared memory, refreshed
+ * every interval. Reading never holds up the app: a copy torn by a publish
+ * is thrown away and read again.
+ *
+ * Usage: MidiStats [interval ms]
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "../MidiConsoleApplication/stats_shm.h"
+
+#define DEFAULT_INTERVAL_MS 100
+#define MAX_TRIES 100
+
+static const char* backend_names[] = { "RtMidi", "ALSA Seq", "JACK" };
+
+
+// NULL while the app isn't running.
+static const StatsBlock* map_stats() {
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, STATS_SHM_NAME);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    const void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(StatsBlock));
+    CloseHandle(mapping); // the view keeps it open
+#else
+    int fd = shm_open(STATS_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    const void* memory = mmap(NULL, sizeof(StatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        memory = NULL;
+    }
+#endif
+    return (const StatsBlock*)memory;
+}
+
+
+static void unmap_stats(const StatsBlock* block) {
+#ifdef _WIN32
+    UnmapViewOfFile(block);
+#else
+    munmap((void*)block, sizeof(StatsBlock));
+#endif
+}
+
+
+static bool valid(const StatsBlock* block) {
+    bool ok = block->magic == STATS_MAGIC && block->version == STATS_VERSION && block->size == sizeof(StatsBlock);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ok;
+}
+
+
+// Returns false if the app kept publishing while we read.
+static bool read_stats(const StatsBlock* block, StatsData* data) {
+    for (int tries = 0; tries < MAX_TRIES; tries++) {
+        uint32_t before = block->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        memcpy(data, (const void*)&block->data, sizeof(StatsData));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (block->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static float latency_percentile(const uint32_t* counts, float share) {
+    uint32_t total = 0;
+    for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+        total += counts[i];
+    }
+    uint32_t seen = 0;
+    for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > 0 && seen >= total * share) {
+            return (i + 1) * STATS_LATENCY_BUCKET_US / 1000.0f;
+        }
+    }
+    return 0;
+}
+
+
+static void print_stats(const StatsData& data, const StatsData& previous, bool stale) {
+    // Home and clear, so the table redraws in place.
+    printf("\x1b[H\x1b[2J");
+    printf("MidiConsoleApplication stats, publish %u%s\n\n", data.publishes, stale ? " (not updating)" : "");
+    double seconds = (data.time_ns - previous.time_ns) / 1e9;
+
+    printf("Out Backend     Sent   Msg/s Coalesced  Dropped  Last ms   p50 ms   p99 ms  Queued RT/Off/Ev/CC\n");
+    for (int i = 0; i < STATS_OUTPUTS; i++) {
+        const StatsOutput& o = data.outputs[i];
+        if (!o.open) {
+            continue;
+        }
+        double rate = seconds > 0 && o.sent >= previous.outputs[i].sent ? (o.sent - previous.outputs[i].sent) / seconds : 0;
+        printf("%3d %-8s %8u %7.0f %9u %8u %8.2f %8.2f %8.2f  %u/%u/%u/%u\n", i + 1,
+            o.backend < 3 ? backend_names[o.backend] : "?", o.sent, rate, o.coalesced, o.dropped, o.latency_us / 1000.0f,
+            latency_percentile(o.histogram, 0.5f), latency_percentile(o.histogram, 0.99f),
+            o.queued[0], o.queued[1], o.queued[2], o.queued[3]);
+    }
+
+    printf("\nController                                  Id Out Chnl Queued  Dropped\n");
+    for (int i = 0; i < STATS_DEVICES; i++) {
+        const StatsDevice& d = data.devices[i];
+        if (d.id == 0) {
+            continue;
+        }
+        char channel[12];
+        if (d.channel < 0) {
+            snprintf(channel, sizeof(channel), "map");
+        }
+        else {
+            snprintf(channel, sizeof(channel), "%d", d.channel + 1);
+        }
+        printf("%-40.40s %5u %3d %4s %6u %8u\n", d.name, d.id, d.output + 1, channel, d.queued, d.dropped);
+    }
+    fflush(stdout);
+}
+
+
+int main(int argc, char* argv[]) {
+    int interval_ms = argc > 1 ? atoi(argv[1]) : DEFAULT_INTERVAL_MS;
+    if (interval_ms <= 0) {
+        fprintf(stderr, "Usage: %s [interval ms]\n", argv[0]);
+        return 1;
+    }
+#ifdef _WIN32
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(console, &mode)) {
+        SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+#endif
+
+    const StatsBlock* block = NULL;
+    StatsData data = {};
+    StatsData previous = {};
+    int unchanged = 0;
+    for (;;) {
+        if (block == NULL) {
+            block = map_stats();
+            if (block == NULL || !valid(block)) {
+                printf("\x1b[H\x1b[2JWaiting for MidiConsoleApplication...\n");
+                fflush(stdout);
+            }
+        }
+        // The app clears the magic when it quits.
+        if (block != NULL && !valid(block)) {
+            unmap_stats(block);
+            block = NULL;
+        }
+        if (block != NULL && read_stats(block, &data)) {
+            // Rates are over the time between the last two publishes seen.
+            unchanged = data.publishes == previous.publishes ? unchanged + 1 : 0;
+            if (unchanged == 0) {
+                print_stats(data, previous, false);
+                previous = data;
+            }
+            else if (unchanged * interval_ms >= 1000) {
+                print_stats(data, data, true);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+}